@@ -0,0 +1,182 @@
+#include "bench.h"
+#include "trace.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+static double tsc_hz;
+static pthread_once_t tsc_once = PTHREAD_ONCE_INIT;
+
+static void measure_tsc(void) {
+#ifdef BENCH_HAVE_TSC
+  uint64_t ns0 = bench_now_ns(), t0 = bench_cycles_start();
+  struct timespec pause = {0, 10000000};
+  while (nanosleep(&pause, &pause) == -1 && errno == EINTR)
+    ;
+  uint64_t ns1 = bench_now_ns(), t1 = bench_cycles_end();
+  tsc_hz = (double)(t1 - t0) * 1e9 / (ns1 - ns0);
+#else
+  tsc_hz = 1e9;
+#endif
+}
+
+double bench_tsc_hz(void) {
+  pthread_once(&tsc_once, measure_tsc);
+  return tsc_hz;
+}
+
+void bench_timer_print(FILE *out, const bench_timer *t) {
+  if (t->count == 0) {
+    fprintf(out, "%s: never ran\n", t->name);
+    return;
+  }
+  double ns = 1e9 / bench_tsc_hz();
+  double avg = (double)t->cycles / t->count;
+  fprintf(out,
+          "%s: %lu, avg %.0f min %lu max %lu cycles (avg %.1f min %.1f max "
+          "%.1f ns)\n",
+          t->name, (unsigned long)t->count, avg, (unsigned long)t->min,
+          (unsigned long)t->max, avg * ns, t->min * ns, t->max * ns);
+}
+
+void bench_suite_init(bench_suite *suite) {
+  memset(suite, 0, sizeof(*suite));
+  suite->samples = 11;
+  suite->sample_seconds = 0.02;
+  suite->out = stdout;
+  bench_counters_open(&suite->counters);
+}
+
+void bench_suite_release(bench_suite *suite) {
+  if (suite->counters.open)
+    bench_counters_close(&suite->counters);
+}
+
+static int compare_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+const bench_result *bench_run(bench_suite *suite, const char *name,
+                              bench_fn fn, void *arg) {
+  if ((suite->filter != NULL && strstr(name, suite->filter) == NULL) ||
+      suite->count == BENCH_MAX_RESULTS)
+    return NULL;
+  // warm up and find the iteration count: double until one call takes a
+  // tenth of a sample, then scale
+  uint64_t iterations = 1;
+  for (;;) {
+    uint64_t start = bench_now_ns();
+    fn(arg, iterations);
+    double seconds = (bench_now_ns() - start) / 1e9;
+    if (seconds >= suite->sample_seconds / 10 || iterations >= (1ull << 40)) {
+      double scale = seconds > 0 ? suite->sample_seconds / seconds : 10;
+      iterations = (uint64_t)(iterations * scale);
+      if (iterations == 0)
+        iterations = 1;
+      break;
+    }
+    iterations *= 2;
+  }
+  int samples = suite->samples > 0 ? suite->samples : 1;
+  double ns[samples], cycles[samples];
+  uint64_t sums[BENCH_COUNTERS] = {0};
+  bool counted = suite->counters.open;
+  for (int s = 0; s < samples; s++) {
+    TRACE_BEGIN(name);
+    if (counted)
+      bench_counters_start(&suite->counters);
+    uint64_t t0 = bench_now_ns(), c0 = bench_cycles_start();
+    fn(arg, iterations);
+    uint64_t c1 = bench_cycles_end(), t1 = bench_now_ns();
+    uint64_t values[BENCH_COUNTERS];
+    if (counted && bench_counters_stop(&suite->counters, values)) {
+      for (int i = 0; i < BENCH_COUNTERS; i++)
+        sums[i] += values[i];
+    } else {
+      counted = false;
+    }
+    TRACE_END(name);
+    ns[s] = (double)(t1 - t0) / iterations;
+    cycles[s] = (double)(c1 - c0) / iterations;
+  }
+  qsort(cycles, samples, sizeof(double), compare_double);
+  qsort(ns, samples, sizeof(double), compare_double);
+
+  bench_result *r = &suite->results[suite->count++];
+  memset(r, 0, sizeof(*r));
+  r->name = name;
+  r->ns_per_op = ns[samples / 2];
+  r->min_ns_per_op = ns[0];
+  r->cycles_per_op = cycles[samples / 2];
+  r->iterations = iterations;
+  r->samples = samples;
+  r->have_counters = counted;
+  for (int i = 0; counted && i < BENCH_COUNTERS; i++)
+    r->counters[i] = (double)sums[i] / ((double)iterations * samples);
+  if (suite->out != NULL) {
+    fprintf(suite->out, "%-32s %10.2f ns/op (min %.2f) %9.1f tsc cycles",
+            name, r->ns_per_op, r->min_ns_per_op, r->cycles_per_op);
+    if (counted)
+      fprintf(suite->out,
+              "  %.1f instructions %.3f cache misses %.3f branch misses",
+              r->counters[BENCH_INSTRUCTIONS], r->counters[BENCH_CACHE_MISSES],
+              r->counters[BENCH_BRANCH_MISSES]);
+    fputc('\n', suite->out);
+  }
+  return r;
+}
+
+bool bench_write_json(const bench_suite *suite, const char *path) {
+  FILE *f = fopen(path, "w");
+  if (f == NULL)
+    return false;
+  fprintf(f, "{\n  \"tsc_hz\": %.0f,\n  \"results\": [\n", bench_tsc_hz());
+  for (int i = 0; i < suite->count; i++) {
+    const bench_result *r = &suite->results[i];
+    // names are ours, no escaping
+    fprintf(f,
+            "    {\"name\": \"%s\", \"ns_per_op\": %.4f, \"min_ns_per_op\": "
+            "%.4f, \"cycles_per_op\": %.2f, \"iterations\": %lu, "
+            "\"samples\": %d",
+            r->name, r->ns_per_op, r->min_ns_per_op, r->cycles_per_op,
+            (unsigned long)r->iterations, r->samples);
+    for (int c = 0; r->have_counters && c < BENCH_COUNTERS; c++)
+      fprintf(f, ", \"%s\": %.4f", bench_counter_names[c], r->counters[c]);
+    fprintf(f, "}%s\n", i + 1 < suite->count ? "," : "");
+  }
+  fprintf(f, "  ]\n}\n");
+  if (fclose(f) == EOF)
+    return false;
+  return true;
+}
+
+int bench_compare(const bench_suite *suite, const char *path,
+                  double threshold, FILE *out) {
+  FILE *f = fopen(path, "r");
+  if (f == NULL)
+    return -1;
+  int slower = 0;
+  char line[1024];
+  while (fgets(line, sizeof(line), f) != NULL) {
+    char name[256];
+    double before;
+    if (sscanf(line, " {\"name\": \"%255[^\"]\", \"ns_per_op\": %lf", name,
+               &before) != 2)
+      continue;
+    for (int i = 0; i < suite->count; i++) {
+      const bench_result *r = &suite->results[i];
+      if (strcmp(r->name, name) != 0)
+        continue;
+      double change = before > 0 ? r->ns_per_op / before - 1 : 0;
+      if (change > threshold) {
+        fprintf(out, "slower: %-32s %10.2f -> %.2f ns/op (%+.1f%%)\n", name,
+                before, r->ns_per_op, change * 100);
+        slower++;
+      }
+    }
+  }
+  fclose(f);
+  return slower;
+}
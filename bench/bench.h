@@ -0,0 +1,143 @@
+#pragma once
+#include "perf_counters.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAVE_TSC 1
+#endif
+// timing for every module: clocks, scoped timers and a microbenchmark
+// runner with JSON output (see microbench.c for the suite)
+
+static inline uint64_t bench_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+// for benchmarks that time a whole run with their own loop
+static inline double bench_now_seconds(void) { return bench_now_ns() / 1e9; }
+// xorshift64 for test data, rand() takes a global lock
+static inline uint64_t bench_random(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+// time stamp counter around measured code: the fences keep the work before
+// start and after end from moving into the measurement (and the measured
+// work from moving out). without a TSC these are ns
+static inline uint64_t bench_cycles_start(void) {
+#ifdef BENCH_HAVE_TSC
+  _mm_lfence();
+  uint64_t t = __rdtsc();
+  _mm_lfence();
+  return t;
+#else
+  return bench_now_ns();
+#endif
+}
+static inline uint64_t bench_cycles_end(void) {
+#ifdef BENCH_HAVE_TSC
+  unsigned aux;
+  uint64_t t = __rdtscp(&aux);
+  _mm_lfence();
+  return t;
+#else
+  return bench_now_ns();
+#endif
+}
+// plain rdtsc without fences, for trace points: ~20 cycles cheaper and a
+// few cycles of reordering do not matter there
+static inline uint64_t bench_ticks(void) {
+#ifdef BENCH_HAVE_TSC
+  return __rdtsc();
+#else
+  return bench_now_ns();
+#endif
+}
+// ticks per second, measured once against CLOCK_MONOTONIC (10 ms on the
+// first call). the TSC of every cpu since ~2008 runs at a constant rate
+double bench_tsc_hz(void);
+
+// adds up the time of every pass through a scope:
+//   static bench_timer t = BENCH_TIMER("parse");
+//   { BENCH_SCOPE(&t); ... }
+typedef struct {
+  const char *name;
+  uint64_t count;
+  uint64_t cycles;
+  uint64_t min;
+  uint64_t max;
+} bench_timer;
+#define BENCH_TIMER(name) {(name), 0, 0, UINT64_MAX, 0}
+typedef struct {
+  bench_timer *timer;
+  uint64_t start;
+} bench_scope;
+static inline bench_scope bench_scope_begin(bench_timer *timer) {
+  return (bench_scope){timer, bench_cycles_start()};
+}
+static inline void bench_scope_end(bench_scope *scope) {
+  uint64_t cycles = bench_cycles_end() - scope->start;
+  bench_timer *t = scope->timer;
+  t->count++;
+  t->cycles += cycles;
+  if (cycles < t->min)
+    t->min = cycles;
+  if (cycles > t->max)
+    t->max = cycles;
+}
+#define BENCH_CONCAT_(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT_(a, b)
+// the timer runs until the enclosing block is left (gcc/clang cleanup)
+#define BENCH_SCOPE(timer)                                                    \
+  bench_scope BENCH_CONCAT(bench_scope_, __LINE__)                            \
+      __attribute__((cleanup(bench_scope_end))) = bench_scope_begin(timer)
+// "name: count, avg/min/max cycles (ns)"
+void bench_timer_print(FILE *out, const bench_timer *t);
+
+// microbenchmarks. fn runs the operation iterations times; the runner
+// finds an iteration count that takes about sample_seconds, then takes
+// samples of it and keeps the median per operation
+typedef void (*bench_fn)(void *arg, uint64_t iterations);
+#define BENCH_MAX_RESULTS 128
+typedef struct {
+  const char *name;
+  double ns_per_op; // median sample
+  double min_ns_per_op;
+  double cycles_per_op; // TSC, median sample
+  uint64_t iterations;  // per sample
+  int samples;
+  bool have_counters;
+  double counters[BENCH_COUNTERS]; // per operation, over all samples
+} bench_result;
+
+typedef struct {
+  const char *filter; // only names containing it, NULL: all
+  int samples;
+  double sample_seconds;
+  bench_counters counters; // used if counters.open
+  FILE *out;               // a line per result as it is done, NULL: quiet
+  int count;
+  bench_result results[BENCH_MAX_RESULTS];
+} bench_suite;
+
+// 11 samples of 20 ms, results to stdout, hardware counters if the kernel
+// allows them
+void bench_suite_init(bench_suite *suite);
+void bench_suite_release(bench_suite *suite);
+// runs one benchmark and keeps its result, NULL if the filter skips it or
+// the suite is full. name is kept as a pointer
+const bench_result *bench_run(bench_suite *suite, const char *name,
+                              bench_fn fn, void *arg);
+// {"tsc_hz": ..., "results": [{"name": ..., "ns_per_op": ...}, ...]} with
+// one result per line. false with errno set
+bool bench_write_json(const bench_suite *suite, const char *path);
+// reads a file of bench_write_json() and prints every benchmark that got
+// slower than threshold (0.1: 10 %) to out. returns how many did, -1 with
+// errno set if the file cannot be read
+int bench_compare(const bench_suite *suite, const char *path,
+                  double threshold, FILE *out);
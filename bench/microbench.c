@@ -0,0 +1,348 @@
+// the hot operations of every module through the bench.h runner: median
+// ns per operation of 11 samples, TSC cycles, and the hardware counters
+// when the kernel gives them (perf_counters.h).
+// --json writes the results, --compare reads such a file from an earlier
+// run and lists what got slower than --threshold percent (default 10), the
+// exit status is 1 then. --filter runs only names containing the string.
+// built with -DBENCH_TRACE the modules' trace points and one span per
+// sample go to --trace as Chrome trace JSON.
+// build (from bench/):
+//   gcc -O2 -msse4.2 -Wall microbench.c bench.c perf_counters.c trace.c
+//     ../circular_buffer/circular_buffer.c ../hash_table/hash_table.c
+//     ../hash_table/hash_functions.c ../string_builder/string_builder.c
+//     ../bitmap_image_man/src/{bitmap,data,draw}.c
+//     ../memory_pool/freelist.c ../memory_pool/bitmaplist.c
+//     ../udp_packet_pool/src/{protocol,stats,spsc,histogram}.c
+//     -lm -lpthread -o microbench
+// usage: microbench [--json out.json] [--compare base.json [--threshold %]]
+//                   [--filter name] [--trace out.json]
+#include "bench.h"
+#include "trace.h"
+#include "../bitmap_image_man/src/bitmap.h"
+#include "../circular_buffer/circular_buffer.h"
+#include "../hash_table/hash_table.h"
+#include "../memory_pool/bitmaplist.h"
+#include "../memory_pool/freelist.h"
+#include "../string_builder/string_builder.h"
+#include "../udp_packet_pool/src/histogram.h"
+#include "../udp_packet_pool/src/protocol.h"
+#include "../udp_packet_pool/src/spsc.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define KEYS 4096   // a power of two
+#define POINTS 4096 // a power of two
+#define BITMAP_SIZE 1024
+#define POOL_BATCH 32
+#define OBJECT_SIZE 64
+
+// results go here so the compiler cannot drop the work
+static volatile uint64_t sink;
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t xorshift(void) {
+  return bench_random(&rng_state);
+}
+
+// circular_buffer
+static void cb_byte(void *arg, uint64_t iterations) {
+  CircularBuffer *cb = arg;
+  uint8_t byte = 0, sum = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    cb_write(cb, byte++);
+    cb_read(cb, &byte);
+    sum += byte;
+  }
+  sink = sum;
+}
+static void cb_bulk(void *arg, uint64_t iterations) {
+  CircularBuffer *cb = arg;
+  uint8_t data[64] = {1}, out[64];
+  for (uint64_t i = 0; i < iterations; i++) {
+    cb_write_bulk(cb, data, sizeof(data));
+    cb_read_bulk(cb, out, sizeof(out));
+  }
+  sink = out[0];
+}
+
+// hash_table
+typedef struct {
+  ht *table;
+  char keys[KEYS][16];
+  char misses[KEYS][16];
+} ht_arg;
+static void ht_get_hit(void *arg, uint64_t iterations) {
+  ht_arg *a = arg;
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    found += hash_get(a->table, a->keys[i & (KEYS - 1)]) != NULL;
+  sink = found;
+}
+static void ht_get_miss(void *arg, uint64_t iterations) {
+  ht_arg *a = arg;
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    found += hash_get(a->table, a->misses[i & (KEYS - 1)]) != NULL;
+  sink = found;
+}
+// the key is copied by the table, tombstones build up and get rebuilt away
+static void ht_insert_delete(void *arg, uint64_t iterations) {
+  ht_arg *a = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    const char *key = a->misses[i & (KEYS - 1)];
+    hash_insert(a->table, (ht_entry){key, NULL});
+    hash_delete(a->table, key);
+  }
+}
+
+// string_builder: the builder is cleared every 4096 appends, so this is
+// mostly appending to a warm heap buffer
+static void sb_append16(void *arg, uint64_t iterations) {
+  Stringbuilder *sb = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if ((i & 4095) == 0)
+      clear_sb(sb);
+    sb_append_n(sb, "0123456789abcdef", 16);
+  }
+  sink = sb->length;
+}
+static void sb_u64(void *arg, uint64_t iterations) {
+  Stringbuilder *sb = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if ((i & 4095) == 0)
+      clear_sb(sb);
+    sb_append_u64(sb, i * 2654435761u);
+  }
+  sink = sb->length;
+}
+static void sb_format(void *arg, uint64_t iterations) {
+  Stringbuilder *sb = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    if ((i & 4095) == 0)
+      clear_sb(sb);
+    sb_append_format(sb, "%s=%lu;", "key", (unsigned long)i);
+  }
+  sink = sb->length;
+}
+
+// bitmap: random pixels of a 1024 x 1024 image, 128 KB so it stays in L2
+typedef struct {
+  Bitmap *bmp;
+  uint32_t x[POINTS];
+  uint32_t y[POINTS];
+} bitmap_arg;
+static void bmp_get(void *arg, uint64_t iterations) {
+  bitmap_arg *a = arg;
+  uint64_t white = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    size_t p = i & (POINTS - 1);
+    white += bitmap_get_pixel(a->bmp, a->x[p], a->y[p]);
+  }
+  sink = white;
+}
+static void bmp_set(void *arg, uint64_t iterations) {
+  bitmap_arg *a = arg;
+  for (uint64_t i = 0; i < iterations; i++) {
+    size_t p = i & (POINTS - 1);
+    bitmap_set_pixel(a->bmp, a->x[p], a->y[p], i & 1);
+  }
+}
+static void bmp_word(void *arg, uint64_t iterations) {
+  bitmap_arg *a = arg;
+  uint64_t bits = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    size_t p = i & (POINTS - 1);
+    bits ^= bitmap_get_word(a->bmp, a->x[p] / 64, a->y[p]);
+  }
+  sink = bits;
+}
+
+// memory_pool: POOL_BATCH objects alive at a time, allocated in a row and
+// freed in a row. one operation is an alloc and a free, the last round is
+// shorter so exactly iterations of them run
+static int pool_round(uint64_t i, uint64_t iterations) {
+  return iterations - i < POOL_BATCH ? (int)(iterations - i) : POOL_BATCH;
+}
+static void pool_freelist(void *arg, uint64_t iterations) {
+  FreeListPool *pool = arg;
+  void *objects[POOL_BATCH];
+  for (uint64_t i = 0; i < iterations; i += POOL_BATCH) {
+    int n = pool_round(i, iterations);
+    for (int k = 0; k < n; k++)
+      objects[k] = freelist_pool_alloc(pool);
+    for (int k = 0; k < n; k++)
+      freelist_pool_free(pool, objects[k]);
+  }
+}
+static void pool_bitmap(void *arg, uint64_t iterations) {
+  BitmapPool *pool = arg;
+  void *objects[POOL_BATCH];
+  for (uint64_t i = 0; i < iterations; i += POOL_BATCH) {
+    int n = pool_round(i, iterations);
+    for (int k = 0; k < n; k++)
+      objects[k] = bitmap_pool_alloc(pool);
+    for (int k = 0; k < n; k++)
+      bitmap_pool_free(pool, objects[k]);
+  }
+}
+static void pool_malloc(void *arg, uint64_t iterations) {
+  (void)arg;
+  void *objects[POOL_BATCH];
+  for (uint64_t i = 0; i < iterations; i += POOL_BATCH) {
+    int n = pool_round(i, iterations);
+    for (int k = 0; k < n; k++)
+      objects[k] = malloc(OBJECT_SIZE);
+    for (int k = 0; k < n; k++)
+      free(objects[k]);
+  }
+}
+
+// udp_packet_pool
+static void udp_crc(void *arg, uint64_t iterations) {
+  uint32_t crc = 0;
+  for (uint64_t i = 0; i < iterations; i++)
+    crc = crc32c(crc, arg, 1400);
+  sink = crc;
+}
+// both ends on one thread: the cost of the index updates without the
+// cache line moving between cores
+static void udp_spsc(void *arg, uint64_t iterations) {
+  spsc_ring *ring = arg;
+  uint64_t sum = 0;
+  for (uint64_t i = 0; i < iterations; i++) {
+    spsc_push(ring, (void *)(uintptr_t)(i + 1));
+    sum += (uintptr_t)spsc_pop(ring);
+  }
+  sink = sum;
+}
+static void udp_histogram(void *arg, uint64_t iterations) {
+  histogram *h = arg;
+  for (uint64_t i = 0; i < iterations; i++)
+    histogram_record(h, (i * 2654435761u) & 0xfffff);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: microbench [--json out.json] [--compare base.json "
+                  "[--threshold %%]] [--filter name] [--trace out.json]\n");
+}
+
+int main(int argc, char **argv) {
+  const char *json = NULL, *compare = NULL, *trace = NULL;
+  double threshold = 10;
+  bench_suite *suite = malloc(sizeof(bench_suite));
+  if (suite == NULL)
+    return 1;
+  bench_suite_init(suite);
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      json = argv[++i];
+    } else if (strcmp(argv[i], "--compare") == 0 && i + 1 < argc) {
+      compare = argv[++i];
+    } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+      threshold = atof(argv[++i]);
+    } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+      suite->filter = argv[++i];
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (!suite->counters.open)
+    printf("no hardware counters (%s), timing only\n", strerror(errno));
+  printf("tsc %.3f GHz\n", bench_tsc_hz() / 1e9);
+  TRACE_THREAD_NAME("microbench");
+
+  CircularBuffer *cb = create_buffer(4096);
+  bench_run(suite, "cb write+read byte", cb_byte, cb);
+  bench_run(suite, "cb bulk 64", cb_bulk, cb);
+  destroy_buffer(cb);
+
+  ht_arg *ha = malloc(sizeof(ht_arg));
+  ha->table = hash_create();
+  for (int i = 0; i < KEYS; i++) {
+    snprintf(ha->keys[i], sizeof(ha->keys[i]), "key%d", i);
+    snprintf(ha->misses[i], sizeof(ha->misses[i]), "miss%d", i);
+    hash_insert(ha->table, (ht_entry){ha->keys[i], NULL});
+  }
+  bench_run(suite, "ht get hit", ht_get_hit, ha);
+  bench_run(suite, "ht get miss", ht_get_miss, ha);
+  bench_run(suite, "ht insert+delete", ht_insert_delete, ha);
+  hash_destroy(ha->table);
+  free(ha);
+
+  Stringbuilder *sb = create_sb(16);
+  bench_run(suite, "sb append 16", sb_append16, sb);
+  bench_run(suite, "sb append u64", sb_u64, sb);
+  bench_run(suite, "sb append format", sb_format, sb);
+  destroy_sb(sb);
+
+  bitmap_arg *ba = malloc(sizeof(bitmap_arg));
+  for (int i = 0; i < POINTS; i++) {
+    ba->x[i] = xorshift() % BITMAP_SIZE;
+    ba->y[i] = xorshift() % BITMAP_SIZE;
+  }
+  const char *const layouts[] = {"packed", "row aligned", "tiled"};
+  static char names[3][3][48];
+  for (int l = 0; l < 3; l++) {
+    ba->bmp = bitmap_create_layout(BITMAP_SIZE, BITMAP_SIZE, l);
+    snprintf(names[l][0], sizeof(names[l][0]), "bitmap set pixel %s",
+             layouts[l]);
+    snprintf(names[l][1], sizeof(names[l][1]), "bitmap get pixel %s",
+             layouts[l]);
+    snprintf(names[l][2], sizeof(names[l][2]), "bitmap get word %s",
+             layouts[l]);
+    bench_run(suite, names[l][0], bmp_set, ba);
+    bench_run(suite, names[l][1], bmp_get, ba);
+    bench_run(suite, names[l][2], bmp_word, ba);
+    bitmap_destroy(ba->bmp);
+  }
+  free(ba);
+
+  FreeListPool *fp = freelist_pool_create(OBJECT_SIZE, POOL_BATCH);
+  bench_run(suite, "pool freelist alloc+free", pool_freelist, fp);
+  freelist_pool_destroy(fp);
+  BitmapPool *bp = bitmap_pool_create(OBJECT_SIZE, POOL_BATCH);
+  bench_run(suite, "pool bitmap alloc+free", pool_bitmap, bp);
+  bitmap_pool_destroy(bp);
+  bench_run(suite, "pool malloc+free", pool_malloc, NULL);
+
+  uint8_t payload[1400];
+  for (size_t i = 0; i < sizeof(payload); i++)
+    payload[i] = xorshift();
+  bench_run(suite, "udp crc32c 1400", udp_crc, payload);
+  spsc_ring *ring = spsc_create(1024);
+  bench_run(suite, "udp spsc push+pop", udp_spsc, ring);
+  spsc_destroy(ring);
+  histogram *h = malloc(sizeof(histogram));
+  histogram_reset(h);
+  bench_run(suite, "udp histogram record", udp_histogram, h);
+  free(h);
+
+  int status = 0;
+  if (json != NULL && !bench_write_json(suite, json)) {
+    fprintf(stderr, "%s: %d : %s\n", json, errno, strerror(errno));
+    status = 1;
+  }
+  if (compare != NULL) {
+    int slower = bench_compare(suite, compare, threshold / 100, stdout);
+    if (slower < 0) {
+      fprintf(stderr, "%s: %d : %s\n", compare, errno, strerror(errno));
+      status = 1;
+    } else {
+      printf("%d slower than %s by more than %.0f%%\n", slower, compare,
+             threshold);
+      if (slower > 0)
+        status = 1;
+    }
+  }
+  if (trace != NULL && !trace_dump_chrome(trace)) {
+    fprintf(stderr, "%s: %d : %s\n", trace, errno, strerror(errno));
+    status = 1;
+  }
+  bench_suite_release(suite);
+  free(suite);
+  return status;
+}
@@ -0,0 +1,72 @@
+#include "perf_counters.h"
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+const char *const bench_counter_names[BENCH_COUNTERS] = {
+    "cycles", "instructions", "cache_misses", "branch_misses"};
+static const uint64_t configs[BENCH_COUNTERS] = {
+    PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+// no glibc wrapper
+static int perf_event_open(struct perf_event_attr *attr, int group_fd) {
+  return syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+bool bench_counters_open(bench_counters *c) {
+  c->open = false;
+  for (int i = 0; i < BENCH_COUNTERS; i++)
+    c->fds[i] = -1;
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.disabled = i == 0; // the leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING;
+    c->fds[i] = perf_event_open(&attr, i == 0 ? -1 : c->fds[0]);
+    if (c->fds[i] == -1) {
+      int saved = errno;
+      bench_counters_close(c);
+      errno = saved;
+      return false;
+    }
+  }
+  c->open = true;
+  return true;
+}
+
+void bench_counters_close(bench_counters *c) {
+  for (int i = 0; i < BENCH_COUNTERS; i++) {
+    if (c->fds[i] != -1)
+      close(c->fds[i]);
+    c->fds[i] = -1;
+  }
+  c->open = false;
+}
+
+void bench_counters_start(bench_counters *c) {
+  ioctl(c->fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+  ioctl(c->fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+bool bench_counters_stop(bench_counters *c, uint64_t values[BENCH_COUNTERS]) {
+  ioctl(c->fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+  // nr, time_enabled, time_running, then one value per counter
+  uint64_t buf[3 + BENCH_COUNTERS];
+  if (read(c->fds[0], buf, sizeof(buf)) != (ssize_t)sizeof(buf) ||
+      buf[0] != BENCH_COUNTERS)
+    return false;
+  double scale = buf[2] > 0 ? (double)buf[1] / buf[2] : 0;
+  for (int i = 0; i < BENCH_COUNTERS; i++)
+    values[i] = (uint64_t)(buf[3 + i] * scale);
+  return true;
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+// hardware counters of the calling thread through perf_event_open, user
+// space only, as one group so all of them count over the same interval.
+// optional: kernels with perf_event_paranoid > 2, containers and VMs
+// without a PMU refuse them, then everything else works without
+enum {
+  BENCH_CYCLES,
+  BENCH_INSTRUCTIONS,
+  BENCH_CACHE_MISSES,
+  BENCH_BRANCH_MISSES,
+  BENCH_COUNTERS
+};
+extern const char *const bench_counter_names[BENCH_COUNTERS];
+
+typedef struct {
+  int fds[BENCH_COUNTERS]; // fds[0] leads the group
+  bool open;
+} bench_counters;
+
+// false with errno set if the kernel does not give us the counters
+bool bench_counters_open(bench_counters *c);
+void bench_counters_close(bench_counters *c);
+// reset to 0 and count
+void bench_counters_start(bench_counters *c);
+// stop counting and read all of them. a counter the PMU could only run part
+// of the time (multiplexed) is scaled up to the whole time
+bool bench_counters_stop(bench_counters *c, uint64_t values[BENCH_COUNTERS]);
@@ -0,0 +1,160 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include "bench.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+_Static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0,
+               "TRACE_RING_EVENTS power of two");
+
+// relaxed atomics are plain loads and stores on x86 and arm64, they only
+// keep the dump from being a data race
+typedef struct {
+  _Atomic uint64_t ticks;
+  _Atomic(const char *) name;
+  _Atomic int64_t value;
+  _Atomic char phase;
+} trace_record;
+
+// one per thread that ever traced, never freed: the events of a thread
+// that is gone still get dumped
+typedef struct trace_ring {
+  struct trace_ring *next;
+  int tid;
+  _Atomic(const char *) thread_name;
+  _Atomic uint64_t head; // events written so far
+  trace_record events[TRACE_RING_EVENTS];
+} trace_ring;
+
+static _Atomic(trace_ring *) rings;
+static __thread trace_ring *mine;
+static __thread bool failed;
+
+static trace_ring *ring_of_thread(void) {
+  if (mine != NULL || failed)
+    return mine;
+  trace_ring *r = calloc(1, sizeof(trace_ring));
+  if (r == NULL) {
+    failed = true;
+    return NULL;
+  }
+  r->tid = syscall(SYS_gettid);
+  r->next = atomic_load_explicit(&rings, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+      &rings, &r->next, r, memory_order_release, memory_order_relaxed))
+    ;
+  mine = r;
+  return r;
+}
+
+void trace_event(const char *name, char phase, int64_t value) {
+  trace_ring *r = ring_of_thread();
+  if (r == NULL)
+    return;
+  uint64_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  trace_record *e = &r->events[h & (TRACE_RING_EVENTS - 1)];
+  // a dump that sees any of the stores below also sees head == h and knows
+  // the slot is being overwritten (the writing half of a seqlock)
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&e->ticks, bench_ticks(), memory_order_relaxed);
+  atomic_store_explicit(&e->name, name, memory_order_relaxed);
+  atomic_store_explicit(&e->value, value, memory_order_relaxed);
+  atomic_store_explicit(&e->phase, phase, memory_order_relaxed);
+  atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+void trace_thread_name(const char *name) {
+  trace_ring *r = ring_of_thread();
+  if (r != NULL)
+    atomic_store_explicit(&r->thread_name, name, memory_order_relaxed);
+}
+
+typedef struct {
+  uint64_t ticks;
+  const char *name;
+  int64_t value;
+  char phase;
+} trace_copy;
+
+// the events of one ring that were not overwritten while we read them,
+// oldest first. returns how many
+static int copy_ring(trace_ring *r, trace_copy *out) {
+  uint64_t h1 = atomic_load_explicit(&r->head, memory_order_acquire);
+  uint64_t first = h1 > TRACE_RING_EVENTS ? h1 - TRACE_RING_EVENTS : 0;
+  for (uint64_t i = first; i < h1; i++) {
+    trace_record *e = &r->events[i & (TRACE_RING_EVENTS - 1)];
+    trace_copy *c = &out[i - first];
+    c->ticks = atomic_load_explicit(&e->ticks, memory_order_relaxed);
+    c->name = atomic_load_explicit(&e->name, memory_order_relaxed);
+    c->value = atomic_load_explicit(&e->value, memory_order_relaxed);
+    c->phase = atomic_load_explicit(&e->phase, memory_order_relaxed);
+  }
+  atomic_thread_fence(memory_order_acquire);
+  uint64_t h2 = atomic_load_explicit(&r->head, memory_order_relaxed);
+  // event i is safe unless the writer got to i + TRACE_RING_EVENTS
+  uint64_t safe = h2 >= TRACE_RING_EVENTS ? h2 - TRACE_RING_EVENTS + 1 : 0;
+  if (safe <= first)
+    return h1 - first;
+  if (safe >= h1)
+    return 0;
+  memmove(out, out + (safe - first), (h1 - safe) * sizeof(trace_copy));
+  return h1 - safe;
+}
+
+bool trace_dump_chrome(const char *path) {
+  trace_copy *events = malloc(TRACE_RING_EVENTS * sizeof(trace_copy));
+  if (events == NULL)
+    return false;
+  FILE *f = fopen(path, "w");
+  if (f == NULL) {
+    free(events);
+    return false;
+  }
+  trace_ring *head = atomic_load_explicit(&rings, memory_order_acquire);
+  // time 0 is the oldest event still in a ring
+  uint64_t base = UINT64_MAX;
+  for (trace_ring *r = head; r != NULL; r = r->next) {
+    int n = copy_ring(r, events);
+    if (n > 0 && events[0].ticks < base)
+      base = events[0].ticks;
+  }
+  double us = 1e6 / bench_tsc_hz();
+  int pid = getpid();
+  bool comma = false;
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (trace_ring *r = head; r != NULL; r = r->next) {
+    const char *thread =
+        atomic_load_explicit(&r->thread_name, memory_order_relaxed);
+    if (thread != NULL) {
+      fprintf(f,
+              "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+              "\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+              comma ? ",\n" : "", pid, r->tid, thread);
+      comma = true;
+    }
+    int n = copy_ring(r, events);
+    for (int i = 0; i < n; i++) {
+      trace_copy *e = &events[i];
+      // names are literals of ours, no escaping
+      double ts = e->ticks > base ? (e->ticks - base) * us : 0;
+      fprintf(f,
+              "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,"
+              "\"tid\":%d",
+              comma ? ",\n" : "", e->name, e->phase, ts, pid, r->tid);
+      if (e->phase == 'i')
+        fprintf(f, ",\"s\":\"t\"");
+      else if (e->phase == 'C')
+        fprintf(f, ",\"args\":{\"value\":%ld}", (long)e->value);
+      fputc('}', f);
+      comma = true;
+    }
+  }
+  fprintf(f, "\n]}\n");
+  free(events);
+  if (fclose(f) == EOF)
+    return false;
+  return true;
+}
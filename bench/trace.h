@@ -0,0 +1,51 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+// trace points for hot paths. compiled with -DBENCH_TRACE every point
+// writes an event (rdtsc, name, phase) into a ring of the calling thread
+// with plain stores, no locks and no shared cache lines; without it they
+// are gone. trace_dump_chrome() writes what the rings hold as Chrome trace
+// JSON (chrome://tracing, ui.perfetto.dev). a ring keeps the last
+// TRACE_RING_EVENTS events of its thread, older ones are overwritten.
+// names must be string literals or live as long as the process
+#define TRACE_RING_EVENTS 16384 // a power of two
+
+#ifdef BENCH_TRACE
+void trace_event(const char *name, char phase, int64_t value);
+void trace_thread_name(const char *name);
+typedef struct {
+  const char *name;
+} trace_scope;
+static inline trace_scope trace_scope_begin(const char *name) {
+  trace_event(name, 'B', 0);
+  return (trace_scope){name};
+}
+static inline void trace_scope_end(trace_scope *scope) {
+  trace_event(scope->name, 'E', 0);
+}
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_BEGIN(name) trace_event((name), 'B', 0)
+#define TRACE_END(name) trace_event((name), 'E', 0)
+#define TRACE_INSTANT(name) trace_event((name), 'i', 0)
+#define TRACE_COUNTER(name, value) trace_event((name), 'C', (value))
+#define TRACE_THREAD_NAME(name) trace_thread_name(name)
+// begin here, end when the enclosing block is left
+#define TRACE_SCOPE(name)                                                     \
+  trace_scope TRACE_CONCAT(trace_scope_, __LINE__)                            \
+      __attribute__((cleanup(trace_scope_end))) = trace_scope_begin(name)
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+#define TRACE_INSTANT(name) ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_SCOPE(name) ((void)0)
+#endif
+
+// every event of every thread so far, timestamps in us from the first.
+// safe while the threads keep tracing (events they overwrite during the
+// dump are left out). without BENCH_TRACE the file has no events. false
+// with errno set
+bool trace_dump_chrome(const char *path);
@@ -0,0 +1,71 @@
+// 16K x 16K (32 MB) image: old pixel at a time drawing vs the span kernels
+#include "../../bench/bench.h"
+#include "bitmap.h"
+#include "draw.h"
+#include <stdio.h>
+#define SIZE 16384
+
+static void report(const char *name, double start, double pixels) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-34s %9.3f ms  %9.1f Mpixel/s\n", name, elapsed * 1e3,
+         pixels / elapsed / 1e6);
+}
+// the loops bitmap_fill_rect() used before, column by column
+static void fill_rect_per_pixel(Bitmap *bmp, uint32_t x, uint32_t y,
+                                uint32_t width, uint32_t height, bool white) {
+  for (uint32_t i = x; i < x + width; i++)
+    for (uint32_t b = y; b < y + height; b++)
+      bitmap_set_pixel(bmp, i, b, white);
+}
+
+int main() {
+  Bitmap *bmp = bitmap_create(SIZE, SIZE);
+  Bitmap *other = bitmap_create(SIZE, SIZE);
+  double full = (double)SIZE * SIZE;
+  double inner = (double)(SIZE - 6) * (SIZE - 6);
+
+  double start = bench_now_seconds();
+  fill_rect_per_pixel(bmp, 3, 3, SIZE - 6, SIZE - 6, 1);
+  report("fill_rect pixel at a time", start, inner);
+  start = bench_now_seconds();
+  bitmap_fill_rect(bmp, 3, 3, SIZE - 6, SIZE - 6, 0);
+  report("fill_rect spans (unaligned x)", start, inner);
+  start = bench_now_seconds();
+  bitmap_fill_rect(bmp, 0, 0, SIZE, SIZE, 1);
+  report("fill_rect full rows (one memset)", start, full);
+
+  start = bench_now_seconds();
+  for (uint32_t y = 0; y < SIZE; y += 2)
+    for (uint32_t x = 1; x < SIZE - 1; x++)
+      bitmap_set_pixel(bmp, x, y, 0);
+  report("hlines pixel at a time", start, full / 2);
+  start = bench_now_seconds();
+  for (uint32_t y = 0; y < SIZE; y += 2)
+    bitmap_draw_hline(bmp, 1, y, SIZE - 2, 0);
+  report("hlines spans", start, full / 2);
+
+  start = bench_now_seconds();
+  for (uint32_t x = 0; x < SIZE; x += 64)
+    for (uint32_t y = 0; y < SIZE; y++)
+      bitmap_set_pixel(bmp, x, y, 1);
+  report("vlines pixel at a time", start, full / 64);
+  start = bench_now_seconds();
+  for (uint32_t x = 0; x < SIZE; x += 64)
+    bitmap_draw_vline(bmp, x, 0, SIZE, 1);
+  report("vlines incremental index", start, full / 64);
+
+  bitmap_fill_rect(other, 100, 100, 8000, 8000, 1);
+  start = bench_now_seconds();
+  bitmap_blit(bmp, 5, 7, other, 0, 0, SIZE - 5, SIZE - 7, BITMAP_COPY);
+  report("blit copy (different bit phase)", start, full);
+  start = bench_now_seconds();
+  bitmap_blit(bmp, 8, 0, other, 0, 0, SIZE - 8, SIZE, BITMAP_OR);
+  report("blit or (same bit phase)", start, full);
+  start = bench_now_seconds();
+  bitmap_raster_op(bmp, other, BITMAP_XOR);
+  report("raster xor (whole bitmap)", start, full);
+
+  bitmap_destroy(bmp);
+  bitmap_destroy(other);
+  return 0;
+}
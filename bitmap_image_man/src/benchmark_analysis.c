@@ -0,0 +1,72 @@
+// morphology and connected component labeling on a 10000 x 10000 (100
+// megapixel) image of random rectangles, 1 .. max threads strips.
+// usage: benchmark_analysis [max threads]
+#include "../../bench/bench.h"
+#include "bitmap.h"
+#include "draw.h"
+#include "label.h"
+#include "morphology.h"
+#include <stdio.h>
+#include <stdlib.h>
+#define SIZE 10000
+#define RECTS 400000
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint32_t next_random(void) {
+  return bench_random(&rng_state);
+}
+static void report(const char *name, int threads, double elapsed,
+                   double single) {
+  double pixels = (double)SIZE * SIZE;
+  printf("%-20s %3d threads %9.1f ms %9.1f Mpixel/s  speedup %5.2f\n", name,
+         threads, elapsed * 1e3, pixels / elapsed / 1e6, single / elapsed);
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  Bitmap *bmp = bitmap_create(SIZE, SIZE);
+  Bitmap *out = bitmap_create(SIZE, SIZE);
+  // about half white, lots of touching rectangles and small specks
+  for (int i = 0; i < RECTS; i++)
+    bitmap_fill_rect(bmp, next_random() % SIZE, next_random() % SIZE,
+                     1 + next_random() % 24, 1 + next_random() % 24, 1);
+
+  double single[4] = {0};
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double start = bench_now_seconds();
+    bitmap_dilate(out, bmp, 1, threads);
+    double elapsed = bench_now_seconds() - start;
+    if (threads == 1)
+      single[0] = elapsed;
+    report("dilate r=1", threads, elapsed, single[0]);
+
+    start = bench_now_seconds();
+    bitmap_open(out, bmp, 3, threads);
+    elapsed = bench_now_seconds() - start;
+    if (threads == 1)
+      single[1] = elapsed;
+    report("open r=3", threads, elapsed, single[1]);
+
+    uint32_t count;
+    start = bench_now_seconds();
+    uint32_t *labels = bitmap_label(bmp, 8, threads, &count);
+    elapsed = bench_now_seconds() - start;
+    if (threads == 1)
+      single[2] = elapsed;
+    report("label 8-connected", threads, elapsed, single[2]);
+    free(labels);
+
+    start = bench_now_seconds();
+    labels = bitmap_label(bmp, 4, threads, &count);
+    elapsed = bench_now_seconds() - start;
+    if (threads == 1)
+      single[3] = elapsed;
+    report("label 4-connected", threads, elapsed, single[3]);
+    if (threads == 1)
+      printf("(%u 4-connected components)\n", count);
+    free(labels);
+  }
+  bitmap_destroy(bmp);
+  bitmap_destroy(out);
+  return 0;
+}
@@ -0,0 +1,154 @@
+// dense Bitmap vs CompressedBitmap on 16K x 16K (256 Mpixel) images at
+// several densities: memory, popcount, find first zero, and/or/xor,
+// conversion and random get
+#include "../../bench/bench.h"
+#include "bitmap.h"
+#include "cbitmap.h"
+#include "draw.h"
+#include <stdio.h>
+#include <string.h>
+#define SIZE 16384
+#define LOOKUPS 1000000
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t next_random(void) {
+  return bench_random(&rng_state);
+}
+// random pixels with about 1 / 2^shift white (shift 0 = all white),
+// inverted for the mostly white images
+static void fill_random(Bitmap *bmp, unsigned shift, bool invert) {
+  size_t words = bytes_needed(bmp->width, bmp->height) / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word = ~0ULL;
+    for (unsigned s = 0; s < shift; s++)
+      word &= next_random();
+    if (invert)
+      word = ~word;
+    memcpy(bmp->data + i * 8, &word, 8);
+  }
+}
+static void sparse_points(Bitmap *bmp, uint64_t count) {
+  memset(bmp->data, 0, bytes_needed(bmp->width, bmp->height));
+  for (uint64_t i = 0; i < count; i++)
+    bitmap_set_pixel(bmp, next_random() % SIZE, next_random() % SIZE, 1);
+}
+static uint64_t dense_popcount(const Bitmap *bmp) {
+  uint64_t count = 0;
+  size_t words = bytes_needed(bmp->width, bmp->height) / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word;
+    memcpy(&word, bmp->data + i * 8, 8);
+    count += __builtin_popcountll(word);
+  }
+  return count;
+}
+static uint64_t dense_first_zero(const Bitmap *bmp) {
+  size_t words = bytes_needed(bmp->width, bmp->height) / 8;
+  for (size_t i = 0; i < words; i++) {
+    uint64_t word;
+    memcpy(&word, bmp->data + i * 8, 8);
+    if (word != ~0ULL)
+      return i * 64 + __builtin_ctzll(~word);
+  }
+  return words * 64;
+}
+
+static void run(const char *name, Bitmap *a, Bitmap *b) {
+  double start = bench_now_seconds();
+  CompressedBitmap *ca = cbitmap_from_bitmap(a);
+  double convert = bench_now_seconds() - start;
+  CompressedBitmap *cb = cbitmap_from_bitmap(b);
+  double dense_mb = bytes_needed(SIZE, SIZE) / 1e6;
+  printf("%-22s density %8.5f%%  dense %7.2f MB  compressed %9.4f MB  "
+         "(%zu chunks)\n",
+         name, 100.0 * dense_popcount(a) / ((double)SIZE * SIZE), dense_mb,
+         cbitmap_memory(ca) / 1e6, ca->count);
+
+  uint64_t sink = 0;
+  start = bench_now_seconds();
+  sink += dense_popcount(a);
+  double dense_time = bench_now_seconds() - start;
+  start = bench_now_seconds();
+  sink += cbitmap_popcount(ca);
+  printf("  %-18s dense %9.3f ms  compressed %9.3f ms\n", "popcount",
+         dense_time * 1e3, (bench_now_seconds() - start) * 1e3);
+
+  uint32_t x, y;
+  start = bench_now_seconds();
+  sink += dense_first_zero(a);
+  dense_time = bench_now_seconds() - start;
+  start = bench_now_seconds();
+  sink += cbitmap_find_first_zero(ca, &x, &y);
+  printf("  %-18s dense %9.3f ms  compressed %9.3f ms\n", "find first zero",
+         dense_time * 1e3, (bench_now_seconds() - start) * 1e3);
+
+  static const char *ops[] = {"copy", "and", "or", "xor"};
+  Bitmap *result = bitmap_create(SIZE, SIZE);
+  for (int op = BITMAP_AND; op <= BITMAP_XOR; op++) {
+    memcpy(result->data, a->data, bytes_needed(SIZE, SIZE));
+    start = bench_now_seconds();
+    bitmap_raster_op(result, b, op);
+    dense_time = bench_now_seconds() - start;
+    start = bench_now_seconds();
+    CompressedBitmap *cr = cbitmap_combine(ca, cb, op);
+    printf("  %-18s dense %9.3f ms  compressed %9.3f ms  (result %.4f MB)\n",
+           ops[op], dense_time * 1e3, (bench_now_seconds() - start) * 1e3,
+           cbitmap_memory(cr) / 1e6);
+    cbitmap_destroy(cr);
+  }
+  bitmap_destroy(result);
+
+  start = bench_now_seconds();
+  for (int i = 0; i < LOOKUPS; i++)
+    sink += bitmap_get_pixel(a, next_random() % SIZE, next_random() % SIZE);
+  dense_time = bench_now_seconds() - start;
+  start = bench_now_seconds();
+  for (int i = 0; i < LOOKUPS; i++)
+    sink += cbitmap_get(ca, next_random() % SIZE, next_random() % SIZE);
+  printf("  %-18s dense %9.3f ms  compressed %9.3f ms\n", "1M random get",
+         dense_time * 1e3, (bench_now_seconds() - start) * 1e3);
+
+  start = bench_now_seconds();
+  Bitmap *back = cbitmap_to_bitmap(ca);
+  printf("  %-18s from dense %7.3f ms  to dense %9.3f ms\n", "conversion",
+         convert * 1e3, (bench_now_seconds() - start) * 1e3);
+  bitmap_destroy(back);
+  if (sink == 42)
+    printf("\n");
+  cbitmap_destroy(ca);
+  cbitmap_destroy(cb);
+}
+
+int main() {
+  Bitmap *a = bitmap_create(SIZE, SIZE);
+  Bitmap *b = bitmap_create(SIZE, SIZE);
+
+  sparse_points(a, 2000);
+  sparse_points(b, 2000);
+  run("2000 random points", a, b);
+  sparse_points(a, 2000000);
+  sparse_points(b, 2000000);
+  run("2M random points", a, b);
+  fill_random(a, 4, false);
+  fill_random(b, 4, false);
+  run("random 1/16", a, b);
+  fill_random(a, 1, false);
+  fill_random(b, 1, false);
+  run("random 1/2", a, b);
+  fill_random(a, 10, true);
+  fill_random(b, 10, true);
+  run("random 1023/1024", a, b);
+  memset(a->data, 0, bytes_needed(SIZE, SIZE));
+  memset(b->data, 0, bytes_needed(SIZE, SIZE));
+  for (int i = 0; i < 200; i++) {
+    bitmap_fill_rect(a, next_random() % SIZE, next_random() % SIZE, 2000,
+                     500, 1);
+    bitmap_fill_rect(b, next_random() % SIZE, next_random() % SIZE, 2000,
+                     500, 1);
+  }
+  run("200 large rectangles", a, b);
+
+  bitmap_destroy(a);
+  bitmap_destroy(b);
+  return 0;
+}
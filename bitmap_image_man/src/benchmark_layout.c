@@ -0,0 +1,81 @@
+// packed vs row aligned vs tiled: pixel access along rows and columns,
+// rect fills and transpose on an 8K x 8K (8 MB) image
+#include "../../bench/bench.h"
+#include "bitmap.h"
+#include "draw.h"
+#include <stdio.h>
+#define SIZE 8192
+#define RECTS 200000
+
+static void report(const char *layout, const char *name, double start,
+                   double pixels) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-12s %-28s %9.3f ms  %9.1f Mpixel/s\n", layout, name,
+         elapsed * 1e3, pixels / elapsed / 1e6);
+}
+static uint64_t rng_state = 88172645463325252ULL;
+static uint32_t next_random(void) {
+  return bench_random(&rng_state);
+}
+// the obvious transpose, one get/set per pixel
+static void transpose_per_pixel(Bitmap *dst, Bitmap *src) {
+  for (uint32_t y = 0; y < src->height; y++)
+    for (uint32_t x = 0; x < src->width; x++)
+      bitmap_set_pixel(dst, y, x, bitmap_get_pixel(src, x, y));
+}
+
+int main() {
+  static const char *names[] = {"packed", "row aligned", "tiled"};
+  // odd size: the packed rows start at every bit phase
+  uint32_t odd = SIZE - 3;
+  for (int layout = BITMAP_PACKED; layout <= BITMAP_TILED; layout++) {
+    const char *name = names[layout];
+    Bitmap *bmp = bitmap_create_layout(odd, odd, layout);
+    Bitmap *other = bitmap_create_layout(odd, odd, layout);
+    double pixels = (double)odd * odd;
+    for (uint32_t i = 0; i < odd; i += 3)
+      bitmap_draw_hline(bmp, 0, i, odd, 1);
+
+    double start = bench_now_seconds();
+    unsigned long count = 0;
+    for (uint32_t y = 0; y < odd; y++)
+      for (uint32_t x = 0; x < odd; x++)
+        count += bitmap_get_pixel(bmp, x, y);
+    report(name, "get_pixel row order", start, pixels);
+    start = bench_now_seconds();
+    for (uint32_t x = 0; x < odd; x++)
+      for (uint32_t y = 0; y < odd; y++)
+        count += bitmap_get_pixel(bmp, x, y);
+    report(name, "get_pixel column order", start, pixels);
+    start = bench_now_seconds();
+    for (uint32_t y = 0; y < odd; y++)
+      for (uint32_t x = 0; x < (odd + 63) / 64; x++)
+        count += __builtin_popcountll(bitmap_get_word(bmp, x, y));
+    report(name, "get_word popcount", start, pixels);
+
+    start = bench_now_seconds();
+    bitmap_fill_rect(bmp, 3, 3, odd - 6, odd - 6, 0);
+    report(name, "fill_rect whole image", start, pixels);
+    double area = 0;
+    start = bench_now_seconds();
+    for (int i = 0; i < RECTS; i++) {
+      uint32_t w = 8 + next_random() % 57, h = 8 + next_random() % 57;
+      bitmap_fill_rect(bmp, next_random() % odd, next_random() % odd, w, h,
+                       i & 1);
+      area += w * h;
+    }
+    report(name, "fill_rect 8..64 random", start, area);
+
+    start = bench_now_seconds();
+    transpose_per_pixel(other, bmp);
+    report(name, "transpose per pixel", start, pixels);
+    start = bench_now_seconds();
+    bitmap_transpose(other, bmp);
+    report(name, "transpose 64x64 blocks", start, pixels);
+    if (count == 0)
+      printf("(empty image)\n");
+    bitmap_destroy(bmp);
+    bitmap_destroy(other);
+  }
+  return 0;
+}
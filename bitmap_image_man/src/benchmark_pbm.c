@@ -0,0 +1,74 @@
+// MB/s of the file formats: P4 save, mmap load, row streaming and the
+// ascii dump (old fprintf per pixel vs one write per row)
+// usage: ./benchmark_pbm [size] [directory]   (default 16384, /tmp)
+#include "../../bench/bench.h"
+#include "bitmap.h"
+#include "draw.h"
+#include "pbm.h"
+#include <stdlib.h>
+
+static void report(const char *name, double start, double bytes) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-28s %8.3f s  %9.1f MB/s\n", name, elapsed, bytes / elapsed / 1e6);
+}
+// how bitmap_save_ascii() worked before
+static void save_ascii_per_pixel(Bitmap *bmp, const char *filename) {
+  FILE *savedfile = fopen(filename, "w");
+  for (uint32_t h = 0; h < bmp->height; h++) {
+    for (uint32_t w = 0; w < bmp->width; w++)
+      fprintf(savedfile, bitmap_get_pixel(bmp, w, h) ? "#" : ".");
+    fprintf(savedfile, "\n");
+  }
+  fclose(savedfile);
+}
+
+int main(int argc, char **argv) {
+  uint32_t size = argc > 1 ? strtoul(argv[1], NULL, 10) : 16384;
+  const char *dir = argc > 2 ? argv[2] : "/tmp";
+  char pbm_file[512], ascii_file[512];
+  snprintf(pbm_file, sizeof(pbm_file), "%s/bitmap_bench.pbm", dir);
+  snprintf(ascii_file, sizeof(ascii_file), "%s/bitmap_bench.txt", dir);
+
+  // odd width so rows do not start on byte boundaries
+  Bitmap *bmp = bitmap_create(size - 3, size);
+  for (uint32_t y = 0; y < size; y += 3)
+    bitmap_draw_hline(bmp, y % 17, y, size, 1);
+  bitmap_fill_rect(bmp, size / 4, size / 4, size / 2, size / 2, 1);
+  double pbm_bytes = (double)((bmp->width + 7) / 8) * bmp->height;
+
+  double start = bench_now_seconds();
+  bitmap_save_pbm(bmp, pbm_file);
+  report("bitmap_save_pbm", start, pbm_bytes);
+
+  start = bench_now_seconds();
+  Bitmap *loaded = bitmap_load_pbm(pbm_file);
+  report("bitmap_load_pbm (mmap)", start, pbm_bytes);
+
+  start = bench_now_seconds();
+  PbmStream *pbm = pbm_reader_open(pbm_file);
+  uint8_t *row = malloc(pbm->row_bytes + BITMAP_PADDING);
+  size_t white = 0;
+  while (pbm_read_row(pbm, row))
+    white += row[0] & 1;
+  pbm_close(pbm);
+  report("pbm_read_row streaming", start, pbm_bytes);
+  free(row);
+
+  // the ascii format is 8x bigger per pixel, keep it to a 4K image
+  Bitmap *small = bitmap_create(4096, 4096);
+  bitmap_blit(small, 0, 0, loaded, 0, 0, 4096, 4096, BITMAP_COPY);
+  double ascii_bytes = 4097.0 * 4096;
+  start = bench_now_seconds();
+  save_ascii_per_pixel(small, ascii_file);
+  report("ascii fprintf per pixel (4K)", start, ascii_bytes);
+  start = bench_now_seconds();
+  bitmap_save_ascii(small, ascii_file);
+  report("bitmap_save_ascii rows (4K)", start, ascii_bytes);
+
+  remove(pbm_file);
+  remove(ascii_file);
+  bitmap_destroy(small);
+  bitmap_destroy(loaded);
+  bitmap_destroy(bmp);
+  return white == 0;
+}
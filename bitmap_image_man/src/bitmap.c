@@ -1,32 +1,53 @@
 #include "bitmap.h"
+#include "draw.h"
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 /* TODO:
  * - ADD BOUNDS CHECKING
  * - ADD NULL CHECK AFTER MALLOC/CALLOC*/
 Bitmap *bitmap_create(uint32_t width, uint32_t height) {
+  return bitmap_create_layout(width, height, BITMAP_PACKED);
+}
+Bitmap *bitmap_create_layout(uint32_t width, uint32_t height,
+                             BitmapLayout layout) {
   // allocate memory to bitmap
   Bitmap *bitmap = malloc(sizeof(Bitmap));
-  bitmap->data = calloc(bytes_needed(width, height), 1);
+  // the pad bits of the aligned layouts are zero and stay zero, every
+  // write is clipped to the width
+  bitmap->data =
+      calloc(bitmap_layout_bytes(width, height, layout) + BITMAP_PADDING, 1);
   bitmap->width = width;
   bitmap->height = height;
+  bitmap->layout = layout;
+  switch (layout) {
+  case BITMAP_PACKED:
+    bitmap->stride = width;
+    break;
+  case BITMAP_ROW_ALIGNED:
+    bitmap->stride = ((uint64_t)width + 63) / 64 * 64;
+    break;
+  case BITMAP_TILED:
+    bitmap->stride = ((uint64_t)width + 63) / 64;
+    break;
+  }
   return bitmap;
 }
 void bitmap_destroy(Bitmap *bmp) {
   free(bmp->data);
-  free(bmp);
   bmp->height = 0;
   bmp->width = 0;
   bmp->data = NULL;
+  free(bmp);
 }
 
 void bitmap_set_pixel(Bitmap *bmp, uint32_t x, uint32_t y, bool white) {
-  uint32_t bit_index = y * bmp->width + x;
-  uint16_t byte_index = bit_index / 8;
-  int16_t bit_offset = bit_index % 8;
+  uint64_t bit_index = bitmap_bit_index(bmp, x, y);
+  size_t byte_index = bit_index / 8;
+  int bit_offset = bit_index % 8;
   if (white) {
     bmp->data[byte_index] |= (1 << bit_offset);
   } else {
@@ -35,31 +56,73 @@ void bitmap_set_pixel(Bitmap *bmp, uint32_t x, uint32_t y, bool white) {
 }
 
 bool bitmap_get_pixel(Bitmap *bmp, uint32_t x, uint32_t y) {
-  uint32_t bit_index = y * bmp->width + x;
-  uint16_t byte_index = bit_index / 8;
-  int16_t bit_offset = bit_index % 8;
+  uint64_t bit_index = bitmap_bit_index(bmp, x, y);
+  size_t byte_index = bit_index / 8;
+  int bit_offset = bit_index % 8;
   return (bmp->data[byte_index] >> bit_offset) & 1;
 }
-// test if this works
-void bitmap_save_ascii(Bitmap *bmp, const char *filename) {
+// pixels in a word that are inside the bitmap
+static uint64_t word_mask(const Bitmap *bmp, uint32_t x) {
+  uint32_t valid = bmp->width - x * 64;
+  return valid >= 64 ? ~0ULL : (1ULL << valid) - 1;
+}
+uint64_t bitmap_get_word(const Bitmap *bmp, uint32_t x, uint32_t y) {
+  uint64_t bit = bitmap_bit_index(bmp, x * 64, y);
+  const uint8_t *p = bmp->data + bit / 8;
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  // only packed rows start between bytes, the rest comes from the 9th byte
+  if (bit % 8 != 0)
+    value = (value >> (bit % 8)) | ((uint64_t)p[8] << (64 - bit % 8));
+  // packed: the bits behind the width belong to the next row
+  return value & word_mask(bmp, x);
+}
+void bitmap_set_word(Bitmap *bmp, uint32_t x, uint32_t y, uint64_t value) {
+  uint64_t bit = bitmap_bit_index(bmp, x * 64, y);
+  uint8_t *p = bmp->data + bit / 8;
+  uint64_t mask = word_mask(bmp, x);
+  unsigned offset = bit % 8;
+  uint64_t word;
+  value &= mask;
+  memcpy(&word, p, sizeof(word));
+  word = (word & ~(mask << offset)) | (value << offset);
+  memcpy(p, &word, sizeof(word));
+  if (offset != 0) {
+    uint8_t high = (uint8_t)(mask >> (64 - offset));
+    p[8] = (p[8] & ~high) | (uint8_t)(value >> (64 - offset));
+  }
+}
+uint64_t *bitmap_row_words(Bitmap *bmp, uint32_t y) {
+  if (bmp->layout != BITMAP_ROW_ALIGNED)
+    return NULL;
+  return (uint64_t *)(bmp->data + (uint64_t)y * (bmp->stride / 8));
+}
+uint64_t *bitmap_tile(Bitmap *bmp, uint32_t tx, uint32_t ty) {
+  if (bmp->layout != BITMAP_TILED)
+    return NULL;
+  return (uint64_t *)bmp->data + ((uint64_t)ty * bmp->stride + tx) * 64;
+}
+// one fwrite per row instead of one fprintf per pixel
+bool bitmap_save_ascii(Bitmap *bmp, const char *filename) {
   FILE *savedfile;
   savedfile = fopen(filename, "w");
-  for (int h = 0; h < bmp->height; h++) {
-    for (size_t w = 0; w < bmp->width; w++) {
-      bool byte = bitmap_get_pixel(bmp, w, h);
-      if (byte) {
-        fprintf(savedfile, "#");
-      } else {
-        fprintf(savedfile, ".");
-      }
-    }
-    fprintf(savedfile, "\n");
+  if (savedfile == NULL) {
+    perror(filename);
+    return false;
   }
-  fclose(savedfile);
-}
-/* TODO:*/
-void bitmap_save_pbm(Bitmap *bmp, const char *filename) {
-  int bitsize = 0;
-  FILE *fb = fopen(filename, "wb");
-  bitsize = bmp->height * bmp->width;
+  uint8_t *row = malloc(((size_t)bmp->width + 7) / 8 + BITMAP_PADDING);
+  char *line = malloc((size_t)bmp->width + 1);
+  for (uint32_t h = 0; h < bmp->height; h++) {
+    bitmap_get_row(bmp, h, row);
+    for (uint32_t w = 0; w < bmp->width; w++)
+      line[w] = (row[w / 8] >> (w % 8)) & 1 ? '#' : '.';
+    line[bmp->width] = '\n';
+    fwrite(line, 1, (size_t)bmp->width + 1, savedfile);
+  }
+  free(line);
+  free(row);
+  bool ok = !ferror(savedfile);
+  if (fclose(savedfile) == EOF)
+    ok = false;
+  return ok;
 }
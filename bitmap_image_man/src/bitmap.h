@@ -2,8 +2,37 @@
 #include "data.h"
 #include <stdbool.h>
 Bitmap *bitmap_create(uint32_t width, uint32_t height);
+// same as bitmap_create, but with a different pixel layout (see data.h).
+// all functions here and in draw.h / pbm.h work with every layout
+Bitmap *bitmap_create_layout(uint32_t width, uint32_t height,
+                             BitmapLayout layout);
 void bitmap_destroy(Bitmap *bmp);
 void bitmap_set_pixel(Bitmap *bmp, uint32_t x, uint32_t y, bool white);
 bool bitmap_get_pixel(Bitmap *bmp, uint32_t x, uint32_t y);
-void bitmap_save_ascii(Bitmap *bmp, const char *filename);
-void bitmap_save_pbm(Bitmap *bmp, const char *filename);
+bool bitmap_save_ascii(Bitmap *bmp, const char *filename);
+// binary P4 files, see pbm.h for the row streaming api
+bool bitmap_save_pbm(Bitmap *bmp, const char *filename);
+Bitmap *bitmap_load_pbm(const char *filename);
+
+// word level access: word x of row y holds pixels 64x..64x+63, pixel 64x+i
+// in bit i. bits past the width read as 0 and are ignored on write
+uint64_t bitmap_get_word(const Bitmap *bmp, uint32_t x, uint32_t y);
+void bitmap_set_word(Bitmap *bmp, uint32_t x, uint32_t y, uint64_t value);
+// direct pointer to the (width + 63) / 64 words of a row, only for
+// BITMAP_ROW_ALIGNED, NULL otherwise
+uint64_t *bitmap_row_words(Bitmap *bmp, uint32_t y);
+// the 64 words of tile (tx, ty), word r = row ty * 64 + r, only for
+// BITMAP_TILED, NULL otherwise
+uint64_t *bitmap_tile(Bitmap *bmp, uint32_t tx, uint32_t ty);
+
+// bit position of pixel (x, y) in data for every layout. in a tile the
+// pixels of one row are 64 consecutive bits, so a row is contiguous from x
+// up to the next multiple of 64
+static inline uint64_t bitmap_bit_index(const Bitmap *bmp, uint32_t x,
+                                        uint32_t y) {
+  if (bmp->layout == BITMAP_TILED) {
+    uint64_t tile = (uint64_t)(y / BITMAP_TILE) * bmp->stride + x / 64;
+    return (tile * BITMAP_TILE + y % BITMAP_TILE) * 64 + x % 64;
+  }
+  return (uint64_t)y * bmp->stride + x;
+}
@@ -0,0 +1,605 @@
+#include "cbitmap.h"
+#include "bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+#define CHUNK_BITS 65536
+#define CHUNK_WORDS (CHUNK_BITS / 64)
+// above this many values an array is bigger than the 8 KB bitset
+#define ARRAY_MAX 4096
+
+static size_t element_size(cb_type type) {
+  return type == CB_ARRAY ? sizeof(uint16_t) : sizeof(cb_run);
+}
+static void reserve(cb_container *c, uint32_t needed) {
+  if (needed <= c->capacity)
+    return;
+  uint32_t capacity = c->capacity ? c->capacity : 4;
+  while (capacity < needed)
+    capacity *= 2;
+  c->data = realloc(c->data, capacity * element_size(c->type));
+  c->capacity = capacity;
+}
+// moves the elements from index on by one, for insert (+1) or remove (-1)
+static void shift_elements(cb_container *c, uint32_t index, int direction) {
+  size_t size = element_size(c->type);
+  uint8_t *p = (uint8_t *)c->data + index * size;
+  if (direction > 0) {
+    reserve(c, c->size + 1);
+    p = (uint8_t *)c->data + index * size;
+    memmove(p + size, p, (c->size - index) * size);
+    c->size++;
+  } else {
+    memmove(p, p + size, (c->size - index - 1) * size);
+    c->size--;
+  }
+}
+// first index with values[i] >= value
+static uint32_t array_lower_bound(const cb_container *c, uint16_t value) {
+  const uint16_t *values = c->data;
+  uint32_t lo = 0, hi = c->size;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (values[mid] < value)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+// last run with start <= value, -1 if there is none
+static int64_t run_search(const cb_container *c, uint16_t value) {
+  const cb_run *runs = c->data;
+  int64_t lo = 0, hi = (int64_t)c->size - 1, found = -1;
+  while (lo <= hi) {
+    int64_t mid = (lo + hi) / 2;
+    if (runs[mid].start <= value) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+static bool container_contains(const cb_container *c, uint16_t low) {
+  switch (c->type) {
+  case CB_ARRAY: {
+    uint32_t i = array_lower_bound(c, low);
+    return i < c->size && ((uint16_t *)c->data)[i] == low;
+  }
+  case CB_BITSET:
+    return (((uint64_t *)c->data)[low / 64] >> (low % 64)) & 1;
+  case CB_RUN: {
+    int64_t i = run_search(c, low);
+    return i >= 0 && low <= ((cb_run *)c->data)[i].last;
+  }
+  }
+  return false;
+}
+static void fill_words(uint64_t *words, uint32_t start, uint32_t last) {
+  for (uint32_t i = start / 64; i <= last / 64; i++) {
+    uint64_t mask = ~0ULL;
+    if (i == start / 64)
+      mask &= ~0ULL << (start % 64);
+    if (i == last / 64 && last % 64 != 63)
+      mask &= (1ULL << (last % 64 + 1)) - 1;
+    words[i] |= mask;
+  }
+}
+static void container_to_words(const cb_container *c, uint64_t *words) {
+  if (c->type == CB_BITSET) {
+    memcpy(words, c->data, CHUNK_WORDS * sizeof(uint64_t));
+    return;
+  }
+  memset(words, 0, CHUNK_WORDS * sizeof(uint64_t));
+  if (c->type == CB_ARRAY) {
+    const uint16_t *values = c->data;
+    for (uint32_t i = 0; i < c->size; i++)
+      words[values[i] / 64] |= 1ULL << (values[i] % 64);
+  } else {
+    const cb_run *runs = c->data;
+    for (uint32_t i = 0; i < c->size; i++)
+      fill_words(words, runs[i].start, runs[i].last);
+  }
+}
+// builds the smallest container for a chunk, false if it is empty
+static bool container_from_words(cb_container *c, uint32_t key,
+                                 const uint64_t *words) {
+  uint32_t cardinality = 0, run_count = 0;
+  uint64_t carry = 0;
+  for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+    cardinality += __builtin_popcountll(words[i]);
+    // a run starts at every set bit whose left neighbour is clear
+    run_count += __builtin_popcountll(words[i] & ~((words[i] << 1) | carry));
+    carry = words[i] >> 63;
+  }
+  if (cardinality == 0)
+    return false;
+  size_t array_bytes = cardinality <= ARRAY_MAX
+                           ? cardinality * sizeof(uint16_t)
+                           : SIZE_MAX;
+  size_t bitset_bytes = CHUNK_WORDS * sizeof(uint64_t);
+  size_t run_bytes = run_count * sizeof(cb_run);
+  *c = (cb_container){.key = key, .cardinality = cardinality};
+  if (bitset_bytes <= array_bytes && bitset_bytes <= run_bytes) {
+    c->type = CB_BITSET;
+    c->data = malloc(bitset_bytes);
+    memcpy(c->data, words, bitset_bytes);
+    return true;
+  }
+  c->type = array_bytes <= run_bytes ? CB_ARRAY : CB_RUN;
+  reserve(c, c->type == CB_ARRAY ? cardinality : run_count);
+  bool open = false;
+  uint32_t start = 0;
+  for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+    uint64_t word = words[i];
+    if (c->type == CB_ARRAY) {
+      while (word) {
+        ((uint16_t *)c->data)[c->size++] = i * 64 + __builtin_ctzll(word);
+        word &= word - 1;
+      }
+      continue;
+    }
+    uint32_t pos = 0;
+    while (pos < 64) {
+      uint64_t rest = (open ? ~word : word) >> pos;
+      if (rest == 0)
+        break;
+      pos += __builtin_ctzll(rest);
+      if (open)
+        ((cb_run *)c->data)[c->size++] = (cb_run){start, i * 64 + pos - 1};
+      else
+        start = i * 64 + pos;
+      open = !open;
+    }
+  }
+  if (open)
+    ((cb_run *)c->data)[c->size++] = (cb_run){start, CHUNK_BITS - 1};
+  return true;
+}
+static void container_convert(cb_container *c, cb_type type) {
+  uint64_t words[CHUNK_WORDS];
+  container_to_words(c, words);
+  free(c->data);
+  c->type = type;
+  c->size = 0;
+  c->capacity = 0;
+  if (type == CB_BITSET) {
+    c->data = malloc(sizeof(words));
+    memcpy(c->data, words, sizeof(words));
+    return;
+  }
+  // only ARRAY is asked for here, from a bitset that got small
+  c->data = NULL;
+  reserve(c, c->cardinality);
+  for (uint32_t i = 0; i < CHUNK_WORDS; i++)
+    for (uint64_t word = words[i]; word; word &= word - 1)
+      ((uint16_t *)c->data)[c->size++] = i * 64 + __builtin_ctzll(word);
+}
+static bool run_add(cb_container *c, uint16_t value) {
+  cb_run *runs = c->data;
+  int64_t i = run_search(c, value);
+  if (i >= 0 && value <= runs[i].last)
+    return false;
+  bool join_prev = i >= 0 && runs[i].last + 1 == value;
+  bool join_next = i + 1 < c->size && runs[i + 1].start == value + 1;
+  if (join_prev && join_next) {
+    runs[i].last = runs[i + 1].last;
+    shift_elements(c, i + 1, -1);
+  } else if (join_prev) {
+    runs[i].last = value;
+  } else if (join_next) {
+    runs[i + 1].start = value;
+  } else {
+    shift_elements(c, i + 1, 1);
+    ((cb_run *)c->data)[i + 1] = (cb_run){value, value};
+  }
+  return true;
+}
+static bool run_remove(cb_container *c, uint16_t value) {
+  cb_run *runs = c->data;
+  int64_t i = run_search(c, value);
+  if (i < 0 || value > runs[i].last)
+    return false;
+  if (runs[i].start == runs[i].last) {
+    shift_elements(c, i, -1);
+  } else if (value == runs[i].start) {
+    runs[i].start++;
+  } else if (value == runs[i].last) {
+    runs[i].last--;
+  } else {
+    uint16_t last = runs[i].last;
+    runs[i].last = value - 1;
+    shift_elements(c, i + 1, 1);
+    ((cb_run *)c->data)[i + 1] = (cb_run){value + 1, last};
+  }
+  return true;
+}
+static void container_add(cb_container *c, uint16_t low) {
+  switch (c->type) {
+  case CB_ARRAY: {
+    uint32_t i = array_lower_bound(c, low);
+    if (i < c->size && ((uint16_t *)c->data)[i] == low)
+      return;
+    if (c->size == ARRAY_MAX) {
+      container_convert(c, CB_BITSET);
+      container_add(c, low);
+      return;
+    }
+    shift_elements(c, i, 1);
+    ((uint16_t *)c->data)[i] = low;
+    c->cardinality++;
+    return;
+  }
+  case CB_BITSET: {
+    uint64_t *word = (uint64_t *)c->data + low / 64;
+    uint64_t bit = 1ULL << (low % 64);
+    c->cardinality += !(*word & bit);
+    *word |= bit;
+    return;
+  }
+  case CB_RUN:
+    c->cardinality += run_add(c, low);
+    if (c->size * sizeof(cb_run) > CHUNK_WORDS * sizeof(uint64_t))
+      container_convert(c, CB_BITSET);
+    return;
+  }
+}
+static void container_remove(cb_container *c, uint16_t low) {
+  switch (c->type) {
+  case CB_ARRAY: {
+    uint32_t i = array_lower_bound(c, low);
+    if (i < c->size && ((uint16_t *)c->data)[i] == low) {
+      shift_elements(c, i, -1);
+      c->cardinality--;
+    }
+    return;
+  }
+  case CB_BITSET: {
+    uint64_t *word = (uint64_t *)c->data + low / 64;
+    uint64_t bit = 1ULL << (low % 64);
+    c->cardinality -= (*word & bit) != 0;
+    *word &= ~bit;
+    if (c->cardinality <= ARRAY_MAX)
+      container_convert(c, CB_ARRAY);
+    return;
+  }
+  case CB_RUN:
+    c->cardinality -= run_remove(c, low);
+    if (c->size * sizeof(cb_run) > CHUNK_WORDS * sizeof(uint64_t))
+      container_convert(c, CB_BITSET);
+    return;
+  }
+}
+static uint32_t container_first_zero(const cb_container *c) {
+  switch (c->type) {
+  case CB_ARRAY: {
+    const uint16_t *values = c->data;
+    uint32_t i = 0;
+    while (i < c->size && values[i] == i)
+      i++;
+    return i;
+  }
+  case CB_BITSET: {
+    const uint64_t *words = c->data;
+    uint32_t i = 0;
+    while (words[i] == ~0ULL)
+      i++;
+    return i * 64 + __builtin_ctzll(~words[i]);
+  }
+  case CB_RUN: {
+    const cb_run *runs = c->data;
+    return runs[0].start > 0 ? 0 : runs[0].last + 1u;
+  }
+  }
+  return 0;
+}
+
+// first container with key >= key
+static size_t find_container(const CompressedBitmap *cb, uint32_t key) {
+  // dense bitmaps have every chunk, container i is chunk i
+  if (key < cb->count && cb->containers[key].key == key)
+    return key;
+  size_t lo = 0, hi = cb->count;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (cb->containers[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+// appends or inserts at index, the container is moved in
+static void insert_container(CompressedBitmap *cb, size_t index,
+                             const cb_container *c) {
+  if (cb->count == cb->capacity) {
+    cb->capacity = cb->capacity ? cb->capacity * 2 : 8;
+    cb->containers =
+        realloc(cb->containers, cb->capacity * sizeof(cb_container));
+  }
+  memmove(cb->containers + index + 1, cb->containers + index,
+          (cb->count - index) * sizeof(cb_container));
+  cb->containers[index] = *c;
+  cb->count++;
+}
+
+CompressedBitmap *cbitmap_create(uint32_t width, uint32_t height) {
+  CompressedBitmap *cb = calloc(1, sizeof(CompressedBitmap));
+  cb->width = width;
+  cb->height = height;
+  return cb;
+}
+void cbitmap_destroy(CompressedBitmap *cb) {
+  for (size_t i = 0; i < cb->count; i++)
+    free(cb->containers[i].data);
+  free(cb->containers);
+  free(cb);
+}
+void cbitmap_set(CompressedBitmap *cb, uint32_t x, uint32_t y, bool white) {
+  uint64_t index = (uint64_t)y * cb->width + x;
+  uint32_t key = index >> 16;
+  size_t i = find_container(cb, key);
+  bool found = i < cb->count && cb->containers[i].key == key;
+  if (white) {
+    if (found) {
+      container_add(&cb->containers[i], index & 0xFFFF);
+      return;
+    }
+    cb_container c = {.key = key, .type = CB_ARRAY, .cardinality = 1};
+    reserve(&c, 1);
+    ((uint16_t *)c.data)[c.size++] = index & 0xFFFF;
+    insert_container(cb, i, &c);
+    return;
+  }
+  if (!found)
+    return;
+  cb_container *c = &cb->containers[i];
+  container_remove(c, index & 0xFFFF);
+  if (c->cardinality == 0) {
+    free(c->data);
+    memmove(c, c + 1, (cb->count - i - 1) * sizeof(cb_container));
+    cb->count--;
+  }
+}
+bool cbitmap_get(const CompressedBitmap *cb, uint32_t x, uint32_t y) {
+  uint64_t index = (uint64_t)y * cb->width + x;
+  size_t i = find_container(cb, index >> 16);
+  return i < cb->count && cb->containers[i].key == index >> 16 &&
+         container_contains(&cb->containers[i], index & 0xFFFF);
+}
+uint64_t cbitmap_popcount(const CompressedBitmap *cb) {
+  uint64_t count = 0;
+  for (size_t i = 0; i < cb->count; i++)
+    count += cb->containers[i].cardinality;
+  return count;
+}
+bool cbitmap_find_first_zero(const CompressedBitmap *cb, uint32_t *x,
+                             uint32_t *y) {
+  uint64_t index = 0;
+  size_t i = 0;
+  // a missing chunk or one with less than 65536 pixels has the zero
+  for (; i < cb->count; i++, index += CHUNK_BITS) {
+    const cb_container *c = &cb->containers[i];
+    if (c->key != index >> 16)
+      break;
+    if (c->cardinality < CHUNK_BITS) {
+      index += container_first_zero(c);
+      break;
+    }
+  }
+  if (index >= (uint64_t)cb->width * cb->height)
+    return false;
+  *x = index % cb->width;
+  *y = index / cb->width;
+  return true;
+}
+
+static cb_container container_copy(const cb_container *c) {
+  cb_container copy = *c;
+  size_t bytes = c->type == CB_BITSET ? CHUNK_WORDS * sizeof(uint64_t)
+                                      : c->size * element_size(c->type);
+  copy.capacity = c->type == CB_BITSET ? 0 : c->size;
+  copy.data = malloc(bytes);
+  memcpy(copy.data, c->data, bytes);
+  return copy;
+}
+// sorted merge of two arrays, the result has up to 2 * ARRAY_MAX values
+static uint32_t merge_arrays(const cb_container *a, const cb_container *b,
+                             BitmapOp op, uint16_t *out) {
+  const uint16_t *va = a->data, *vb = b->data;
+  uint32_t i = 0, j = 0, n = 0;
+  while (i < a->size && j < b->size) {
+    if (va[i] == vb[j]) {
+      if (op != BITMAP_XOR)
+        out[n++] = va[i];
+      i++;
+      j++;
+    } else if (va[i] < vb[j]) {
+      if (op != BITMAP_AND)
+        out[n++] = va[i];
+      i++;
+    } else {
+      if (op != BITMAP_AND)
+        out[n++] = vb[j];
+      j++;
+    }
+  }
+  if (op != BITMAP_AND) {
+    while (i < a->size)
+      out[n++] = va[i++];
+    while (j < b->size)
+      out[n++] = vb[j++];
+  }
+  return n;
+}
+// false if the result chunk is empty
+static bool container_combine(cb_container *out, const cb_container *a,
+                              const cb_container *b, BitmapOp op) {
+  uint64_t wa[CHUNK_WORDS], wb[CHUNK_WORDS];
+  if (a->type == CB_ARRAY && b->type == CB_ARRAY) {
+    uint16_t values[2 * ARRAY_MAX];
+    uint32_t n = merge_arrays(a, b, op, values);
+    if (n == 0)
+      return false;
+    if (n <= ARRAY_MAX) {
+      *out = (cb_container){.key = a->key, .type = CB_ARRAY, .cardinality = n};
+      reserve(out, n);
+      memcpy(out->data, values, n * sizeof(uint16_t));
+      out->size = n;
+      return true;
+    }
+    memset(wa, 0, sizeof(wa));
+    for (uint32_t i = 0; i < n; i++)
+      wa[values[i] / 64] |= 1ULL << (values[i] % 64);
+    return container_from_words(out, a->key, wa);
+  }
+  // a small array against anything: look its values up in the other side
+  if (op == BITMAP_AND && (a->type == CB_ARRAY || b->type == CB_ARRAY)) {
+    const cb_container *array = a->type == CB_ARRAY ? a : b;
+    const cb_container *other = array == a ? b : a;
+    *out = (cb_container){.key = a->key, .type = CB_ARRAY};
+    reserve(out, array->size);
+    for (uint32_t i = 0; i < array->size; i++) {
+      uint16_t value = ((uint16_t *)array->data)[i];
+      if (container_contains(other, value))
+        ((uint16_t *)out->data)[out->size++] = value;
+    }
+    out->cardinality = out->size;
+    if (out->size == 0)
+      free(out->data);
+    return out->size > 0;
+  }
+  // bitsets are used in place, arrays and runs are expanded first
+  const uint64_t *pa = a->data, *pb = b->data;
+  if (a->type != CB_BITSET) {
+    container_to_words(a, wa);
+    pa = wa;
+  }
+  if (b->type != CB_BITSET) {
+    container_to_words(b, wb);
+    pb = wb;
+  }
+  if (a->type == CB_RUN && b->type == CB_RUN) {
+    // runs with runs usually stays runs, let the full size check decide
+    for (uint32_t i = 0; i < CHUNK_WORDS; i++)
+      wa[i] = op == BITMAP_AND ? wa[i] & wb[i]
+              : op == BITMAP_OR ? wa[i] | wb[i]
+                                : wa[i] ^ wb[i];
+    return container_from_words(out, a->key, wa);
+  }
+  // like roaring: a bitset result stays a bitset unless it got small enough
+  // for an array, cbitmap_optimize() finds the run containers
+  uint64_t *words = malloc(CHUNK_WORDS * sizeof(uint64_t));
+  uint32_t cardinality = 0;
+  for (uint32_t i = 0; i < CHUNK_WORDS; i++) {
+    words[i] = op == BITMAP_AND  ? pa[i] & pb[i]
+               : op == BITMAP_OR ? pa[i] | pb[i]
+                                 : pa[i] ^ pb[i];
+    cardinality += __builtin_popcountll(words[i]);
+  }
+  if (cardinality > ARRAY_MAX) {
+    *out = (cb_container){.key = a->key, .type = CB_BITSET,
+                          .cardinality = cardinality, .data = words};
+    return true;
+  }
+  bool nonempty = container_from_words(out, a->key, words);
+  free(words);
+  return nonempty;
+}
+CompressedBitmap *cbitmap_combine(const CompressedBitmap *a,
+                                  const CompressedBitmap *b, BitmapOp op) {
+  if (a->width != b->width || a->height != b->height)
+    return NULL;
+  static const CompressedBitmap empty;
+  CompressedBitmap *result = cbitmap_create(a->width, a->height);
+  if (op == BITMAP_COPY)
+    a = &empty; // everything is taken from b
+  size_t i = 0, j = 0;
+  while (i < a->count || j < b->count) {
+    const cb_container *ca = i < a->count ? &a->containers[i] : NULL;
+    const cb_container *cb = j < b->count ? &b->containers[j] : NULL;
+    cb_container c;
+    if (cb == NULL || (ca != NULL && ca->key < cb->key)) {
+      i++;
+      if (op == BITMAP_AND)
+        continue;
+      c = container_copy(ca);
+    } else if (ca == NULL || cb->key < ca->key) {
+      j++;
+      if (op == BITMAP_AND)
+        continue;
+      c = container_copy(cb);
+    } else {
+      i++;
+      j++;
+      if (!container_combine(&c, ca, cb, op))
+        continue;
+    }
+    insert_container(result, result->count, &c);
+  }
+  return result;
+}
+void cbitmap_optimize(CompressedBitmap *cb) {
+  uint64_t words[CHUNK_WORDS];
+  for (size_t i = 0; i < cb->count; i++) {
+    cb_container *c = &cb->containers[i];
+    container_to_words(c, words);
+    free(c->data);
+    container_from_words(c, c->key, words);
+  }
+}
+size_t cbitmap_memory(const CompressedBitmap *cb) {
+  size_t bytes = sizeof(CompressedBitmap) + cb->capacity * sizeof(cb_container);
+  for (size_t i = 0; i < cb->count; i++) {
+    const cb_container *c = &cb->containers[i];
+    bytes += c->type == CB_BITSET ? CHUNK_WORDS * sizeof(uint64_t)
+                                  : c->capacity * element_size(c->type);
+  }
+  return bytes;
+}
+
+// a packed bitmap has the same pixel order, a chunk is 8 KB of its data
+CompressedBitmap *cbitmap_from_bitmap(const Bitmap *bmp) {
+  if (bmp->layout != BITMAP_PACKED) {
+    Bitmap *packed = bitmap_create(bmp->width, bmp->height);
+    bitmap_blit(packed, 0, 0, bmp, 0, 0, bmp->width, bmp->height,
+                BITMAP_COPY);
+    CompressedBitmap *cb = cbitmap_from_bitmap(packed);
+    bitmap_destroy(packed);
+    return cb;
+  }
+  CompressedBitmap *cb = cbitmap_create(bmp->width, bmp->height);
+  size_t bytes = bytes_needed(bmp->width, bmp->height);
+  uint64_t words[CHUNK_WORDS];
+  for (size_t offset = 0; offset < bytes; offset += sizeof(words)) {
+    size_t n = bytes - offset < sizeof(words) ? bytes - offset : sizeof(words);
+    memset(words, 0, sizeof(words));
+    memcpy(words, bmp->data + offset, n);
+    // the bits behind the last pixel in the last byte
+    uint64_t last = (uint64_t)bmp->width * bmp->height - offset * 8;
+    if (last < CHUNK_BITS && last % 64 != 0)
+      words[last / 64] &= (1ULL << (last % 64)) - 1;
+    cb_container c;
+    if (container_from_words(&c, offset / sizeof(words), words))
+      insert_container(cb, cb->count, &c);
+  }
+  return cb;
+}
+Bitmap *cbitmap_to_bitmap(const CompressedBitmap *cb) {
+  Bitmap *bmp = bitmap_create(cb->width, cb->height);
+  size_t bytes = bytes_needed(cb->width, cb->height);
+  uint64_t words[CHUNK_WORDS];
+  for (size_t i = 0; i < cb->count; i++) {
+    const cb_container *c = &cb->containers[i];
+    size_t offset = (size_t)c->key * sizeof(words);
+    const void *src = c->data;
+    if (c->type != CB_BITSET) {
+      container_to_words(c, words);
+      src = words;
+    }
+    size_t n = bytes - offset < sizeof(words) ? bytes - offset : sizeof(words);
+    memcpy(bmp->data + offset, src, n);
+  }
+  return bmp;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "data.h"
+#include "draw.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// compressed bitmap (roaring style): the pixels are numbered row by row like
+// in a packed Bitmap and cut into chunks of 65536. only non empty chunks are
+// stored, each in the smallest of three containers:
+// ARRAY  sorted uint16_t pixel offsets, up to 4096 white pixels
+// BITSET 1024 uint64_t words, 8 KB
+// RUN    sorted [start, last] runs of white pixels (4 bytes per run), for
+//        mostly white or blocky chunks
+typedef enum { CB_ARRAY, CB_BITSET, CB_RUN } cb_type;
+
+typedef struct {
+  uint16_t start;
+  uint16_t last;
+} cb_run;
+
+typedef struct {
+  uint32_t key; // pixel index >> 16
+  cb_type type;
+  uint32_t cardinality; // white pixels, 1..65536
+  uint32_t size;        // ARRAY values / RUN runs in use
+  uint32_t capacity;
+  void *data; // uint16_t[] / uint64_t[1024] / cb_run[]
+} cb_container;
+
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  cb_container *containers; // sorted by key
+  size_t count;
+  size_t capacity;
+} CompressedBitmap;
+
+CompressedBitmap *cbitmap_create(uint32_t width, uint32_t height);
+void cbitmap_destroy(CompressedBitmap *cb);
+void cbitmap_set(CompressedBitmap *cb, uint32_t x, uint32_t y, bool white);
+bool cbitmap_get(const CompressedBitmap *cb, uint32_t x, uint32_t y);
+uint64_t cbitmap_popcount(const CompressedBitmap *cb);
+// first black pixel in row order, false if the bitmap is all white
+bool cbitmap_find_first_zero(const CompressedBitmap *cb, uint32_t *x,
+                             uint32_t *y);
+// new bitmap a op b (BITMAP_AND/OR/XOR, COPY gives a copy of b), NULL if
+// the sizes differ
+CompressedBitmap *cbitmap_combine(const CompressedBitmap *a,
+                                  const CompressedBitmap *b, BitmapOp op);
+// picks the smallest container for every chunk. set() never creates run
+// containers, call this after many single pixel changes
+void cbitmap_optimize(CompressedBitmap *cb);
+// bytes used including the struct itself
+size_t cbitmap_memory(const CompressedBitmap *cb);
+// conversion, any layout in, packed out
+CompressedBitmap *cbitmap_from_bitmap(const Bitmap *bmp);
+Bitmap *cbitmap_to_bitmap(const CompressedBitmap *cb);
@@ -1,6 +1,22 @@
-#include <stdint.h>
+#include "data.h"
 
-int bytes_needed(uint32_t width, uint32_t height) {
-  int bytes = (width * height + 7) / 8;
+size_t bytes_needed(uint32_t width, uint32_t height) {
+  // 64 bit math, width * height overflows uint32_t above 64K x 64K
+  size_t bytes = ((uint64_t)width * height + 7) / 8;
   return bytes;
 }
+size_t bitmap_layout_bytes(uint32_t width, uint32_t height,
+                           BitmapLayout layout) {
+  uint64_t words = ((uint64_t)width + 63) / 64;
+  switch (layout) {
+  case BITMAP_PACKED:
+    return bytes_needed(width, height);
+  case BITMAP_ROW_ALIGNED:
+    return words * 8 * height;
+  case BITMAP_TILED:
+    // partial tiles at the right/bottom edge are stored whole
+    return words * (((uint64_t)height + BITMAP_TILE - 1) / BITMAP_TILE) *
+           BITMAP_TILE * 8;
+  }
+  return 0;
+}
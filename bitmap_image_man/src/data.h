@@ -1,10 +1,33 @@
 #pragma once
+#include <stddef.h>
 #include <stdint.h>
+// data is allocated with this many spare bytes at the end, so the span
+// kernels can always load/store a whole uint64_t at any byte index
+#define BITMAP_PADDING 8
+// edge length of a tile in BITMAP_TILED, one uint64_t per tile row
+#define BITMAP_TILE 64
+
+// how the pixels are laid out in data:
+// PACKED      rows follow each other without gaps (stride == width), the
+//             original format, smallest but rows start at any bit
+// ROW_ALIGNED every row starts on a uint64_t, stride is width rounded up to
+//             64, so word i of a row always holds pixels 64i..64i+63
+// TILED       64x64 tiles of 64 words (512 bytes) each, tiles row by row.
+//             word r of a tile is row r of it, so small 2d areas (transpose,
+//             morphology, blits of small rects) stay in a few cache lines
+typedef enum { BITMAP_PACKED, BITMAP_ROW_ALIGNED, BITMAP_TILED } BitmapLayout;
 
 typedef struct {
 
   uint32_t width;
   uint32_t height;
   uint8_t *data;
+  BitmapLayout layout;
+  // bits from one row to the next (PACKED / ROW_ALIGNED),
+  // tiles per tile row for TILED
+  uint64_t stride;
 } Bitmap;
-int bytes_needed(uint32_t width, uint32_t height);
+size_t bytes_needed(uint32_t width, uint32_t height);
+// size of data without BITMAP_PADDING for the given layout
+size_t bitmap_layout_bytes(uint32_t width, uint32_t height,
+                           BitmapLayout layout);
@@ -1,17 +1,284 @@
 #include "draw.h"
 #include "bitmap.h"
+#include <stdlib.h>
+#include <string.h>
+/* NOTE: pixel i of the bitstream is bit i % 8 of byte i / 8, which on a
+ * little endian cpu is also bit i % 64 of the uint64_t at byte (i / 64) * 8.
+ * the 64 bit kernels below rely on that (x86/arm little endian). */
+
+static inline uint64_t load64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline void store64(uint8_t *p, uint64_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+// sets or clears count bits starting at bit start
+static void fill_bits(uint8_t *data, uint64_t start, uint64_t count,
+                      bool white) {
+  if (count == 0)
+    return;
+  uint8_t *p = data + start / 8;
+  unsigned offset = start % 8;
+  // partial first byte
+  if (offset != 0) {
+    unsigned n = count < 8 - offset ? count : 8 - offset;
+    uint8_t mask = ((1u << n) - 1) << offset;
+    *p = white ? (*p | mask) : (*p & ~mask);
+    p++;
+    count -= n;
+  }
+  // full bytes, memset already uses the widest stores the cpu has
+  memset(p, white ? 0xFF : 0x00, count / 8);
+  p += count / 8;
+  // partial last byte
+  if (count % 8 != 0) {
+    uint8_t mask = (1u << (count % 8)) - 1;
+    *p = white ? (*p | mask) : (*p & ~mask);
+  }
+}
+static inline uint64_t apply(uint64_t word, uint64_t value, uint64_t mask,
+                             BitmapOp op) {
+  switch (op) {
+  case BITMAP_COPY:
+    return (word & ~mask) | (value & mask);
+  case BITMAP_AND:
+    return word & (value | ~mask);
+  case BITMAP_OR:
+    return word | (value & mask);
+  case BITMAP_XOR:
+    return word ^ (value & mask);
+  }
+  return word;
+}
+// up to 56 bits from any bit position: one unaligned load and a shift
+static void combine_unaligned(uint8_t *dst, uint64_t dst_bit,
+                              const uint8_t *src, uint64_t src_bit,
+                              uint64_t count, BitmapOp op) {
+  while (count > 0) {
+    unsigned n = count < 56 ? count : 56;
+    unsigned shift = dst_bit % 8;
+    uint64_t bits = load64(src + src_bit / 8) >> (src_bit % 8);
+    uint64_t mask = ((1ULL << n) - 1) << shift;
+    uint8_t *d = dst + dst_bit / 8;
+    store64(d, apply(load64(d), bits << shift, mask, op));
+    dst_bit += n;
+    src_bit += n;
+    count -= n;
+  }
+}
+// dst bits [dst_bit, +count) = dst op src bits [src_bit, +count)
+static void combine_bits(uint8_t *dst, uint64_t dst_bit, const uint8_t *src,
+                         uint64_t src_bit, uint64_t count, BitmapOp op) {
+  if (dst_bit % 8 != src_bit % 8 || count < 64) {
+    combine_unaligned(dst, dst_bit, src, src_bit, count, op);
+    return;
+  }
+  // same bit phase: align to a byte, then whole bytes/words
+  unsigned head = (8 - dst_bit % 8) % 8;
+  combine_unaligned(dst, dst_bit, src, src_bit, head, op);
+  dst_bit += head;
+  src_bit += head;
+  count -= head;
+  uint8_t *d = dst + dst_bit / 8;
+  const uint8_t *s = src + src_bit / 8;
+  size_t bytes = count / 8;
+  if (op == BITMAP_COPY) {
+    memcpy(d, s, bytes);
+  } else {
+    size_t i = 0;
+    for (; i + 8 <= bytes; i += 8)
+      store64(d + i, apply(load64(d + i), load64(s + i), ~0ULL, op));
+    for (; i < bytes; i++)
+      d[i] = (uint8_t)apply(d[i], s[i], 0xFF, op);
+  }
+  combine_unaligned(dst, dst_bit + bytes * 8, src, src_bit + bytes * 8,
+                    count % 8, op);
+}
+// cuts the rect down to the part inside the bitmap, false if nothing is left
+static bool clip(const Bitmap *bmp, uint32_t x, uint32_t y, uint32_t *width,
+                 uint32_t *height) {
+  if (x >= bmp->width || y >= bmp->height)
+    return false;
+  if (*width > bmp->width - x)
+    *width = bmp->width - x;
+  if (*height > bmp->height - y)
+    *height = bmp->height - y;
+  return *width > 0 && *height > 0;
+}
+
+// the row helpers below work on pixels [x, x + count) of row y for every
+// layout. PACKED and ROW_ALIGNED rows are one span, TILED rows are split
+// at the tile edges into spans of up to 64 bits
+static inline uint32_t segment_length(const Bitmap *bmp, uint32_t x,
+                                      uint32_t count) {
+  if (bmp->layout != BITMAP_TILED)
+    return count;
+  uint32_t n = 64 - x % 64;
+  return count < n ? count : n;
+}
+static void row_fill(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t count,
+                     bool white) {
+  while (count > 0) {
+    uint32_t n = segment_length(bmp, x, count);
+    uint64_t bit = bitmap_bit_index(bmp, x, y);
+    if (n == 64 && bit % 64 == 0)
+      store64(bmp->data + bit / 8, white ? ~0ULL : 0);
+    else
+      fill_bits(bmp->data, bit, n, white);
+    x += n;
+    count -= n;
+  }
+}
+// row y of dst op src bits [src_bit, +count)
+static void row_combine(Bitmap *dst, uint32_t x, uint32_t y,
+                        const uint8_t *src, uint64_t src_bit, uint32_t count,
+                        BitmapOp op) {
+  while (count > 0) {
+    uint32_t n = segment_length(dst, x, count);
+    combine_bits(dst->data, bitmap_bit_index(dst, x, y), src, src_bit, n, op);
+    x += n;
+    src_bit += n;
+    count -= n;
+  }
+}
+// copies row y of src to dest bits [dest_bit, +count)
+static void row_read(const Bitmap *src, uint32_t x, uint32_t y,
+                     uint8_t *dest, uint64_t dest_bit, uint32_t count) {
+  while (count > 0) {
+    uint32_t n = segment_length(src, x, count);
+    combine_bits(dest, dest_bit, src->data, bitmap_bit_index(src, x, y), n,
+                 BITMAP_COPY);
+    x += n;
+    dest_bit += n;
+    count -= n;
+  }
+}
+static bool is_contiguous(const Bitmap *bmp) {
+  return bmp->layout != BITMAP_TILED && bmp->stride == bmp->width;
+}
+
 // x and y are the starting point width and height are the size of the rectangle
 void bitmap_fill_rect(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t width,
                       uint32_t height, bool white) {
-  for (int i = x; i < x + width; i++) {
-    for (int b = y; b < y + height; b++) {
-      bitmap_set_pixel(bmp, i, b, white);
-    }
+  if (!clip(bmp, x, y, &width, &height))
+    return;
+  // full width packed rows are one continuous span in the bitstream
+  if (width == bmp->width && is_contiguous(bmp)) {
+    fill_bits(bmp->data, (uint64_t)y * bmp->width,
+              (uint64_t)width * height, white);
+    return;
   }
+  for (uint32_t row = 0; row < height; row++)
+    row_fill(bmp, x, y + row, width, white);
 }
 void bitmap_draw_hline(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t length,
                        bool white) {
-  for (int i = x; i < x + length; i++) {
-    bitmap_set_pixel(bmp, i, y, white);
+  uint32_t height = 1;
+  if (!clip(bmp, x, y, &length, &height))
+    return;
+  row_fill(bmp, x, y, length, white);
+}
+// one bit per row, the index just moves by the stride (no multiply per
+// pixel), in a tile by 64 until the next tile starts
+void bitmap_draw_vline(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t length,
+                       bool white) {
+  uint32_t width = 1;
+  if (!clip(bmp, x, y, &width, &length))
+    return;
+  uint64_t step = bmp->layout == BITMAP_TILED ? 64 : bmp->stride;
+  uint64_t bit = bitmap_bit_index(bmp, x, y);
+  for (uint32_t row = 0; row < length; row++, bit += step) {
+    if (bmp->layout == BITMAP_TILED && (y + row) % BITMAP_TILE == 0)
+      bit = bitmap_bit_index(bmp, x, y + row);
+    uint8_t mask = 1u << (bit % 8);
+    if (white)
+      bmp->data[bit / 8] |= mask;
+    else
+      bmp->data[bit / 8] &= ~mask;
+  }
+}
+void bitmap_blit(Bitmap *dst, uint32_t dx, uint32_t dy, const Bitmap *src,
+                 uint32_t sx, uint32_t sy, uint32_t width, uint32_t height,
+                 BitmapOp op) {
+  if (!clip(src, sx, sy, &width, &height) ||
+      !clip(dst, dx, dy, &width, &height))
+    return;
+  if (width == dst->width && width == src->width && is_contiguous(dst) &&
+      is_contiguous(src)) {
+    combine_bits(dst->data, (uint64_t)dy * dst->width, src->data,
+                 (uint64_t)sy * src->width, (uint64_t)width * height, op);
+    return;
+  }
+  // tiled source rows are not contiguous, they go through a row buffer
+  uint8_t *buffer = NULL;
+  if (src->layout == BITMAP_TILED)
+    buffer = malloc(((size_t)width + 7) / 8 + BITMAP_PADDING);
+  for (uint32_t row = 0; row < height; row++) {
+    if (buffer != NULL) {
+      row_read(src, sx, sy + row, buffer, 0, width);
+      row_combine(dst, dx, dy + row, buffer, 0, width, op);
+    } else {
+      row_combine(dst, dx, dy + row, src->data,
+                  bitmap_bit_index(src, sx, sy + row), width, op);
+    }
+  }
+  free(buffer);
+}
+void bitmap_raster_op(Bitmap *dst, const Bitmap *src, BitmapOp op) {
+  if (dst->width != src->width || dst->height != src->height)
+    return;
+  // same layout: the pad bits are zero in both, so the whole buffer can be
+  // combined at once
+  if (dst->layout == src->layout) {
+    uint64_t bits =
+        dst->layout == BITMAP_PACKED
+            ? (uint64_t)dst->width * dst->height
+            : bitmap_layout_bytes(dst->width, dst->height, dst->layout) * 8;
+    combine_bits(dst->data, 0, src->data, 0, bits, op);
+    return;
+  }
+  bitmap_blit(dst, 0, 0, src, 0, 0, src->width, src->height, op);
+}
+void bitmap_get_row(const Bitmap *bmp, uint32_t y, uint8_t *row) {
+  size_t row_bytes = ((size_t)bmp->width + 7) / 8;
+  row_read(bmp, 0, y, row, 0, bmp->width);
+  // clear the pad bits behind the last pixel
+  if (bmp->width % 8 != 0)
+    row[row_bytes - 1] &= (1u << (bmp->width % 8)) - 1;
+}
+void bitmap_set_row(Bitmap *bmp, uint32_t y, const uint8_t *row) {
+  row_combine(bmp, 0, y, row, 0, bmp->width, BITMAP_COPY);
+}
+// 64x64 bit matrix in place, word r bit c <-> word c bit r. swaps the two
+// off diagonal 32x32 blocks, then the 16x16 blocks inside all four, ...
+static void transpose64(uint64_t *m) {
+  static const uint64_t masks[6] = {
+      0x00000000FFFFFFFFULL, 0x0000FFFF0000FFFFULL, 0x00FF00FF00FF00FFULL,
+      0x0F0F0F0F0F0F0F0FULL, 0x3333333333333333ULL, 0x5555555555555555ULL};
+  for (unsigned level = 0, j = 32; j != 0; level++, j /= 2) {
+    for (unsigned k = 0; k < 64; k = (k + j + 1) & ~j) {
+      uint64_t t = ((m[k] >> j) ^ m[k + j]) & masks[level];
+      m[k] ^= t << j;
+      m[k + j] ^= t;
+    }
+  }
+}
+bool bitmap_transpose(Bitmap *dst, const Bitmap *src) {
+  if (dst->width != src->height || dst->height != src->width)
+    return false;
+  uint64_t block[64];
+  for (uint32_t by = 0; by < src->height; by += 64) {
+    uint32_t rows = src->height - by < 64 ? src->height - by : 64;
+    for (uint32_t bx = 0; bx < src->width; bx += 64) {
+      uint32_t cols = src->width - bx < 64 ? src->width - bx : 64;
+      for (uint32_t r = 0; r < 64; r++)
+        block[r] = r < rows ? bitmap_get_word(src, bx / 64, by + r) : 0;
+      transpose64(block);
+      for (uint32_t c = 0; c < cols; c++)
+        bitmap_set_word(dst, by / 64, bx + c, block[c]);
+    }
   }
+  return true;
 }
@@ -3,7 +3,30 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+// how source pixels are combined with the destination (blit / raster op)
+typedef enum { BITMAP_COPY, BITMAP_AND, BITMAP_OR, BITMAP_XOR } BitmapOp;
+
+// everything here clips to the bitmap and works on whole bit spans:
+// partial first/last byte masked, full bytes in between with memset/uint64
 void bitmap_fill_rect(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t width,
                       uint32_t height, bool white);
 void bitmap_draw_hline(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t length,
                        bool white);
+void bitmap_draw_vline(Bitmap *bmp, uint32_t x, uint32_t y, uint32_t length,
+                       bool white);
+// combines the width x height rect at (sx, sy) of src into dst at (dx, dy).
+// src and dst may be the same bitmap only if the rects do not overlap
+void bitmap_blit(Bitmap *dst, uint32_t dx, uint32_t dy, const Bitmap *src,
+                 uint32_t sx, uint32_t sy, uint32_t width, uint32_t height,
+                 BitmapOp op);
+// dst = dst op src for two bitmaps of the same size (any layouts)
+void bitmap_raster_op(Bitmap *dst, const Bitmap *src, BitmapOp op);
+// row accessors: one row as byte aligned bits in the bitmap bit order (bit
+// i % 8 of byte i / 8), (width + 7) / 8 bytes. the row buffer needs
+// BITMAP_PADDING spare bytes at the end like bitmap data
+void bitmap_get_row(const Bitmap *bmp, uint32_t y, uint8_t *row);
+void bitmap_set_row(Bitmap *bmp, uint32_t y, const uint8_t *row);
+// dst = src mirrored at the diagonal, dst must be src->height x
+// src->width. works on 64x64 blocks through the word accessors, fastest
+// with BITMAP_TILED on both sides
+bool bitmap_transpose(Bitmap *dst, const Bitmap *src);
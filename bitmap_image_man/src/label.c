@@ -0,0 +1,227 @@
+#include "label.h"
+#include "bitmap.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#define MAX_THREADS 256
+
+// white pixels x0..x1 (inclusive) of one row
+typedef struct {
+  uint32_t x0, x1;
+} run;
+
+typedef struct {
+  const Bitmap *bmp;
+  uint32_t y0, y1;
+  uint32_t touch; // 1 for 8-connectivity: runs touching diagonally connect
+  run *runs;
+  size_t run_count, run_capacity;
+  size_t *row_first; // runs of row y0 + r are row_first[r]..row_first[r + 1]
+  uint32_t *parent;  // strip local union-find, later global
+  size_t offset;     // index of the first run in the global arrays
+  uint32_t roots;
+  // shared after the merge
+  uint32_t *global_parent;
+  uint32_t *root_of;
+  uint32_t first_label;
+  uint32_t *labels;
+} label_strip;
+
+// path halving, only used while a single thread owns the array part
+static uint32_t find(uint32_t *parent, uint32_t i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+// the smaller index stays root, so a root is the first run of its component
+static void unite(uint32_t *parent, uint32_t a, uint32_t b) {
+  a = find(parent, a);
+  b = find(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+static void add_run(label_strip *s, uint32_t x0, uint32_t x1) {
+  if (s->run_count == s->run_capacity) {
+    s->run_capacity = s->run_capacity ? s->run_capacity * 2 : 1024;
+    s->runs = realloc(s->runs, s->run_capacity * sizeof(run));
+    s->parent = realloc(s->parent, s->run_capacity * sizeof(uint32_t));
+  }
+  s->parent[s->run_count] = s->run_count;
+  s->runs[s->run_count++] = (run){x0, x1};
+}
+// splits row y into runs with ctz, a word at a time
+static void find_runs(label_strip *s, uint32_t y) {
+  uint32_t words = (s->bmp->width + 63) / 64;
+  uint32_t start = 0;
+  bool open = false;
+  for (uint32_t i = 0; i < words; i++) {
+    uint64_t word = bitmap_get_word(s->bmp, i, y);
+    uint32_t pos = 0;
+    while (pos < 64) {
+      // ones where the current run state flips
+      uint64_t rest = (open ? ~word : word) >> pos;
+      if (rest == 0)
+        break;
+      pos += __builtin_ctzll(rest);
+      if (open)
+        add_run(s, start, i * 64 + pos - 1);
+      else
+        start = i * 64 + pos;
+      open = !open;
+    }
+  }
+  if (open)
+    add_run(s, start, s->bmp->width - 1);
+}
+// unites the runs a[0..na) of one row with the touching runs b[0..nb) of the
+// next, both sorted by x
+static void connect_rows(uint32_t *parent, const run *a, uint32_t a_index,
+                         size_t na, const run *b, uint32_t b_index, size_t nb,
+                         uint32_t touch) {
+  size_t p = 0;
+  for (size_t i = 0; i < nb; i++) {
+    while (p < na && (uint64_t)a[p].x1 + touch < b[i].x0)
+      p++;
+    for (size_t q = p; q < na && a[q].x0 <= (uint64_t)b[i].x1 + touch; q++)
+      unite(parent, a_index + q, b_index + i);
+  }
+}
+static void *label_strip_runs(void *arg) {
+  label_strip *s = arg;
+  s->row_first = malloc(((size_t)s->y1 - s->y0 + 1) * sizeof(size_t));
+  for (uint32_t y = s->y0; y < s->y1; y++) {
+    size_t r = y - s->y0;
+    s->row_first[r] = s->run_count;
+    find_runs(s, y);
+    if (r > 0) {
+      size_t prev = s->row_first[r - 1], cur = s->row_first[r];
+      connect_rows(s->parent, s->runs + prev, prev, cur - prev,
+                   s->runs + cur, cur, s->run_count - cur, s->touch);
+    }
+  }
+  s->row_first[s->y1 - s->y0] = s->run_count;
+  return NULL;
+}
+// after the merge the parents do not change anymore, the roots are found
+// without path compression so all threads can read the whole array
+static void *label_strip_roots(void *arg) {
+  label_strip *s = arg;
+  s->roots = 0;
+  for (size_t i = s->offset; i < s->offset + s->run_count; i++) {
+    uint32_t root = i;
+    while (s->global_parent[root] != root)
+      root = s->global_parent[root];
+    s->root_of[i] = root;
+    s->roots += root == i;
+  }
+  return NULL;
+}
+// numbers the roots of the strip, the parent entry of a root becomes its
+// label (only the own entries are written)
+static void *label_strip_number(void *arg) {
+  label_strip *s = arg;
+  uint32_t label = s->first_label;
+  for (size_t i = s->offset; i < s->offset + s->run_count; i++)
+    if (s->root_of[i] == i)
+      s->global_parent[i] = label++;
+  return NULL;
+}
+static void *label_strip_write(void *arg) {
+  label_strip *s = arg;
+  uint32_t width = s->bmp->width;
+  for (uint32_t y = s->y0; y < s->y1; y++) {
+    uint32_t *row = s->labels + (size_t)y * width;
+    memset(row, 0, width * sizeof(uint32_t));
+    size_t r = y - s->y0;
+    for (size_t i = s->row_first[r]; i < s->row_first[r + 1]; i++) {
+      uint32_t label = s->global_parent[s->root_of[s->offset + i]];
+      for (uint32_t x = s->runs[i].x0; x <= s->runs[i].x1; x++)
+        row[x] = label;
+    }
+  }
+  return NULL;
+}
+static void run_strips(label_strip *strips, int threads,
+                       void *(*fn)(void *)) {
+  pthread_t tids[MAX_THREADS];
+  if (threads == 1) {
+    fn(&strips[0]);
+    return;
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_create(&tids[t], NULL, fn, &strips[t]);
+  for (int t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+}
+
+uint32_t *bitmap_label(const Bitmap *bmp, int connectivity, int threads,
+                       uint32_t *count) {
+  if ((connectivity != 4 && connectivity != 8) || bmp->height == 0)
+    return NULL;
+  if (threads < 1)
+    threads = 1;
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+  if ((uint32_t)threads > bmp->height)
+    threads = bmp->height;
+  uint32_t *labels =
+      malloc((uint64_t)bmp->width * bmp->height * sizeof(uint32_t));
+  if (labels == NULL)
+    return NULL;
+  label_strip strips[MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    strips[t] = (label_strip){.bmp = bmp, .labels = labels};
+    strips[t].y0 = (uint64_t)bmp->height * t / threads;
+    strips[t].y1 = (uint64_t)bmp->height * (t + 1) / threads;
+    strips[t].touch = connectivity == 8;
+  }
+  run_strips(strips, threads, label_strip_runs);
+
+  // merge: one global index space, then the runs across the strip borders
+  size_t total = 0;
+  for (int t = 0; t < threads; t++) {
+    strips[t].offset = total;
+    total += strips[t].run_count;
+  }
+  uint32_t *parent = malloc((total + 1) * sizeof(uint32_t));
+  uint32_t *root_of = malloc((total + 1) * sizeof(uint32_t));
+  for (int t = 0; t < threads; t++) {
+    label_strip *s = &strips[t];
+    for (size_t i = 0; i < s->run_count; i++)
+      parent[s->offset + i] = s->offset + find(s->parent, i);
+    s->global_parent = parent;
+    s->root_of = root_of;
+  }
+  for (int t = 1; t < threads; t++) {
+    label_strip *above = &strips[t - 1], *below = &strips[t];
+    size_t a = above->row_first[above->y1 - above->y0 - 1];
+    size_t na = above->run_count - a;
+    size_t nb = below->row_first[1];
+    connect_rows(parent, above->runs + a, above->offset + a, na, below->runs,
+                 below->offset, nb, below->touch);
+  }
+
+  run_strips(strips, threads, label_strip_roots);
+  uint32_t next_label = 1;
+  for (int t = 0; t < threads; t++) {
+    strips[t].first_label = next_label;
+    next_label += strips[t].roots;
+  }
+  run_strips(strips, threads, label_strip_number);
+  run_strips(strips, threads, label_strip_write);
+
+  for (int t = 0; t < threads; t++) {
+    free(strips[t].runs);
+    free(strips[t].parent);
+    free(strips[t].row_first);
+  }
+  free(parent);
+  free(root_of);
+  if (count != NULL)
+    *count = next_label - 1;
+  return labels;
+}
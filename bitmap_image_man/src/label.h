@@ -0,0 +1,13 @@
+#pragma once
+#include "data.h"
+#include <stdint.h>
+
+// connected component labeling of the white pixels, connectivity 4 or 8.
+// returns a width * height array (row by row) with 0 for black pixels and
+// 1..count for the components, numbered in the order their first pixel
+// appears. NULL on bad arguments or out of memory, free() the result.
+// works on runs of white pixels found word by word, the rows are split into
+// threads strips that are labeled independently (union-find over the runs)
+// and joined in a merge pass over the strip borders
+uint32_t *bitmap_label(const Bitmap *bmp, int connectivity, int threads,
+                       uint32_t *count);
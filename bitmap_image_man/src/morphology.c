@@ -0,0 +1,154 @@
+#include "morphology.h"
+#include "bitmap.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#define MAX_THREADS 256
+
+typedef struct {
+  Bitmap *dst;
+  const Bitmap *src;
+  uint32_t radius;
+  bool erode;
+  uint32_t y0, y1;
+  // packed rows share bytes with their neighbours. the first row of every
+  // strip is kept here and written after the join, so two threads never
+  // read-modify-write the same bytes
+  uint64_t *first_row;
+} morph_strip;
+
+// one row of src as words with one guard word on each side, pixels outside
+// the bitmap set to the neutral value of the operation
+static void load_row(const morph_strip *s, uint32_t y, uint64_t *in,
+                     size_t words) {
+  uint64_t neutral = s->erode ? ~0ULL : 0;
+  in[0] = neutral;
+  in[words + 1] = neutral;
+  for (size_t i = 0; i < words; i++)
+    in[i + 1] = bitmap_get_word(s->src, i, y);
+  if (s->erode && s->src->width % 64 != 0)
+    in[words] |= ~0ULL << (s->src->width % 64);
+}
+// out pixel x = op of in pixels x - radius .. x + radius
+static void horizontal(const morph_strip *s, const uint64_t *in, uint64_t *out,
+                       size_t words) {
+  for (size_t i = 0; i < words; i++) {
+    uint64_t prev = in[i], word = in[i + 1], next = in[i + 2];
+    uint64_t result = word;
+    for (uint32_t k = 1; k <= s->radius; k++) {
+      uint64_t left = (word << k) | (prev >> (64 - k));
+      uint64_t right = (word >> k) | (next << (64 - k));
+      if (s->erode)
+        result &= left & right;
+      else
+        result |= left | right;
+    }
+    out[i] = result;
+  }
+}
+static void *morph_worker(void *arg) {
+  morph_strip *s = arg;
+  uint32_t height = s->src->height;
+  size_t words = ((size_t)s->src->width + 63) / 64;
+  uint32_t span = 2 * s->radius + 1;
+  // the horizontal results of the last span rows, row j at j % span
+  uint64_t *ring = malloc(span * words * sizeof(uint64_t));
+  uint64_t *in = malloc((words + 2) * sizeof(uint64_t));
+  uint64_t *out = malloc(words * sizeof(uint64_t));
+  uint32_t next = s->y0 > s->radius ? s->y0 - s->radius : 0;
+  for (uint32_t y = s->y0; y < s->y1; y++) {
+    uint32_t first = y > s->radius ? y - s->radius : 0;
+    uint32_t last = height - 1 - y > s->radius ? y + s->radius : height - 1;
+    for (; next <= last; next++) {
+      load_row(s, next, in, words);
+      horizontal(s, in, ring + (size_t)(next % span) * words, words);
+    }
+    memcpy(out, ring + (size_t)(first % span) * words,
+           words * sizeof(uint64_t));
+    for (uint32_t j = first + 1; j <= last; j++) {
+      const uint64_t *row = ring + (size_t)(j % span) * words;
+      for (size_t i = 0; i < words; i++)
+        out[i] = s->erode ? out[i] & row[i] : out[i] | row[i];
+    }
+    if (y == s->y0 && s->first_row != NULL) {
+      memcpy(s->first_row, out, words * sizeof(uint64_t));
+      continue;
+    }
+    for (size_t i = 0; i < words; i++)
+      bitmap_set_word(s->dst, i, y, out[i]);
+  }
+  free(out);
+  free(in);
+  free(ring);
+  return NULL;
+}
+static bool morph(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                  int threads, bool erode) {
+  if (dst == src || dst->width != src->width ||
+      dst->height != src->height || radius == 0 || radius > 63)
+    return false;
+  if (threads < 1)
+    threads = 1;
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+  if ((uint32_t)threads > src->height)
+    threads = src->height;
+  // a packed row must be wider than one set_word window (72 bits), else the
+  // windows of two strips can overlap even with the deferred first rows
+  bool defer = threads > 1 && dst->layout == BITMAP_PACKED;
+  if (defer && dst->width < 128) {
+    threads = 1;
+    defer = false;
+  }
+  size_t words = ((size_t)src->width + 63) / 64;
+  pthread_t tids[MAX_THREADS];
+  morph_strip strips[MAX_THREADS];
+  for (int t = 0; t < threads; t++) {
+    strips[t] = (morph_strip){dst, src, radius, erode, 0, 0, NULL};
+    strips[t].y0 = (uint64_t)src->height * t / threads;
+    strips[t].y1 = (uint64_t)src->height * (t + 1) / threads;
+    if (defer && t > 0)
+      strips[t].first_row = malloc(words * sizeof(uint64_t));
+  }
+  if (threads == 1) {
+    morph_worker(&strips[0]);
+    return true;
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_create(&tids[t], NULL, morph_worker, &strips[t]);
+  for (int t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+  for (int t = 1; t < threads; t++) {
+    if (strips[t].first_row == NULL)
+      continue;
+    for (size_t i = 0; i < words; i++)
+      bitmap_set_word(dst, i, strips[t].y0, strips[t].first_row[i]);
+    free(strips[t].first_row);
+  }
+  return true;
+}
+
+bool bitmap_dilate(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                   int threads) {
+  return morph(dst, src, radius, threads, false);
+}
+bool bitmap_erode(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                  int threads) {
+  return morph(dst, src, radius, threads, true);
+}
+bool bitmap_open(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                 int threads) {
+  Bitmap *tmp = bitmap_create_layout(src->width, src->height, src->layout);
+  bool ok = bitmap_erode(tmp, src, radius, threads) &&
+            bitmap_dilate(dst, tmp, radius, threads);
+  bitmap_destroy(tmp);
+  return ok;
+}
+bool bitmap_close(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                  int threads) {
+  Bitmap *tmp = bitmap_create_layout(src->width, src->height, src->layout);
+  bool ok = bitmap_dilate(tmp, src, radius, threads) &&
+            bitmap_erode(dst, tmp, radius, threads);
+  bitmap_destroy(tmp);
+  return ok;
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "data.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+// binary morphology with a square (2 * radius + 1)^2 structuring element,
+// radius 1..63. works on 64 pixel words: the horizontal part is a few
+// shifts per word, the vertical part ORs/ANDs 2 * radius + 1 rows.
+// pixels outside the bitmap are ignored (they never grow or eat anything).
+// dst and src must be different bitmaps of the same size, any layouts.
+// the rows are split into threads horizontal strips
+bool bitmap_dilate(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                   int threads);
+bool bitmap_erode(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                  int threads);
+// erode then dilate / dilate then erode, with a temporary bitmap
+bool bitmap_open(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                 int threads);
+bool bitmap_close(Bitmap *dst, const Bitmap *src, uint32_t radius,
+                  int threads);
@@ -0,0 +1,206 @@
+#include "pbm.h"
+#include "bitmap.h"
+#include "draw.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bit reversed bytes, built by the preprocessor
+#define R2(n) n, n + 2 * 64, n + 1 * 64, n + 3 * 64
+#define R4(n) R2(n), R2(n + 2 * 16), R2(n + 1 * 16), R2(n + 3 * 16)
+#define R6(n) R4(n), R4(n + 2 * 4), R4(n + 1 * 4), R4(n + 3 * 4)
+static const uint8_t reversed[256] = {R6(0), R6(2), R6(1), R6(3)};
+
+// in size_t: (width + 7) / 8 in uint32_t is 0 for widths near UINT32_MAX
+static size_t row_bytes_of(uint32_t width) { return ((size_t)width + 7) / 8; }
+
+// reverse + invert is its own inverse, so one function for both directions.
+// the pad bits of the last byte end up set, the callers mask them
+static void convert_row(uint8_t *dest, const uint8_t *src, uint32_t width) {
+  size_t bytes = row_bytes_of(width);
+  for (size_t i = 0; i < bytes; i++)
+    dest[i] = ~reversed[src[i]];
+}
+// pad bits are the high bits in bitmap order and the low bits in pbm order
+static void mask_bitmap_row(uint8_t *row, uint32_t width) {
+  if (width % 8 != 0)
+    row[row_bytes_of(width) - 1] &= (1u << (width % 8)) - 1;
+}
+static void mask_pbm_row(uint8_t *row, uint32_t width) {
+  if (width % 8 != 0)
+    row[row_bytes_of(width) - 1] &= (uint8_t)(0xFF << (8 - width % 8));
+}
+
+// header: "P4" whitespace width whitespace height, single whitespace, with
+// '#' comments up to the end of a line allowed in between
+typedef struct {
+  FILE *file;
+  const uint8_t *p;
+  const uint8_t *end;
+} header_input;
+static int next_char(header_input *in) {
+  if (in->file != NULL)
+    return getc(in->file);
+  return in->p < in->end ? *in->p++ : EOF;
+}
+static bool read_number(header_input *in, uint32_t *value) {
+  int c = next_char(in);
+  while (c != EOF && (isspace(c) || c == '#')) {
+    if (c == '#')
+      while (c != EOF && c != '\n')
+        c = next_char(in);
+    c = next_char(in);
+  }
+  if (c == EOF || !isdigit(c))
+    return false;
+  uint64_t number = 0;
+  while (c != EOF && isdigit(c)) {
+    number = number * 10 + (c - '0');
+    if (number > UINT32_MAX)
+      return false;
+    c = next_char(in);
+  }
+  *value = number;
+  // c is the single whitespace that ends the number (and the header)
+  return c != EOF && isspace(c);
+}
+static bool read_header(header_input *in, uint32_t *width, uint32_t *height) {
+  if (next_char(in) != 'P' || next_char(in) != '4')
+    return false;
+  return read_number(in, width) && read_number(in, height) && *width > 0 &&
+         *width <= PBM_MAX_WIDTH && *height > 0;
+}
+
+PbmStream *pbm_reader_open(const char *filename) {
+  FILE *file = fopen(filename, "rb");
+  if (file == NULL) {
+    perror(filename);
+    return NULL;
+  }
+  header_input in = {file, NULL, NULL};
+  uint32_t width, height;
+  if (!read_header(&in, &width, &height)) {
+    fprintf(stderr, "%s: not a binary pbm (P4) file\n", filename);
+    fclose(file);
+    return NULL;
+  }
+  PbmStream *pbm = malloc(sizeof(PbmStream));
+  pbm->file = file;
+  pbm->width = width;
+  pbm->height = height;
+  pbm->row = 0;
+  pbm->row_bytes = row_bytes_of(width);
+  pbm->buffer = NULL;
+  return pbm;
+}
+bool pbm_read_row(PbmStream *pbm, uint8_t *row) {
+  if (pbm->row >= pbm->height)
+    return false;
+  if (fread(row, 1, pbm->row_bytes, pbm->file) != pbm->row_bytes)
+    return false;
+  mask_pbm_row(row, pbm->width);
+  convert_row(row, row, pbm->width);
+  mask_bitmap_row(row, pbm->width);
+  pbm->row++;
+  return true;
+}
+PbmStream *pbm_writer_open(const char *filename, uint32_t width,
+                           uint32_t height) {
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL) {
+    perror(filename);
+    return NULL;
+  }
+  fprintf(file, "P4\n%u %u\n", width, height);
+  PbmStream *pbm = malloc(sizeof(PbmStream));
+  pbm->file = file;
+  pbm->width = width;
+  pbm->height = height;
+  pbm->row = 0;
+  pbm->row_bytes = row_bytes_of(width);
+  pbm->buffer = malloc(pbm->row_bytes);
+  return pbm;
+}
+bool pbm_write_row(PbmStream *pbm, const uint8_t *row) {
+  if (pbm->row >= pbm->height)
+    return false;
+  convert_row(pbm->buffer, row, pbm->width);
+  mask_pbm_row(pbm->buffer, pbm->width);
+  pbm->row++;
+  return fwrite(pbm->buffer, 1, pbm->row_bytes, pbm->file) == pbm->row_bytes;
+}
+bool pbm_close(PbmStream *pbm) {
+  bool ok = true;
+  if (pbm->buffer != NULL) // writer
+    ok = pbm->row == pbm->height && !ferror(pbm->file);
+  if (fclose(pbm->file) == EOF)
+    ok = false;
+  free(pbm->buffer);
+  free(pbm);
+  return ok;
+}
+
+bool bitmap_save_pbm(Bitmap *bmp, const char *filename) {
+  PbmStream *pbm = pbm_writer_open(filename, bmp->width, bmp->height);
+  if (pbm == NULL)
+    return false;
+  uint8_t *row = malloc(pbm->row_bytes + BITMAP_PADDING);
+  bool ok = true;
+  for (uint32_t y = 0; y < bmp->height && ok; y++) {
+    bitmap_get_row(bmp, y, row);
+    ok = pbm_write_row(pbm, row);
+  }
+  free(row);
+  return pbm_close(pbm) && ok;
+}
+// maps the file and converts the rows straight out of the page cache
+Bitmap *bitmap_load_pbm(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    perror(filename);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size == 0) {
+    fprintf(stderr, "%s: empty or unreadable file\n", filename);
+    close(fd);
+    return NULL;
+  }
+  const uint8_t *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    perror(filename);
+    return NULL;
+  }
+  madvise((void *)map, st.st_size, MADV_SEQUENTIAL);
+  header_input in = {NULL, map, map + st.st_size};
+  uint32_t width, height;
+  size_t row_bytes = 0;
+  bool ok = read_header(&in, &width, &height);
+  if (ok) {
+    row_bytes = row_bytes_of(width);
+    ok = (size_t)(in.end - in.p) / row_bytes >= height;
+  }
+  if (!ok) {
+    fprintf(stderr, "%s: not a complete binary pbm (P4) file\n", filename);
+    munmap((void *)map, st.st_size);
+    return NULL;
+  }
+  Bitmap *bmp = bitmap_create(width, height);
+  uint8_t *row = malloc(row_bytes + BITMAP_PADDING);
+  for (uint32_t y = 0; y < height; y++) {
+    memcpy(row, in.p + (size_t)y * row_bytes, row_bytes);
+    mask_pbm_row(row, width);
+    convert_row(row, row, width);
+    mask_bitmap_row(row, width);
+    bitmap_set_row(bmp, y, row);
+  }
+  free(row);
+  munmap((void *)map, st.st_size);
+  return bmp;
+}
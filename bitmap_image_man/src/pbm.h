@@ -0,0 +1,32 @@
+#pragma once
+#include "data.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+/* binary PBM (P4) streaming. P4 rows are padded to whole bytes, the first
+ * pixel is the most significant bit and 1 means black, the Bitmap is the
+ * other way around (lsb first, 1 = white). rows are converted with one
+ * table lookup per byte.
+ * rows passed to / returned by the reader and writer use the Bitmap bit
+ * order, (width + 7) / 8 bytes, so images bigger than RAM can be processed
+ * one row at a time. */
+// wider headers are rejected: the bitmap code rounds widths up to whole
+// 64 bit words in uint32_t
+#define PBM_MAX_WIDTH (UINT32_MAX - 63)
+
+typedef struct {
+  FILE *file;
+  uint32_t width;
+  uint32_t height;
+  uint32_t row; // rows read/written so far
+  size_t row_bytes;
+  uint8_t *buffer;
+} PbmStream;
+
+PbmStream *pbm_reader_open(const char *filename);
+bool pbm_read_row(PbmStream *pbm, uint8_t *row);
+PbmStream *pbm_writer_open(const char *filename, uint32_t width,
+                           uint32_t height);
+bool pbm_write_row(PbmStream *pbm, const uint8_t *row);
+// for writers false if anything failed (incl. missing rows / fclose)
+bool pbm_close(PbmStream *pbm);
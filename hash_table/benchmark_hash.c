@@ -0,0 +1,99 @@
+// compares the ht hash functions: raw speed, bucket distribution and the
+// probe length they produce inside the table
+// usage: ./benchmark_hash [keys]
+#include "../bench/bench.h"
+#include "hash_functions.h"
+#include "hash_table.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+  const char *name;
+  ht_hash_fn fn;
+} named_hash;
+static const named_hash functions[] = {
+    {"fnv1a", ht_hash_fnv1a},
+    {"wy", ht_hash_wy},
+    {"crc32c", ht_hash_crc32c},
+};
+#define FUNCTION_COUNT (sizeof(functions) / sizeof(functions[0]))
+
+// GB/s over keys of one length, 1 MiB of random bytes hashed repeatedly
+static void benchmark_throughput(const named_hash *h, size_t key_length) {
+  size_t buffer_size = 1 << 20;
+  char *buffer = malloc(buffer_size + key_length);
+  for (size_t i = 0; i < buffer_size + key_length; i++)
+    buffer[i] = 'a' + rand() % 26;
+  size_t keys = buffer_size / key_length;
+  if (keys < 1024)
+    keys = 1024;
+  int rounds = 1;
+  double elapsed = 0;
+  volatile uint64_t sink = 0;
+  // grow the run until it takes long enough to time reliably
+  while (elapsed < 0.2) {
+    double start = bench_now_seconds();
+    for (int r = 0; r < rounds; r++) {
+      for (size_t k = 0; k < keys; k++)
+        sink ^= h->fn(buffer + (k * key_length) % buffer_size, key_length);
+    }
+    elapsed = bench_now_seconds() - start;
+    rounds *= 2;
+  }
+  rounds /= 2;
+  double bytes = (double)rounds * keys * key_length;
+  printf("  len %5zu: %7.2f GB/s  %6.1f ns/hash\n", key_length,
+         bytes / elapsed / 1e9, elapsed * 1e9 / ((double)rounds * keys));
+  free(buffer);
+}
+// sequential "user%zu" keys into a power of two bucket count, the pattern
+// that breaks hashes with weak low bits. chi-squared should be close to the
+// bucket count, the z score |(chi2 - buckets) / sqrt(2 * buckets)| small
+static void benchmark_distribution(const named_hash *h, size_t count) {
+  size_t buckets = 1;
+  while (buckets < count / 4)
+    buckets *= 2;
+  size_t *hits = calloc(buckets, sizeof(size_t));
+  char key[32];
+  for (size_t i = 0; i < count; i++) {
+    int len = snprintf(key, sizeof(key), "user%zu", i);
+    hits[h->fn(key, len) & (buckets - 1)]++;
+  }
+  double expected = (double)count / buckets;
+  double chi2 = 0;
+  for (size_t b = 0; b < buckets; b++)
+    chi2 += (hits[b] - expected) * (hits[b] - expected) / expected;
+  printf("  chi2: %.1f over %zu buckets (z = %.2f)\n", chi2, buckets,
+         (chi2 - buckets) / sqrt(2.0 * buckets));
+  free(hits);
+}
+static void benchmark_probe_length(const named_hash *h, size_t count) {
+  ht *table = hash_create_with(h->fn);
+  char key[32];
+  double start = bench_now_seconds();
+  for (size_t i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "user%zu", i);
+    hash_insert(table, (ht_entry){key, NULL});
+  }
+  double insert_time = bench_now_seconds() - start;
+  printf("  table: %zu keys, capacity %zu, avg probe length %.3f, "
+         "insert %.1f ns/key\n",
+         table->length, table->capacity, hash_probe_length(table),
+         insert_time * 1e9 / count);
+  hash_destroy(table);
+}
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000000;
+  size_t lengths[] = {4, 8, 16, 32, 64, 256, 1024, 4096};
+  for (size_t f = 0; f < FUNCTION_COUNT; f++) {
+    printf("%s\n", functions[f].name);
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++)
+      benchmark_throughput(&functions[f], lengths[l]);
+    benchmark_distribution(&functions[f], count);
+    benchmark_probe_length(&functions[f], count);
+  }
+  return 0;
+}
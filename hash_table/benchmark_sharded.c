@@ -0,0 +1,84 @@
+// throughput of the sharded table for read heavy and write heavy mixes
+// usage: ./benchmark_sharded [max_threads] [shards]
+#include "../bench/bench.h"
+#include "sharded_ht.h"
+#include <stdio.h>
+#include <stdlib.h>
+#define KEY_COUNT 100000
+#define OPS_PER_THREAD 1000000
+
+typedef struct {
+  sht *map;
+  char (*keys)[16];
+  int thread_id;
+  int thread_count;
+  int write_percent;
+} worker_args;
+
+// xorshift, rand() has a global lock that would dominate the benchmark
+static unsigned next_random(unsigned *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+static void *worker(void *arg) {
+  worker_args *a = arg;
+  unsigned state = 2463534242u + a->thread_id;
+  for (int op = 0; op < OPS_PER_THREAD; op++) {
+    unsigned r = next_random(&state);
+    if ((int)(r % 100) < a->write_percent) {
+      // writes stay inside the own key partition, so no two threads ever
+      // delete and reinsert the same key at the same time
+      size_t k = (r / 100) % (KEY_COUNT / a->thread_count);
+      k = k * a->thread_count + a->thread_id;
+      sht_delete(a->map, a->keys[k]);
+      int *value = malloc(sizeof(int));
+      *value = (int)k;
+      sht_insert(a->map, (ht_entry){a->keys[k], value});
+    } else {
+      int value;
+      sht_get_copy(a->map, a->keys[(r / 100) % KEY_COUNT], &value,
+                   sizeof(value));
+    }
+  }
+  return NULL;
+}
+static void benchmark_mix(sht *map, char (*keys)[16], int threads,
+                          int write_percent) {
+  pthread_t tids[threads];
+  worker_args args[threads];
+  double start = bench_now_seconds();
+  for (int t = 0; t < threads; t++) {
+    args[t] = (worker_args){map, keys, t, threads, write_percent};
+    pthread_create(&tids[t], NULL, worker, &args[t]);
+  }
+  for (int t = 0; t < threads; t++)
+    pthread_join(tids[t], NULL);
+  double elapsed = bench_now_seconds() - start;
+  double mops = (double)threads * OPS_PER_THREAD / elapsed / 1e6;
+  printf("threads: %2d  writes: %2d%%  %8.2f Mops/s  (%.1f ns/op/thread)\n",
+         threads, write_percent, mops, elapsed * 1e9 / OPS_PER_THREAD);
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  size_t shards = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+  char(*keys)[16] = malloc(KEY_COUNT * sizeof(*keys));
+  sht *map = sht_create(shards);
+  for (int i = 0; i < KEY_COUNT; i++) {
+    snprintf(keys[i], sizeof(keys[i]), "client%d", i);
+    int *value = malloc(sizeof(int));
+    *value = i;
+    sht_insert(map, (ht_entry){keys[i], value});
+  }
+  printf("%zu shards, %zu keys\n", map->shard_count, sht_length(map));
+  int mixes[] = {5, 50};
+  for (int m = 0; m < 2; m++) {
+    for (int threads = 1; threads <= max_threads; threads *= 2)
+      benchmark_mix(map, keys, threads, mixes[m]);
+  }
+  sht_destroy(map);
+  free(keys);
+  return 0;
+}
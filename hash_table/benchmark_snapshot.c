@@ -0,0 +1,60 @@
+// startup cost: rebuilding a ht with hash_insert() vs mmapping a snapshot
+// usage: ./benchmark_snapshot [keys] [file]
+#include "../bench/bench.h"
+#include "ht_snapshot.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+
+int main(int argc, char **argv) {
+  size_t count = argc > 1 ? strtoul(argv[1], NULL, 10) : 10000000;
+  const char *filename = argc > 2 ? argv[2] : "/tmp/ht_snapshot.bin";
+  char key[32];
+
+  double start = bench_now_seconds();
+  ht *table = hash_create();
+  for (size_t i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "key%zu", i);
+    uint64_t *value = malloc(sizeof(uint64_t));
+    *value = i;
+    hash_insert(table, (ht_entry){key, value});
+  }
+  printf("rebuild with hash_insert: %f s (%zu keys)\n",
+         bench_now_seconds() - start, table->length);
+
+  start = bench_now_seconds();
+  if (ht_save(table, filename, sizeof(uint64_t)) == -1) {
+    perror(filename);
+    return 1;
+  }
+  printf("ht_save:                  %f s\n", bench_now_seconds() - start);
+  hash_destroy(table);
+
+  start = bench_now_seconds();
+  hts *snap = hts_open(filename);
+  if (snap == NULL)
+    return 1;
+  printf("hts_open (mmap):          %f s\n", bench_now_seconds() - start);
+
+  // lookups fault the pages in lazily, so time them separately
+  start = bench_now_seconds();
+  size_t misses = 0;
+  for (size_t i = 0; i < count; i++) {
+    snprintf(key, sizeof(key), "key%zu", i);
+    const uint64_t *value = hts_get(snap, key);
+    if (value == NULL || *value != i)
+      misses++;
+  }
+  double elapsed = bench_now_seconds() - start;
+  printf("hts_get all keys:         %f s (%.1f ns/lookup, %zu wrong)\n",
+         elapsed, elapsed * 1e9 / count, misses);
+
+  start = bench_now_seconds();
+  ht *copy = hts_to_ht(snap);
+  printf("hts_to_ht:                %f s\n", bench_now_seconds() - start);
+  if (copy != NULL)
+    hash_destroy(copy);
+  hts_close(snap);
+  remove(filename);
+  return misses != 0;
+}
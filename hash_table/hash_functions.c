@@ -0,0 +1,93 @@
+#include "hash_functions.h"
+#include <string.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_CRC32_INSTRUCTION 1
+#endif
+
+// unaligned loads, memcpy compiles to a single mov
+static inline uint64_t read64(const unsigned char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+static inline uint32_t read32(const unsigned char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+uint64_t ht_hash_fnv1a(const char *key, size_t length) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)key[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+// multiply to 128 bit and fold, every input bit reaches the low output bits
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+uint64_t ht_hash_wy(const char *key, size_t length) {
+  const uint64_t s0 = 0xa0761d6478bd642fULL;
+  const uint64_t s1 = 0xe7037ed1a0b428dbULL;
+  const uint64_t s2 = 0x8ebc6af09c88c6e3ULL;
+  const unsigned char *p = (const unsigned char *)key;
+  uint64_t seed = s0 ^ mum(length ^ s2, s1);
+  size_t left = length;
+  while (left > 16) {
+    seed = mum(read64(p) ^ s1, read64(p + 8) ^ seed);
+    p += 16;
+    left -= 16;
+  }
+  // the last 1..16 bytes, overlapping reads instead of a byte loop
+  uint64_t a = 0, b = 0;
+  if (left >= 8) {
+    a = read64(p);
+    b = read64(p + left - 8);
+  } else if (left >= 4) {
+    a = read32(p);
+    b = read32(p + left - 4);
+  } else if (left > 0) {
+    a = ((uint64_t)p[0] << 16) | ((uint64_t)p[left >> 1] << 8) | p[left - 1];
+  }
+  return mum(s1 ^ length, mum(a ^ s1, b ^ seed));
+}
+
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p,
+                                size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= p[i];
+    for (int bit = 0; bit < 8; bit++)
+      crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+  }
+  return crc;
+}
+#ifdef HAVE_CRC32_INSTRUCTION
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hardware(uint32_t crc, const unsigned char *p, size_t length) {
+  uint64_t crc64 = crc;
+  while (length >= 8) {
+    crc64 = _mm_crc32_u64(crc64, read64(p));
+    p += 8;
+    length -= 8;
+  }
+  crc = (uint32_t)crc64;
+  while (length > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+    length--;
+  }
+  return crc;
+}
+#endif
+uint64_t ht_hash_crc32c(const char *key, size_t length) {
+  const unsigned char *p = (const unsigned char *)key;
+#ifdef HAVE_CRC32_INSTRUCTION
+  if (__builtin_cpu_supports("sse4.2"))
+    return ~crc32c_hardware(~0u, p, length);
+#endif
+  return ~crc32c_software(~0u, p, length);
+}
@@ -0,0 +1,13 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/* hash functions usable as ht_hash_fn (hash_create_with()). the table masks
+ * with capacity - 1, so the low bits have to be good:
+ * - fnv1a:  byte at a time, simple, slow on long keys (default)
+ * - wy:     wyhash style, 8/16 bytes per step with a 128 bit multiply mix
+ * - crc32c: SSE4.2 crc32 instruction (software fallback on other cpus),
+ *           only 32 bits of output */
+uint64_t ht_hash_fnv1a(const char *key, size_t length);
+uint64_t ht_hash_wy(const char *key, size_t length);
+uint64_t ht_hash_crc32c(const char *key, size_t length);
@@ -1,16 +1,28 @@
 #include "hash_table.h"
+#include "hash_functions.h"
+#include "../bench/trace.h"
 #include <stdio.h> //for printf
 #include <stdlib.h>
 #include <string.h> //for strcmp
-#define STANDART_GRÖẞE 3
+#define STANDART_GRÖẞE 8 // has to be a power of two
+// resize before probe chains get long, tombstones count as used
+#define MAX_LOAD_PERCENT 75
 // use a tombstone instead of NULL on char*
 #define TOMBSTONE (char *)-1
+// occupancy bitmap helpers, one uint64_t covers 64 slots
+#define OCC_WORDS(cap) (((cap) + 63) / 64)
+#define OCC_SET(t, i) ((t)->occupied[(i) / 64] |= (1ULL << ((i) % 64)))
+#define OCC_CLEAR(t, i) ((t)->occupied[(i) / 64] &= ~(1ULL << ((i) % 64)))
 
 // creates a new hash table:
-ht *hash_create(void) {
+ht *hash_create(void) { return hash_create_with(ht_hash_fnv1a); }
+ht *hash_create_with(ht_hash_fn hash_fn) {
   ht *table = malloc(sizeof(ht));
   table->capacity = STANDART_GRÖẞE;
+  table->tombstones = 0;
+  table->hash_fn = hash_fn;
   table->entries = calloc(table->capacity, sizeof(ht_entry));
+  table->occupied = calloc(OCC_WORDS(table->capacity), sizeof(uint64_t));
   table->length = 0;
   return table;
 }
@@ -29,78 +41,76 @@ void hash_destroy(ht *table) {
     }
   }
   free(table->entries);
+  free(table->occupied);
   free(table);
 }
-// hash function
-unsigned long hash(const char *str) {
-  unsigned long hash = 2166136261u;
-  while (*str) {
-    hash ^= (unsigned char)(*str++);
-    hash *= 16777619;
+// hash function, kept for callers that only have a string (sharding, the
+// snapshot format); the table itself uses table->hash_fn
+unsigned long hash(const char *str) { return ht_hash_fnv1a(str, strlen(str)); }
+static size_t home_slot(ht *table, const char *key) {
+  return table->hash_fn(key, strlen(key)) & (table->capacity - 1);
+}
+// rezize the array: doubles the capacity when the live entries need it,
+// otherwise rebuilds at the same size just to drop the tombstones. the keys
+// are moved, not copied
+static void hash_resize(ht *table) {
+  TRACE_SCOPE("hash_resize");
+  ht_entry *old_entries = table->entries;
+  uint64_t *old_occupied = table->occupied;
+  size_t old_capacity = table->capacity;
+  if ((table->length + 1) * 100 > table->capacity * MAX_LOAD_PERCENT / 2)
+    table->capacity *= 2;
+  table->entries = calloc(table->capacity, sizeof(ht_entry));
+  table->occupied = calloc(OCC_WORDS(table->capacity), sizeof(uint64_t));
+  table->tombstones = 0;
+  size_t mask = table->capacity - 1;
+  for (size_t n = 0; n < old_capacity; n++) {
+    if (old_entries[n].key == NULL || old_entries[n].key == TOMBSTONE)
+      continue;
+    size_t newhash = home_slot(table, old_entries[n].key);
+    for (size_t i = 0; i < table->capacity; i++) {
+      size_t newnewhash = (newhash + i) & mask;
+      if (table->entries[newnewhash].key == NULL) {
+        table->entries[newnewhash] = old_entries[n];
+        OCC_SET(table, newnewhash);
+        break;
+      }
+    }
   }
-  return hash;
+  free(old_entries);
+  free(old_occupied);
 }
 // insert newentry to hashtable
 void hash_insert(ht *table, ht_entry newentry) {
-  if (table->length < table->capacity) {
-    size_t index = hash(newentry.key) % table->capacity;
-    // if hash is empty, else error handling
-    if (table->entries[index].key == NULL ||
-        table->entries[index].key == TOMBSTONE) {
+  if ((table->length + table->tombstones + 1) * 100 >
+      table->capacity * MAX_LOAD_PERCENT)
+    hash_resize(table);
+  size_t mask = table->capacity - 1;
+  size_t index = home_slot(table, newentry.key);
+  for (size_t i = 0; i < table->capacity; i++) {
+    size_t newindex = (index + i) & mask;
+    if (table->entries[newindex].key == NULL ||
+        table->entries[newindex].key == TOMBSTONE) {
+      if (table->entries[newindex].key == TOMBSTONE)
+        table->tombstones--;
       // deep copy of newentry
-      char *duplicated_key = strdup(newentry.key);
-      table->entries[index].key = duplicated_key;
-      table->entries[index].value = newentry.value;
-      table->length += 1;
-
-    } else {
-      for (int i = 1; i < table->capacity; i++) {
-        size_t newindex = (index + i) % table->capacity;
-        if (table->entries[newindex].key == NULL ||
-            table->entries[newindex].key == TOMBSTONE) {
-          //     table->entries[newindex] = newentry;
-          table->entries[newindex].key = strdup(newentry.key);
-          table->entries[newindex].value = newentry.value;
-          table->length++;
-          break;
-        }
-      }
-    }
-  } else {
-    // rezize the array:
-    ht_entry *old_entries = table->entries;
-    size_t old_capacity = table->capacity;
-    table->capacity *= 2;
-    table->entries = calloc(table->capacity, sizeof(ht_entry));
-    for (int n = 0; n < old_capacity; n++) {
-      if (old_entries[n].key == NULL || old_entries[n].key == TOMBSTONE)
-        continue;
-      size_t newhash = hash(old_entries[n].key) % table->capacity;
-      for (int i = 0; i < table->capacity; i++) {
-        size_t newnewhash = (newhash + i) % table->capacity;
-        if (table->entries[newnewhash].key == NULL ||
-            table->entries[newnewhash].key == TOMBSTONE) {
-          if (old_entries[n].key == NULL || old_entries[n].key == TOMBSTONE)
-            continue;
-          table->entries[newnewhash].key = old_entries[n].key;
-          table->entries[newnewhash].value = old_entries[n].value;
-          break;
-        }
-      }
-      free(old_entries);
-      hash_insert(table, newentry);
+      table->entries[newindex].key = strdup(newentry.key);
+      table->entries[newindex].value = newentry.value;
+      OCC_SET(table, newindex);
+      table->length++;
+      return;
     }
   }
 }
 // search for the value given the key returning a pointer to it (the value)
 void *hash_get(ht *table, const char *key) {
-  size_t index = hash(key) % table->capacity;
-  for (int i = 0; i < table->capacity; i++) {
-    size_t newindex = (index + i) % table->capacity;
+  size_t mask = table->capacity - 1;
+  size_t index = home_slot(table, key);
+  for (size_t i = 0; i < table->capacity; i++) {
+    size_t newindex = (index + i) & mask;
     if (table->entries[newindex].key == NULL) {
       return NULL;
-    } else if ((table->entries[newindex].key != NULL &&
-                table->entries[newindex].key != TOMBSTONE) &&
+    } else if (table->entries[newindex].key != TOMBSTONE &&
                strcmp(table->entries[newindex].key, key) == 0) {
       return table->entries[newindex].value;
     }
@@ -109,17 +119,21 @@ void *hash_get(ht *table, const char *key) {
 }
 // delete the value given the key
 void hash_delete(ht *table, const char *key) {
-  size_t index = hash(key) % table->capacity;
-  for (int i = 0; i < table->capacity; i++) {
-    size_t newindex = (index + i) % table->capacity;
-    if ((table->entries[newindex].key != NULL &&
-         table->entries[newindex].key != TOMBSTONE) &&
+  size_t mask = table->capacity - 1;
+  size_t index = home_slot(table, key);
+  for (size_t i = 0; i < table->capacity; i++) {
+    size_t newindex = (index + i) & mask;
+    if (table->entries[newindex].key == NULL)
+      break;
+    if (table->entries[newindex].key != TOMBSTONE &&
         strcmp(table->entries[newindex].key, key) == 0) {
       free(table->entries[newindex].value);
       free((void *)table->entries[newindex].key);
       table->entries[newindex].value = NULL;
       table->entries[newindex].key = TOMBSTONE;
+      OCC_CLEAR(table, newindex);
       table->length--;
+      table->tombstones++;
       break;
     }
   }
@@ -135,3 +149,61 @@ void hash_print(ht *table) {
     }
   }
 }
+// distance of every live entry from its home slot, +1 for the slot itself
+double hash_probe_length(ht *table) {
+  if (table->length == 0)
+    return 0.0;
+  size_t mask = table->capacity - 1;
+  size_t total = 0;
+  hti it = ht_iterator(table);
+  while (ht_next(&it)) {
+    size_t slot = it._index - 1;
+    total += ((slot - home_slot(table, it.key)) & mask) + 1;
+  }
+  return (double)total / table->length;
+}
+// iterator starts before the first slot, call ht_next() to advance
+hti ht_iterator(ht *table) {
+  hti it;
+  it.key = NULL;
+  it.value = NULL;
+  it._table = table;
+  it._index = 0;
+  return it;
+}
+// move to the next live entry, returns false when there are no more.
+// whole empty words of the occupancy bitmap are skipped with one compare
+bool ht_next(hti *it) {
+  ht *table = it->_table;
+  size_t i = it->_index;
+  while (i < table->capacity) {
+    uint64_t word = table->occupied[i / 64] >> (i % 64);
+    if (word == 0) {
+      i = (i / 64 + 1) * 64;
+      continue;
+    }
+    i += __builtin_ctzll(word);
+    it->key = table->entries[i].key;
+    it->value = table->entries[i].value;
+    it->_index = i + 1;
+    return true;
+  }
+  it->_index = table->capacity;
+  return false;
+}
+size_t ht_export(ht *table, const char **keys, void **values, size_t max) {
+  size_t count = 0;
+  for (size_t w = 0; w < OCC_WORDS(table->capacity) && count < max; w++) {
+    uint64_t word = table->occupied[w];
+    while (word != 0 && count < max) {
+      size_t i = w * 64 + __builtin_ctzll(word);
+      word &= word - 1; // clear lowest set bit
+      if (keys != NULL)
+        keys[count] = table->entries[i].key;
+      if (values != NULL)
+        values[count] = table->entries[i].value;
+      count++;
+    }
+  }
+  return count;
+}
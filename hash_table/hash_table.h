@@ -1,7 +1,11 @@
 #pragma once
+#include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 typedef struct ht ht;
+// key + its length (without '\0'), see hash_functions.h for the choices
+typedef uint64_t (*ht_hash_fn)(const char *key, size_t length);
 
 typedef struct {
   const char *key;
@@ -17,12 +21,27 @@ typedef struct {
 
 struct ht {
   ht_entry *entries;
-  size_t capacity;
+  size_t capacity; // always a power of two, slot = hash & (capacity - 1)
   size_t length;
+  size_t tombstones;
+  ht_hash_fn hash_fn;
+  // one bit per live slot, lets iteration jump over empty/tombstone runs
+  uint64_t *occupied;
 };
 ht *hash_create(void);
+ht *hash_create_with(ht_hash_fn hash_fn);
+unsigned long hash(const char *str);
 void hash_destroy(ht *table);
 void hash_insert(ht *table, ht_entry);
 void *hash_get(ht *table, const char *key);
 void hash_delete(ht *table, const char *key);
 void hash_print(ht *table);
+// average number of slots a successful lookup touches (1.0 = no collisions)
+double hash_probe_length(ht *table);
+// iteration over all live entries (order is slot order, not insert order)
+// usage: hti it = ht_iterator(table); while (ht_next(&it)) { it.key ... }
+hti ht_iterator(ht *table);
+bool ht_next(hti *it);
+// copies up to max live entries into the caller arrays, returns the count
+// (keys still belong to the table). keys or values may be NULL
+size_t ht_export(ht *table, const char **keys, void **values, size_t max);
@@ -0,0 +1,198 @@
+#include "ht_snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static size_t hts_capacity_for(size_t length) {
+  size_t capacity = 16;
+  while (capacity < length * 2)
+    capacity *= 2;
+  return capacity;
+}
+int ht_save(ht *table, const char *filename, size_t value_size) {
+  hts_header header;
+  memset(&header, 0, sizeof(header));
+  header.magic = HTS_MAGIC;
+  header.capacity = hts_capacity_for(table->length);
+  header.length = table->length;
+  header.value_size = value_size;
+  header.slots_offset = sizeof(hts_header);
+  header.values_offset =
+      header.slots_offset + header.capacity * sizeof(hts_slot);
+  header.keys_offset = header.values_offset + header.capacity * value_size;
+  // first pass: size of the key blob
+  size_t keys_size = 0;
+  hti it = ht_iterator(table);
+  while (ht_next(&it))
+    keys_size += strlen(it.key) + 1;
+  header.file_size = header.keys_offset + keys_size;
+
+  int fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1)
+    return -1;
+  if (ftruncate(fd, header.file_size) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  uint8_t *map = mmap(NULL, header.file_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+  memcpy(map, &header, sizeof(header));
+  hts_slot *slots = (hts_slot *)(map + header.slots_offset);
+  uint8_t *values = map + header.values_offset;
+  char *keys = (char *)(map + header.keys_offset);
+  for (size_t i = 0; i < header.capacity; i++)
+    slots[i] = (hts_slot){HTS_EMPTY, 0, 0};
+  // second pass: linear probing into the fresh slot array
+  size_t key_pos = 0;
+  size_t mask = header.capacity - 1;
+  it = ht_iterator(table);
+  while (ht_next(&it)) {
+    unsigned long h = hash(it.key);
+    size_t index = h & mask;
+    while (slots[index].key_offset != HTS_EMPTY)
+      index = (index + 1) & mask;
+    size_t len = strlen(it.key);
+    slots[index] = (hts_slot){key_pos, (uint32_t)len, (uint32_t)h};
+    memcpy(keys + key_pos, it.key, len + 1);
+    key_pos += len + 1;
+    if (value_size > 0 && it.value != NULL)
+      memcpy(values + index * value_size, it.value, value_size);
+  }
+  int result = munmap(map, header.file_size);
+  if (close(fd) == -1)
+    result = -1;
+  return result;
+}
+// reject anything that would make lookups read past the mapping. the
+// sizes are checked against what is left of the file before they are
+// multiplied, a huge capacity must not wrap around to a valid offset
+static bool hts_header_valid(const hts_header *header, size_t file_size) {
+  if (header->magic != HTS_MAGIC || header->file_size != file_size ||
+      header->capacity == 0 ||
+      (header->capacity & (header->capacity - 1)) != 0 ||
+      header->slots_offset != sizeof(hts_header))
+    return false;
+  if (header->capacity >
+      (file_size - header->slots_offset) / sizeof(hts_slot))
+    return false;
+  if (header->values_offset !=
+      header->slots_offset + header->capacity * sizeof(hts_slot))
+    return false;
+  if (header->value_size > 0 &&
+      header->capacity >
+          (file_size - header->values_offset) / header->value_size)
+    return false;
+  return header->keys_offset ==
+         header->values_offset + header->capacity * header->value_size;
+}
+// every used slot has to name a '\0' terminated key inside the key blob,
+// then hts_get() and hts_to_ht() can trust them. written so that no sum
+// can wrap around
+static bool hts_slots_valid(const uint8_t *map, const hts_header *header) {
+  const hts_slot *slots = (const hts_slot *)(map + header->slots_offset);
+  const char *keys = (const char *)(map + header->keys_offset);
+  size_t keys_size = header->file_size - header->keys_offset;
+  for (size_t i = 0; i < header->capacity; i++) {
+    const hts_slot *slot = &slots[i];
+    if (slot->key_offset == HTS_EMPTY)
+      continue;
+    if (slot->key_offset >= keys_size ||
+        slot->key_length >= keys_size - slot->key_offset ||
+        keys[slot->key_offset + slot->key_length] != '\0')
+      return false;
+  }
+  return true;
+}
+hts *hts_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(hts_header)) {
+    fprintf(stderr, "%s: not a snapshot file\n", filename);
+    close(fd);
+    return NULL;
+  }
+  void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping keeps the file alive
+  if (map == MAP_FAILED) {
+    fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    return NULL;
+  }
+  const hts_header *header = map;
+  if (!hts_header_valid(header, st.st_size) ||
+      !hts_slots_valid(map, header)) {
+    fprintf(stderr, "%s: corrupt or incompatible snapshot\n", filename);
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  hts *snap = malloc(sizeof(hts));
+  if (snap == NULL) {
+    fprintf(stderr, "%s: %s\n", filename, strerror(errno));
+    munmap(map, st.st_size);
+    return NULL;
+  }
+  snap->map = map;
+  snap->map_size = st.st_size;
+  snap->header = header;
+  snap->slots = (const hts_slot *)(snap->map + header->slots_offset);
+  return snap;
+}
+void hts_close(hts *snap) {
+  munmap((void *)snap->map, snap->map_size);
+  free(snap);
+}
+const void *hts_get(hts *snap, const char *key) {
+  const hts_header *header = snap->header;
+  const char *keys = (const char *)(snap->map + header->keys_offset);
+  size_t len = strlen(key);
+  unsigned long h = hash(key);
+  size_t mask = header->capacity - 1;
+  for (size_t i = 0, index = h & mask; i < header->capacity;
+       i++, index = (index + 1) & mask) {
+    const hts_slot *slot = &snap->slots[index];
+    if (slot->key_offset == HTS_EMPTY)
+      return NULL;
+    // hts_open() checked that the key lies inside the file
+    if (slot->hash_low == (uint32_t)h && slot->key_length == len &&
+        memcmp(keys + slot->key_offset, key, len) == 0)
+      return snap->map + header->values_offset + index * header->value_size;
+  }
+  return NULL;
+}
+ht *hts_to_ht(hts *snap) {
+  const hts_header *header = snap->header;
+  const char *keys = (const char *)(snap->map + header->keys_offset);
+  ht *table = hash_create();
+  for (size_t i = 0; i < header->capacity; i++) {
+    if (snap->slots[i].key_offset == HTS_EMPTY)
+      continue;
+    void *value = NULL;
+    if (header->value_size > 0) {
+      value = malloc(header->value_size);
+      if (value == NULL) {
+        hash_destroy(table);
+        return NULL;
+      }
+      memcpy(value, snap->map + header->values_offset + i * header->value_size,
+             header->value_size);
+    }
+    hash_insert(table, (ht_entry){keys + snap->slots[i].key_offset, value});
+  }
+  return table;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "hash_table.h"
+#include <stdint.h>
+
+/* flat on-disk image of a ht, every offset is relative to the file start so
+ * the file can be mmapped anywhere and used without fixups:
+ *
+ *   hts_header | hts_slot[capacity] | values[capacity * value_size] | keys
+ *
+ * the slot array is rebuilt on save (power of two capacity, load factor
+ * <= 0.5, no tombstones), so lookups never walk long probe chains. */
+// the slots are placed by hash(), so the version changes with it: 02 is
+// the 64 bit FNV-1a, 01 files (the old hash) are rejected by hts_open()
+#define HTS_MAGIC 0x323050414e535448ULL // "HTSNAP02" little endian
+#define HTS_EMPTY UINT64_MAX
+
+typedef struct {
+  uint64_t magic;
+  uint64_t file_size;
+  uint64_t capacity; // number of slots, power of two
+  uint64_t length;   // live keys
+  uint64_t value_size;
+  uint64_t slots_offset;
+  uint64_t values_offset;
+  uint64_t keys_offset;
+} hts_header;
+
+typedef struct {
+  uint64_t key_offset; // relative to keys_offset, HTS_EMPTY if unused
+  uint32_t key_length; // without the '\0'
+  uint32_t hash_low;   // low 32 hash bits, cheap reject before memcmp
+} hts_slot;
+
+// read only view of a snapshot file
+typedef struct {
+  const uint8_t *map;
+  size_t map_size;
+  const hts_header *header;
+  const hts_slot *slots;
+} hts;
+
+// writes value_size bytes of every value; returns 0 or -1 with errno set
+int ht_save(ht *table, const char *filename, size_t value_size);
+hts *hts_open(const char *filename);
+void hts_close(hts *snap);
+// pointer into the mapping, valid until hts_close()
+const void *hts_get(hts *snap, const char *key);
+// copies the image back into a normal (writable) ht, NULL if out of memory
+ht *hts_to_ht(hts *snap);
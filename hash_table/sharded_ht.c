@@ -0,0 +1,81 @@
+#include "sharded_ht.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* NOTE: reads take the shard lock in shared mode. a seqlock would avoid the
+ * atomic on the lock word, but ht frees keys on delete and the whole entry
+ * array on resize, so an optimistic reader could touch freed memory. */
+
+static sht_shard *sht_shard_for(sht *map, const char *key) {
+  if (map->shard_bits == 0)
+    return &map->shards[0];
+  unsigned long h = hash(key);
+  return &map->shards[h >> (sizeof(unsigned long) * 8 - map->shard_bits)];
+}
+// shard_count gets rounded up to the next power of two
+sht *sht_create(size_t shard_count) {
+  sht *map = malloc(sizeof(sht));
+  if (map == NULL)
+    return NULL;
+  map->shard_bits = 0;
+  while (((size_t)1 << map->shard_bits) < shard_count)
+    map->shard_bits++;
+  map->shard_count = (size_t)1 << map->shard_bits;
+  map->shards = aligned_alloc(64, map->shard_count * sizeof(sht_shard));
+  if (map->shards == NULL) {
+    free(map);
+    return NULL;
+  }
+  for (size_t i = 0; i < map->shard_count; i++) {
+    pthread_rwlock_init(&map->shards[i].lock, NULL);
+    map->shards[i].table = hash_create();
+  }
+  return map;
+}
+void sht_destroy(sht *map) {
+  for (size_t i = 0; i < map->shard_count; i++) {
+    pthread_rwlock_destroy(&map->shards[i].lock);
+    hash_destroy(map->shards[i].table);
+  }
+  free(map->shards);
+  free(map);
+}
+void sht_insert(sht *map, ht_entry newentry) {
+  sht_shard *shard = sht_shard_for(map, newentry.key);
+  pthread_rwlock_wrlock(&shard->lock);
+  hash_insert(shard->table, newentry);
+  pthread_rwlock_unlock(&shard->lock);
+}
+void *sht_get(sht *map, const char *key) {
+  sht_shard *shard = sht_shard_for(map, key);
+  pthread_rwlock_rdlock(&shard->lock);
+  void *value = hash_get(shard->table, key);
+  pthread_rwlock_unlock(&shard->lock);
+  return value;
+}
+// copies size bytes of the value into dest while the shard is still locked
+bool sht_get_copy(sht *map, const char *key, void *dest, size_t size) {
+  sht_shard *shard = sht_shard_for(map, key);
+  pthread_rwlock_rdlock(&shard->lock);
+  void *value = hash_get(shard->table, key);
+  if (value != NULL)
+    memcpy(dest, value, size);
+  pthread_rwlock_unlock(&shard->lock);
+  return value != NULL;
+}
+void sht_delete(sht *map, const char *key) {
+  sht_shard *shard = sht_shard_for(map, key);
+  pthread_rwlock_wrlock(&shard->lock);
+  hash_delete(shard->table, key);
+  pthread_rwlock_unlock(&shard->lock);
+}
+// sum over all shards, only a snapshot while writers are running
+size_t sht_length(sht *map) {
+  size_t length = 0;
+  for (size_t i = 0; i < map->shard_count; i++) {
+    pthread_rwlock_rdlock(&map->shards[i].lock);
+    length += map->shards[i].table->length;
+    pthread_rwlock_unlock(&map->shards[i].lock);
+  }
+  return length;
+}
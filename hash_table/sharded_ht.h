@@ -0,0 +1,28 @@
+#pragma once
+#include "hash_table.h"
+#include <pthread.h>
+
+// one shard = one plain ht behind its own reader-writer lock. padded to a
+// cache line so two shards never share one (false sharing on the lock word)
+typedef struct {
+  pthread_rwlock_t lock;
+  ht *table;
+} __attribute__((aligned(64))) sht_shard;
+
+// thread safe map made of independent ht shards, the shard is picked by the
+// high hash bits so the low bits stay free for the slot index inside the shard
+typedef struct {
+  sht_shard *shards;
+  size_t shard_count; // always a power of two
+  unsigned shard_bits;
+} sht;
+
+sht *sht_create(size_t shard_count);
+void sht_destroy(sht *map);
+void sht_insert(sht *map, ht_entry newentry);
+// the returned value is not protected after the call returns, copy it with
+// sht_get_copy() if another thread could delete the key concurrently
+void *sht_get(sht *map, const char *key);
+bool sht_get_copy(sht *map, const char *key, void *dest, size_t size);
+void sht_delete(sht *map, const char *key);
+size_t sht_length(sht *map);
@@ -59,6 +59,20 @@ int main(int argc, char **argv) {
     printf("'score' not found (BUG - tombstone broke probing!)\n");
   }
 
+  // Test iteration and bulk export
+  printf("\n--- Testing iterator ---\n");
+  hti it = ht_iterator(table);
+  size_t seen = 0;
+  while (ht_next(&it)) {
+    printf("iter key: %s value: %d\n", it.key, *(int *)it.value);
+    seen++;
+  }
+  const char *keys[8];
+  void *values[8];
+  size_t exported = ht_export(table, keys, values, 8);
+  printf("iterated %zu, exported %zu, length %zu\n", seen, exported,
+         table->length);
+
   hash_destroy(table);
   printf("\n--- Hash table destroyed ---\n");
   return 0;
@@ -1,19 +1,250 @@
-// counts the number of worlds that has been used in this specific document
-// using a hash table
+// counts how often every word is used in a document using hash tables
+// usage: ./word_counter [-t threads] [-k top] [--naive] file
 //
+// default mode mmaps the file, splits it into one chunk per thread (cut at
+// word boundaries), tokenizes every chunk with a SSE2 delimiter scan into a
+// thread local ht and merges the tables at the end. --naive is the old
+// fgets() loop on one thread, kept as baseline for the GB/s numbers.
 #include "hash_table.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdio.h>
-int count(ht *ht, char *filename, char *word) {
-  FILE *file;
-  file = fopen(filename, "w");
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#define MAX_WORD 256
+#define MAX_THREADS 256
+
+typedef struct {
+  const uint8_t *begin;
+  const uint8_t *end;
+  ht *table;
+} chunk;
+
+// letters, digits and every non ascii byte (so utf-8 words stay together)
+static inline bool is_word_byte(uint8_t c) {
+  return isalnum(c) || c >= 0x80;
+}
+#ifdef __SSE2__
+// bit i is set if p[i] is a word byte
+static inline uint32_t word_mask16(const uint8_t *p) {
+  __m128i v = _mm_loadu_si128((const __m128i *)p);
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+  __m128i high = _mm_cmplt_epi8(v, _mm_setzero_si128()); // >= 0x80
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), high));
+}
+#endif
+// first position in [p, end) where is_word_byte() == want
+static const uint8_t *scan_until(const uint8_t *p, const uint8_t *end,
+                                 bool want) {
+#ifdef __SSE2__
+  while (end - p >= 16) {
+    uint32_t mask = word_mask16(p);
+    if (!want)
+      mask = ~mask & 0xFFFF;
+    if (mask != 0)
+      return p + __builtin_ctz(mask);
+    p += 16;
+  }
+#endif
+  while (p < end && is_word_byte(*p) != want)
+    p++;
+  return p;
+}
+static void count_word(ht *table, const uint8_t *word, size_t len) {
+  char key[MAX_WORD];
+  if (len >= MAX_WORD)
+    len = MAX_WORD - 1; // overlong tokens get counted by their prefix
+  for (size_t i = 0; i < len; i++)
+    key[i] = tolower(word[i]);
+  key[len] = '\0';
+  size_t *counter = hash_get(table, key);
+  if (counter != NULL) {
+    (*counter)++;
+    return;
+  }
+  counter = malloc(sizeof(size_t));
+  *counter = 1;
+  hash_insert(table, (ht_entry){key, counter});
+}
+static void *count_chunk(void *arg) {
+  chunk *c = arg;
+  const uint8_t *p = c->begin;
+  while (p < c->end) {
+    const uint8_t *start = scan_until(p, c->end, true);
+    if (start == c->end)
+      break;
+    p = scan_until(start, c->end, false);
+    count_word(c->table, start, p - start);
+  }
+  return NULL;
+}
+// adds every count of src into dest
+static void merge_tables(ht *dest, ht *src) {
+  hti it = ht_iterator(src);
+  while (ht_next(&it)) {
+    size_t *counter = hash_get(dest, it.key);
+    if (counter != NULL) {
+      *counter += *(size_t *)it.value;
+    } else {
+      size_t *copy = malloc(sizeof(size_t));
+      *copy = *(size_t *)it.value;
+      hash_insert(dest, (ht_entry){it.key, copy});
+    }
+  }
+}
+static ht *count_mmap(const char *filename, int threads, size_t *bytes) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    perror(filename);
+    return NULL;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    perror(filename);
+    close(fd);
+    return NULL;
+  }
+  *bytes = st.st_size;
+  if (st.st_size == 0) {
+    close(fd);
+    return hash_create();
+  }
+  const uint8_t *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    perror(filename);
+    return NULL;
+  }
+  madvise((void *)data, st.st_size, MADV_SEQUENTIAL);
+  const uint8_t *end = data + st.st_size;
+  chunk chunks[MAX_THREADS];
+  pthread_t tids[MAX_THREADS];
+  const uint8_t *begin = data;
+  for (int t = 0; t < threads; t++) {
+    const uint8_t *cut =
+        (t == threads - 1) ? end : data + st.st_size / threads * (t + 1);
+    if (cut < begin)
+      cut = begin;
+    // never split a word, move the cut behind it
+    while (cut < end && is_word_byte(*cut))
+      cut++;
+    chunks[t] = (chunk){begin, cut, hash_create()};
+    begin = cut;
+  }
+  for (int t = 1; t < threads; t++)
+    pthread_create(&tids[t], NULL, count_chunk, &chunks[t]);
+  count_chunk(&chunks[0]);
+  for (int t = 1; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    merge_tables(chunks[0].table, chunks[t].table);
+    hash_destroy(chunks[t].table);
+  }
+  munmap((void *)data, st.st_size);
+  return chunks[0].table;
+}
+// baseline: line by line with fgets, words cut at 4 KiB line fragments
+static ht *count_naive(const char *filename, size_t *bytes) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    perror(filename);
+    return NULL;
+  }
+  ht *table = hash_create();
+  char line[4096];
+  *bytes = 0;
   while (fgets(line, sizeof(line), file)) {
+    size_t len = strlen(line);
+    *bytes += len;
+    size_t i = 0;
+    while (i < len) {
+      while (i < len && !is_word_byte(line[i]))
+        i++;
+      size_t start = i;
+      while (i < len && is_word_byte(line[i]))
+        i++;
+      if (i > start)
+        count_word(table, (const uint8_t *)line + start, i - start);
+    }
   }
+  if (ferror(file))
+    fprintf(stderr, "%s: %s\n", filename, strerror(errno));
   fclose(file);
-  return 130;
+  return table;
+}
+typedef struct {
+  const char *word;
+  size_t count;
+} word_count;
+static int by_count_desc(const void *a, const void *b) {
+  size_t ca = ((const word_count *)a)->count;
+  size_t cb = ((const word_count *)b)->count;
+  return (ca < cb) - (ca > cb);
+}
+static void print_top(ht *table, size_t k) {
+  word_count *words = malloc(table->length * sizeof(word_count));
+  size_t n = 0;
+  hti it = ht_iterator(table);
+  while (ht_next(&it))
+    words[n++] = (word_count){it.key, *(size_t *)it.value};
+  qsort(words, n, sizeof(word_count), by_count_desc);
+  for (size_t i = 0; i < n && i < k; i++)
+    printf("%10zu  %s\n", words[i].count, words[i].word);
+  free(words);
 }
-int main(int argc, const char **argv) {
-  ht *wordcount = hash_create();
-  printf("there are : %i the char table in hash_table.c",
-         count(wordcount, "hash_table.c", "table"));
+
+int main(int argc, char **argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t top = 20;
+  bool naive = false;
+  const char *filename = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc)
+      top = strtoul(argv[++i], NULL, 10);
+    else if (strcmp(argv[i], "--naive") == 0)
+      naive = true;
+    else
+      filename = argv[i];
+  }
+  if (filename == NULL) {
+    fprintf(stderr, "usage: %s [-t threads] [-k top] [--naive] file\n",
+            argv[0]);
+    return 1;
+  }
+  if (threads < 1)
+    threads = 1;
+  if (threads > MAX_THREADS)
+    threads = MAX_THREADS;
+
+  struct timespec start, end;
+  size_t bytes = 0;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  ht *table = naive ? count_naive(filename, &bytes)
+                    : count_mmap(filename, threads, &bytes);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  if (table == NULL)
+    return 1;
+  double elapsed =
+      (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  print_top(table, top);
+  fprintf(stderr, "%s: %zu bytes, %zu unique words, %.3f s, %.2f GB/s\n",
+          naive ? "fgets" : "mmap", bytes, table->length, elapsed,
+          bytes / elapsed / 1e9);
+  hash_destroy(table);
   return 0;
 }
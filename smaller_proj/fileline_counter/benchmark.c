@@ -0,0 +1,100 @@
+// GB/s of the old fgets loop vs count_file() with mmap and with read()
+// blocks on a generated log file.
+// usage: benchmark [size in MB (default 2048)] [file (default
+// /tmp/fileline_bench.log)], the file is created if it has the wrong size
+#include "../../bench/bench.h"
+#include "count.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+// the loop main.c had before count.c: fgets into 100 bytes, a strlen per
+// fragment, one "line" per 100 byte fragment
+static size_t old_loop(const char *filename, size_t *chars) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    perror(filename);
+    return 0;
+  }
+  size_t lines = 0;
+  char mystring[100];
+  while (fgets(mystring, 100, file)) {
+    lines++;
+    size_t len = strlen(mystring);
+    for (size_t b = 0; b < len; b++) {
+      if (mystring[b] != ' ' && mystring[b] != '\n' && mystring[b] != '\0')
+        (*chars)++;
+    }
+  }
+  fclose(file);
+  return lines;
+}
+// log like lines between 20 and 300 bytes
+static bool create_log(const char *filename, size_t size) {
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    perror(filename);
+    return false;
+  }
+  static const char words[] = "GET /index.html 200 user=alice latency_ms=12 "
+                              "WARN cache miss key=0x7f3a9c retry=3 ";
+  uint64_t state = 88172645463325252ULL;
+  char line[320];
+  size_t written = 0;
+  while (written < size) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    size_t length = 20 + state % 280;
+    for (size_t i = 0; i < length; i++)
+      line[i] = words[((state >> 20) + i) % (sizeof(words) - 1)];
+    line[length] = '\n';
+    if (length + 1 > size - written)
+      length = size - written - 1;
+    fwrite(line, 1, length + 1, file);
+    written += length + 1;
+  }
+  bool ok = !ferror(file);
+  if (fclose(file) == EOF)
+    ok = false;
+  return ok;
+}
+static void report(const char *name, double start, size_t bytes,
+                   size_t lines, size_t chars) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-18s %8.3f s %7.2f GB/s  %zu lines %zu chars\n", name, elapsed,
+         bytes / elapsed / 1e9, lines, chars);
+}
+
+int main(int argc, char **argv) {
+  size_t size = (argc > 1 ? strtoull(argv[1], NULL, 10) : 2048) << 20;
+  const char *filename = argc > 2 ? argv[2] : "/tmp/fileline_bench.log";
+  struct stat st;
+  if (stat(filename, &st) != 0 || (size_t)st.st_size != size) {
+    printf("writing %zu MB to %s\n", size >> 20, filename);
+    if (!create_log(filename, size))
+      return 1;
+  }
+  // first pass only warms the page cache, all runs below read from memory
+  filecount count = {0};
+  count_file(filename, &count, false);
+
+  size_t chars = 0;
+  double start = bench_now_seconds();
+  size_t lines = old_loop(filename, &chars);
+  report("old fgets loop", start, size, lines, chars);
+
+  count = (filecount){0};
+  start = bench_now_seconds();
+  if (!count_file(filename, &count, true))
+    perror(filename);
+  report("read() 1 MB blocks", start, size, count.lines, count.chars);
+
+  count = (filecount){0};
+  start = bench_now_seconds();
+  if (!count_file(filename, &count, false))
+    perror(filename);
+  report("mmap", start, size, count.lines, count.chars);
+  return 0;
+}
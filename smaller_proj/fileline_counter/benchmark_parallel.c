@@ -0,0 +1,98 @@
+// scaling of count_files_parallel() over thread counts for three file mixes
+// (many small files, a few large ones, one huge file plus small ones). the
+// files are written once into a directory and read from the page cache.
+// usage: benchmark_parallel [max threads (default 8)] [directory (default
+// /tmp/fileline_mix)]
+#include "../../bench/bench.h"
+#include "parallel.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+static uint64_t rng_state = 88172645463325252ULL;
+static uint64_t next_random(void) {
+  return bench_random(&rng_state);
+}
+// text with a newline every 1..160 bytes, skipped if it already exists
+static bool write_file(const char *filename, size_t size) {
+  struct stat st;
+  if (stat(filename, &st) == 0 && (size_t)st.st_size == size)
+    return true;
+  FILE *file = fopen(filename, "w");
+  if (file == NULL) {
+    perror(filename);
+    return false;
+  }
+  char block[4096];
+  for (size_t written = 0; written < size; written += sizeof(block)) {
+    for (size_t i = 0; i < sizeof(block); i++) {
+      uint64_t r = next_random();
+      block[i] = r % 160 == 0 ? '\n' : r % 7 == 0 ? ' ' : 'a' + r % 26;
+    }
+    size_t n = size - written < sizeof(block) ? size - written : sizeof(block);
+    fwrite(block, 1, n, file);
+  }
+  bool ok = !ferror(file);
+  if (fclose(file) == EOF)
+    ok = false;
+  return ok;
+}
+typedef struct {
+  const char *name;
+  int count;       // files of size bytes
+  size_t size;
+  int extra_count; // plus extra_count files of extra_size
+  size_t extra_size;
+} file_mix;
+
+static void run_mix(const file_mix *mix, const char *directory,
+                    int max_threads) {
+  int n = mix->count + mix->extra_count;
+  char **files = malloc(n * sizeof(char *));
+  size_t total = 0;
+  for (int i = 0; i < n; i++) {
+    size_t size = i < mix->count ? mix->size : mix->extra_size;
+    files[i] = malloc(strlen(directory) + 64);
+    sprintf(files[i], "%s/%s_%d", directory, mix->name, i);
+    if (!write_file(files[i], size))
+      exit(1);
+    total += size;
+  }
+  file_result *results = malloc(n * sizeof(file_result));
+  // warm the page cache
+  if (results == NULL ||
+      !count_files_parallel(files, n, false, max_threads, results)) {
+    perror("count_files_parallel");
+    exit(1);
+  }
+  printf("%s: %d files, %.1f MB\n", mix->name, n, total / 1e6);
+  double single = 0;
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    double start = bench_now_seconds();
+    count_files_parallel(files, n, false, threads, results);
+    double elapsed = bench_now_seconds() - start;
+    if (threads == 1)
+      single = elapsed;
+    printf("  %3d threads %9.1f ms %7.2f GB/s  speedup %5.2f\n", threads,
+           elapsed * 1e3, total / elapsed / 1e9, single / elapsed);
+  }
+  for (int i = 0; i < n; i++)
+    free(files[i]);
+  free(files);
+  free(results);
+}
+
+int main(int argc, char **argv) {
+  int max_threads = argc > 1 ? atoi(argv[1]) : 8;
+  const char *directory = argc > 2 ? argv[2] : "/tmp/fileline_mix";
+  mkdir(directory, 0755);
+  static const file_mix mixes[] = {
+      {"small", 4000, 64 << 10, 0, 0},
+      {"large", 4, 256 << 20, 0, 0},
+      {"mixed", 1, 512 << 20, 2000, 32 << 10},
+  };
+  for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i++)
+    run_mix(&mixes[i], directory, max_threads);
+  return 0;
+}
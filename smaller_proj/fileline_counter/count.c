@@ -0,0 +1,157 @@
+#include "count.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+#define READ_BLOCK (1 << 20)
+
+// 1 for the whitespace bytes of isspace() in the C locale
+static const uint8_t is_space[256] = {
+    ['\t'] = 1, ['\n'] = 1, ['\v'] = 1, ['\f'] = 1, ['\r'] = 1, [' '] = 1};
+
+static void count_scalar(const uint8_t *p, size_t length, size_t *newlines,
+                         size_t *spaces) {
+  size_t nl = 0, ws = 0;
+  for (size_t i = 0; i < length; i++) {
+    nl += p[i] == '\n';
+    ws += is_space[p[i]];
+  }
+  *newlines += nl;
+  *spaces += ws;
+}
+#ifdef HAVE_AVX2_KERNEL
+// 32 bytes per step: compare, then subtract the 0xFF (= -1) match bytes
+// from per byte counters. every 255 steps the counters are summed with sad
+// before they can overflow
+__attribute__((target("avx2"))) static void
+count_avx2(const uint8_t *p, size_t length, size_t *newlines,
+           size_t *spaces) {
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i four = _mm256_set1_epi8(4);
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i total_nl = zero, total_ws = zero;
+  while (length >= 32) {
+    size_t steps = length / 32 < 255 ? length / 32 : 255;
+    __m256i acc_nl = zero, acc_ws = zero;
+    for (size_t i = 0; i < steps; i++, p += 32) {
+      __m256i v = _mm256_loadu_si256((const __m256i *)p);
+      // \t..\r are 9..13: v - 9 <= 4 unsigned
+      __m256i d = _mm256_sub_epi8(v, tab);
+      __m256i ws = _mm256_or_si256(
+          _mm256_cmpeq_epi8(v, space),
+          _mm256_cmpeq_epi8(_mm256_min_epu8(d, four), d));
+      acc_nl = _mm256_sub_epi8(acc_nl, _mm256_cmpeq_epi8(v, newline));
+      acc_ws = _mm256_sub_epi8(acc_ws, ws);
+    }
+    total_nl = _mm256_add_epi64(total_nl, _mm256_sad_epu8(acc_nl, zero));
+    total_ws = _mm256_add_epi64(total_ws, _mm256_sad_epu8(acc_ws, zero));
+    length -= steps * 32;
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, total_nl);
+  *newlines += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  _mm256_storeu_si256((__m256i *)lanes, total_ws);
+  *spaces += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  count_scalar(p, length, newlines, spaces);
+}
+#endif
+void count_block(const uint8_t *data, size_t length, filecount *count) {
+  size_t newlines = 0, spaces = 0;
+#ifdef HAVE_AVX2_KERNEL
+  if (__builtin_cpu_supports("avx2"))
+    count_avx2(data, length, &newlines, &spaces);
+  else
+#endif
+    count_scalar(data, length, &newlines, &spaces);
+  count->lines += newlines;
+  count->chars += length - spaces;
+  count->bytes += length;
+}
+void count_finish(filecount *count, int last_byte) {
+  if (last_byte != -1 && last_byte != '\n')
+    count->lines++;
+}
+
+static bool map_fd(int fd, const struct stat *st, mapped_file *file) {
+  file->size = st->st_size;
+  file->data = NULL;
+  if (file->size == 0)
+    return true;
+  void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED)
+    return false;
+  madvise(data, file->size, MADV_SEQUENTIAL);
+  file->data = data;
+  return true;
+}
+bool map_file(const char *filename, mapped_file *file) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  if (ok && !S_ISREG(st.st_mode)) {
+    errno = ENODEV;
+    ok = false;
+  }
+  if (ok)
+    ok = map_fd(fd, &st, file);
+  int saved = errno;
+  close(fd);
+  errno = saved;
+  return ok;
+}
+void unmap_file(mapped_file *file) {
+  if (file->data != NULL)
+    munmap((void *)file->data, file->size);
+  file->data = NULL;
+}
+static bool count_read(int fd, filecount *count) {
+  uint8_t *buffer = aligned_alloc(4096, READ_BLOCK);
+  if (buffer == NULL)
+    return false;
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  int last_byte = -1;
+  ssize_t n;
+  while ((n = read(fd, buffer, READ_BLOCK)) != 0) {
+    if (n == -1) {
+      if (errno == EINTR)
+        continue;
+      free(buffer);
+      return false;
+    }
+    count_block(buffer, n, count);
+    last_byte = buffer[n - 1];
+  }
+  count_finish(count, last_byte);
+  free(buffer);
+  return true;
+}
+bool count_file(const char *filename, filecount *count, bool use_read) {
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+    return false;
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0;
+  mapped_file file;
+  if (ok && !use_read && S_ISREG(st.st_mode) && map_fd(fd, &st, &file)) {
+    count_block(file.data, file.size, count);
+    count_finish(count, file.size ? file.data[file.size - 1] : -1);
+    unmap_file(&file);
+  } else if (ok) {
+    // not mappable (pipe, /proc, ...) or asked for: plain reads
+    ok = count_read(fd, count);
+  }
+  int saved = errno;
+  close(fd);
+  errno = saved;
+  return ok;
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+  size_t lines; // '\n' bytes, plus one for a last line without '\n'
+  size_t chars; // bytes that are not whitespace (space \t \n \v \f \r)
+  size_t bytes;
+} filecount;
+
+// a regular file mapped read only, data is NULL for empty files
+typedef struct {
+  const uint8_t *data;
+  size_t size;
+} mapped_file;
+
+// adds the newlines, non whitespace bytes and bytes of a block to count.
+// uses avx2 if the cpu has it. does not know where the file ends, call
+// count_finish() with the last byte of the file once at the end
+void count_block(const uint8_t *data, size_t length, filecount *count);
+// last_byte is -1 for an empty file
+void count_finish(filecount *count, int last_byte);
+// false with errno set if the file can not be opened or is not a regular
+// file (ENODEV), pipes and devices have to go through count_file()
+bool map_file(const char *filename, mapped_file *file);
+void unmap_file(mapped_file *file);
+// counts a whole file: mmap for regular files, otherwise (or with use_read)
+// 1 MB read() blocks after posix_fadvise(SEQUENTIAL).
+// false with errno set on any error, count is only complete on success
+bool count_file(const char *filename, filecount *count, bool use_read);
@@ -1,49 +1,94 @@
+#include "count.h"
+#include "parallel.h"
 #include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 typedef struct {
   size_t lines;
   size_t chars;
+  size_t bytes;
   size_t numberoffiles;
 } fileinfo;
-// TODO: add error handling
+// usage: main [--read] [-j threads] file...
+// --read counts with read() blocks instead of mmap (see count.h)
+// -j counts on a work stealing pool (see parallel.h), the output is the same
+// as without, in argument order
 int main(int argc, char **argv) {
   // initialize fileinfo:
   fileinfo info;
   info.lines = 0;
   info.chars = 0;
+  info.bytes = 0;
   info.numberoffiles = 0;
   int haderrors = 0;
-  for (int i = 1; i < argc; i++) {
+  bool use_read = false;
+  int threads = 1;
+  int first = 1;
+  for (; first < argc; first++) {
+    if (strcmp(argv[first], "--read") == 0) {
+      use_read = true;
+    } else if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) {
+      threads = atoi(argv[++first]);
+      if (threads < 1) {
+        fprintf(stderr, "%s: -j needs a thread count above 0\n", argv[0]);
+        return 1;
+      }
+    } else {
+      break;
+    }
+  }
+  if (first >= argc) {
+    fprintf(stderr, "usage: %s [--read] [-j threads] file...\n", argv[0]);
+    return 1;
+  }
+  int files = argc - first;
+  file_result *results = NULL;
+  if (threads > 1) {
+    // no memory or threads for the pool: count them one by one below
+    results = malloc(files * sizeof(file_result));
+    if (results != NULL && !count_files_parallel(argv + first, files,
+                                                 use_read, threads, results)) {
+      fprintf(stderr, "%s: -j: %i : %s \n", argv[0], errno, strerror(errno));
+      free(results);
+      results = NULL;
+    }
+  }
+  for (int i = first; i < argc; i++) {
     char *filename = argv[i];
-    // check of file actually exist
-    FILE *file = fopen(filename, "r");
-    if (file == NULL) {
-      fprintf(stderr, " %i : %s \n", errno, strerror(errno));
+    filecount count = {0};
+    errno = 0;
+    // open, read and close errors all end up here with errno set
+    bool ok;
+    if (results != NULL) {
+      count = results[i - first].count;
+      errno = results[i - first].error;
+      ok = errno == 0;
+    } else {
+      ok = count_file(filename, &count, use_read);
+    }
+    if (!ok) {
+      fprintf(stderr, "%s: %i : %s \n", argv[0], errno, strerror(errno));
       perror(filename);
       haderrors++;
       continue; // skip to next loop
     }
-    errno = 0;
     info.numberoffiles++;
-    char mystring[100];
-    // XXX: difference fgets and fgetc?
-    while (fgets(mystring, 100, file)) {
-      info.lines++;
-      for (int b = 0; b < strlen(mystring); b++) {
-        if (mystring[b] != ' ' && mystring[b] != '\n' && mystring[b] != '\0')
-          info.chars++;
-      }
-    }
-    // count which chars are full and which are not
-    if (ferror(file))
-      fprintf(stderr, "%i : %s\n", errno, strerror(errno));
-    if (fclose(file) == EOF)
-      fprintf(stderr, "%i : %s\n", errno, strerror(errno));
+    info.lines += count.lines;
+    info.chars += count.chars;
+    info.bytes += count.bytes;
+    printf("%s: %zu lines, %zu chars, %zu bytes\n", filename, count.lines,
+           count.chars, count.bytes);
   }
+  free(results);
   fprintf(stdout, "number of chars: %zu\n", info.chars);
   printf("number of lines: %zu \n", info.lines);
+  printf("number of bytes: %zu\n", info.bytes);
   printf("number of files %zu\n", info.numberoffiles);
+  if (fflush(stdout) == EOF) {
+    perror("stdout");
+    haderrors++;
+  }
 
   return (haderrors > 0);
 }
@@ -0,0 +1,110 @@
+#include "parallel.h"
+#include "pool.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct file_job file_job;
+typedef struct {
+  file_job *file;
+  size_t index;
+} chunk_job;
+
+struct file_job {
+  ws_pool *pool;
+  const char *filename;
+  bool use_read;
+  file_result *result;
+  mapped_file map;
+  filecount *chunk_counts;
+  chunk_job *chunks;
+  size_t chunk_count;
+  atomic_size_t remaining;
+};
+
+static void merge_chunks(file_job *job) {
+  filecount total = {0};
+  for (size_t i = 0; i < job->chunk_count; i++) {
+    total.lines += job->chunk_counts[i].lines;
+    total.chars += job->chunk_counts[i].chars;
+    total.bytes += job->chunk_counts[i].bytes;
+  }
+  count_finish(&total, job->map.data[job->map.size - 1]);
+  job->result->count = total;
+  unmap_file(&job->map);
+  free(job->chunk_counts);
+  free(job->chunks);
+}
+static void count_chunk(void *arg) {
+  chunk_job *chunk = arg;
+  file_job *job = chunk->file;
+  size_t start = chunk->index * (size_t)PARALLEL_CHUNK;
+  size_t length = job->map.size - start < PARALLEL_CHUNK
+                      ? job->map.size - start
+                      : PARALLEL_CHUNK;
+  count_block(job->map.data + start, length, &job->chunk_counts[chunk->index]);
+  if (atomic_fetch_sub(&job->remaining, 1) == 1)
+    merge_chunks(job);
+}
+static void count_whole(void *arg) {
+  file_job *job = arg;
+  file_result *result = job->result;
+  if (!job->use_read && map_file(job->filename, &job->map)) {
+    if (job->map.size > PARALLEL_CHUNK) {
+      // the chunks go to this worker's deque, idle workers steal them
+      job->chunk_count =
+          (job->map.size + PARALLEL_CHUNK - 1) / PARALLEL_CHUNK;
+      job->chunk_counts = calloc(job->chunk_count, sizeof(filecount));
+      job->chunks = malloc(job->chunk_count * sizeof(chunk_job));
+      if (job->chunk_counts != NULL && job->chunks != NULL) {
+        atomic_store(&job->remaining, job->chunk_count);
+        for (size_t i = 0; i < job->chunk_count; i++) {
+          job->chunks[i] = (chunk_job){job, i};
+          ws_pool_submit(job->pool, count_chunk, &job->chunks[i]);
+        }
+        return;
+      }
+      // no memory for the chunk table: count it here in one go
+      free(job->chunk_counts);
+      free(job->chunks);
+    }
+    count_block(job->map.data, job->map.size, &result->count);
+    count_finish(&result->count,
+                 job->map.size ? job->map.data[job->map.size - 1] : -1);
+    unmap_file(&job->map);
+    return;
+  }
+  // pipes, devices, files mmap fails on, --read: one task reads the whole
+  // file, like count_file() does. a file that cannot be opened fails there
+  // again with its errno
+  errno = 0;
+  if (count_file(job->filename, &result->count, true))
+    return;
+  result->error = errno;
+}
+
+bool count_files_parallel(char **files, int n, bool use_read, int threads,
+                          file_result *results) {
+  file_job *jobs = calloc(n, sizeof(file_job));
+  if (jobs == NULL)
+    return false;
+  ws_pool *pool = ws_pool_create(threads);
+  if (pool == NULL) {
+    int saved = errno;
+    free(jobs);
+    errno = saved;
+    return false;
+  }
+  for (int i = 0; i < n; i++) {
+    results[i] = (file_result){{0}, 0};
+    jobs[i] = (file_job){.pool = pool,
+                         .filename = files[i],
+                         .use_read = use_read,
+                         .result = &results[i]};
+    ws_pool_submit(pool, count_whole, &jobs[i]);
+  }
+  ws_pool_wait(pool);
+  ws_pool_destroy(pool);
+  free(jobs);
+  return true;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include "count.h"
+
+// bigger regular files are split into chunks of this size
+#define PARALLEL_CHUNK (8 << 20)
+
+typedef struct {
+  filecount count;
+  int error; // errno of the failed step, 0 if the file was counted
+} file_result;
+
+// counts files[0..n) on a work stealing pool of threads workers, results[i]
+// belongs to files[i]. small files are one task each, regular files above
+// PARALLEL_CHUNK are mapped once and counted in chunks by whichever workers
+// are free, the chunk counts are merged by the last chunk to finish.
+// false with errno set if the pool could not be started, nothing counted
+bool count_files_parallel(char **files, int n, bool use_read, int threads,
+                          file_result *results);
@@ -0,0 +1,196 @@
+#include "pool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+typedef struct {
+  ws_task_fn fn;
+  void *arg;
+} ws_task;
+
+// ring buffer, top = tasks[head], bottom = tasks[tail - 1]
+typedef struct {
+  pthread_mutex_t lock;
+  ws_task *tasks;
+  size_t head, tail, capacity; // capacity is a power of two
+} __attribute__((aligned(64))) ws_deque;
+
+struct ws_pool {
+  ws_deque *deques;
+  pthread_t *tids;
+  int threads;
+  atomic_uint next; // round robin for outside submits
+  pthread_mutex_t lock;
+  pthread_cond_t work; // a task was queued or stop
+  pthread_cond_t done; // pending dropped to 0
+  atomic_size_t queued;  // tasks sitting in deques
+  atomic_size_t pending; // submitted and not finished
+  bool stop;
+};
+
+typedef struct {
+  ws_pool *pool;
+  int index;
+} worker_arg;
+// the worker the current thread is, -1 outside the pool
+static __thread int current_worker = -1;
+static __thread ws_pool *current_pool = NULL;
+
+// false if the deque is full and can not grow
+static bool deque_push(ws_deque *d, ws_task task) {
+  pthread_mutex_lock(&d->lock);
+  if (d->tail - d->head == d->capacity) {
+    size_t capacity = d->capacity ? d->capacity * 2 : 64;
+    ws_task *tasks = malloc(capacity * sizeof(ws_task));
+    if (tasks == NULL) {
+      pthread_mutex_unlock(&d->lock);
+      return false;
+    }
+    for (size_t i = d->head; i < d->tail; i++)
+      tasks[i - d->head] = d->tasks[i & (d->capacity - 1)];
+    free(d->tasks);
+    d->tasks = tasks;
+    d->tail -= d->head;
+    d->head = 0;
+    d->capacity = capacity;
+  }
+  d->tasks[d->tail++ & (d->capacity - 1)] = task;
+  pthread_mutex_unlock(&d->lock);
+  return true;
+}
+static bool deque_take(ws_deque *d, ws_task *task, bool bottom) {
+  pthread_mutex_lock(&d->lock);
+  bool found = d->tail != d->head;
+  if (found && bottom)
+    *task = d->tasks[--d->tail & (d->capacity - 1)];
+  else if (found)
+    *task = d->tasks[d->head++ & (d->capacity - 1)];
+  pthread_mutex_unlock(&d->lock);
+  return found;
+}
+static bool find_task(ws_pool *pool, int self, ws_task *task) {
+  if (deque_take(&pool->deques[self], task, true))
+    return true;
+  for (int i = 1; i < pool->threads; i++)
+    if (deque_take(&pool->deques[(self + i) % pool->threads], task, false))
+      return true;
+  return false;
+}
+static void task_done(ws_pool *pool) {
+  if (atomic_fetch_sub(&pool->pending, 1) == 1) {
+    pthread_mutex_lock(&pool->lock);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+static void *worker_main(void *arg) {
+  worker_arg *w = arg;
+  ws_pool *pool = w->pool;
+  current_worker = w->index;
+  current_pool = pool;
+  for (;;) {
+    ws_task task;
+    if (find_task(pool, w->index, &task)) {
+      atomic_fetch_sub(&pool->queued, 1);
+      task.fn(task.arg);
+      task_done(pool);
+      continue;
+    }
+    // queued is raised under the lock after the push, so checking it under
+    // the lock can not miss a wakeup
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->queued) == 0 && !pool->stop)
+      pthread_cond_wait(&pool->work, &pool->lock);
+    bool stop = pool->stop && atomic_load(&pool->queued) == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (stop)
+      break;
+  }
+  free(w);
+  return NULL;
+}
+
+// stops and joins the first started workers, frees the pool
+static void pool_free(ws_pool *pool, int started) {
+  pthread_mutex_lock(&pool->lock);
+  pool->stop = true;
+  pthread_cond_broadcast(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < started; i++)
+    pthread_join(pool->tids[i], NULL);
+  for (int i = 0; i < pool->threads; i++) {
+    pthread_mutex_destroy(&pool->deques[i].lock);
+    free(pool->deques[i].tasks);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  pthread_cond_destroy(&pool->work);
+  pthread_cond_destroy(&pool->done);
+  free(pool->deques);
+  free(pool->tids);
+  free(pool);
+}
+
+ws_pool *ws_pool_create(int threads) {
+  if (threads < 1)
+    threads = 1;
+  ws_pool *pool = calloc(1, sizeof(ws_pool));
+  if (pool == NULL)
+    return NULL;
+  pool->threads = threads;
+  pool->deques = aligned_alloc(64, threads * sizeof(ws_deque));
+  pool->tids = malloc(threads * sizeof(pthread_t));
+  if (pool->deques == NULL || pool->tids == NULL) {
+    free(pool->deques);
+    free(pool->tids);
+    free(pool);
+    errno = ENOMEM;
+    return NULL;
+  }
+  for (int i = 0; i < threads; i++) {
+    pool->deques[i] = (ws_deque){.tasks = NULL};
+    pthread_mutex_init(&pool->deques[i].lock, NULL);
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->work, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < threads; i++) {
+    worker_arg *w = malloc(sizeof(worker_arg));
+    int err = w == NULL ? ENOMEM : 0;
+    if (w != NULL) {
+      *w = (worker_arg){pool, i};
+      err = pthread_create(&pool->tids[i], NULL, worker_main, w);
+      if (err != 0)
+        free(w);
+    }
+    if (err != 0) {
+      pool_free(pool, i);
+      errno = err;
+      return NULL;
+    }
+  }
+  return pool;
+}
+void ws_pool_submit(ws_pool *pool, ws_task_fn fn, void *arg) {
+  int target = current_pool == pool
+                   ? current_worker
+                   : (int)(atomic_fetch_add(&pool->next, 1) % pool->threads);
+  atomic_fetch_add(&pool->pending, 1);
+  if (!deque_push(&pool->deques[target], (ws_task){fn, arg})) {
+    // no memory to queue it: the submitter runs it
+    fn(arg);
+    task_done(pool);
+    return;
+  }
+  pthread_mutex_lock(&pool->lock);
+  atomic_fetch_add(&pool->queued, 1);
+  pthread_cond_signal(&pool->work);
+  pthread_mutex_unlock(&pool->lock);
+}
+void ws_pool_wait(ws_pool *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (atomic_load(&pool->pending) != 0)
+    pthread_cond_wait(&pool->done, &pool->lock);
+  pthread_mutex_unlock(&pool->lock);
+}
+void ws_pool_destroy(ws_pool *pool) { pool_free(pool, pool->threads); }
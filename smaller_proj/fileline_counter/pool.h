@@ -0,0 +1,20 @@
+#pragma once
+#include <stdbool.h>
+
+// work stealing thread pool: every worker has its own deque. the owner
+// pushes and pops at the bottom (newest first, still hot in cache), idle
+// workers steal from the top of the others (oldest first, usually the
+// biggest piece of work left). the deques have their own small locks, so
+// workers only meet each other when they steal
+typedef void (*ws_task_fn)(void *arg);
+typedef struct ws_pool ws_pool;
+
+// NULL with errno set if the memory or a thread could not be had
+ws_pool *ws_pool_create(int threads);
+// from outside the pool the tasks go round robin to the workers, from a
+// task to the deque of the worker running it. a task that can not be
+// queued (out of memory) runs right away in the caller
+void ws_pool_submit(ws_pool *pool, ws_task_fn fn, void *arg);
+// until every submitted task, including the ones submitted by tasks, ran
+void ws_pool_wait(ws_pool *pool);
+void ws_pool_destroy(ws_pool *pool);
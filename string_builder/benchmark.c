@@ -0,0 +1,156 @@
+// builds 10M small log lines and compares the old append path (strlen on
+// every step, calloc + copy on every growth, two allocations per builder)
+// with the inline buffer + length aware appends
+#include "../bench/bench.h"
+#include "string_builder.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#define LINES 10000000
+
+// count every heap allocation of the process (glibc exports the real
+// allocator as __libc_*, so the benchmark can wrap it)
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+static size_t allocations = 0;
+void *malloc(size_t size) {
+  allocations++;
+  return __libc_malloc(size);
+}
+void *calloc(size_t n, size_t size) {
+  allocations++;
+  return __libc_calloc(n, size);
+}
+void *realloc(void *ptr, size_t size) {
+  allocations++;
+  return __libc_realloc(ptr, size);
+}
+void free(void *ptr) { __libc_free(ptr); }
+
+// the append path as it was before the inline buffer, kept as baseline
+typedef struct {
+  char *data;
+  size_t length;
+  size_t size;
+} old_sb;
+static old_sb *old_create(size_t size) {
+  old_sb *sb = malloc(sizeof(old_sb));
+  sb->length = 0;
+  sb->size = size;
+  sb->data = calloc(size, sizeof(char));
+  return sb;
+}
+static void old_reserve(old_sb *sb, size_t new_capacity) {
+  size_t old_size = sb->size;
+  sb->size = new_capacity;
+  char *old_data = sb->data;
+  sb->data = calloc(sb->size, sizeof(char));
+  memcpy(sb->data, old_data, old_size);
+  free(old_data);
+}
+static void old_append(old_sb *sb, const char *str) {
+  if (strlen(str) <= (sb->size - sb->length - 1)) {
+    strcpy(sb->data + sb->length, str);
+    sb->length += strlen(str);
+  } else {
+    size_t needed = sb->length + strlen(str) + 1;
+    size_t new_cap = sb->size * 2;
+    while (new_cap < needed)
+      new_cap *= 2;
+    old_reserve(sb, new_cap);
+    old_append(sb, str);
+  }
+}
+static void old_destroy(old_sb *sb) {
+  free(sb->data);
+  free(sb);
+}
+
+static const char *levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+static const char *paths[] = {"/", "/index.html", "/api/v1/users",
+                              "/static/app.js"};
+#define APPENDS_PER_LINE 7
+
+static void report(const char *name, double start, size_t allocs,
+                   size_t checksum) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-22s %6.2f ns/append  %7.2f M lines/s  %5.2f allocs/line  "
+         "(%.1f M allocs/s, checksum %zu)\n",
+         name, elapsed * 1e9 / ((double)LINES * APPENDS_PER_LINE),
+         LINES / elapsed / 1e6, (double)allocs / LINES,
+         allocs / elapsed / 1e6, checksum);
+}
+void benchmark_old(void) {
+  size_t checksum = 0, before = allocations;
+  double start = bench_now_seconds();
+  for (int i = 0; i < LINES; i++) {
+    old_sb *sb = old_create(16);
+    old_append(sb, "[");
+    old_append(sb, levels[i & 3]);
+    old_append(sb, "] ");
+    old_append(sb, "GET ");
+    old_append(sb, paths[(i >> 2) & 3]);
+    old_append(sb, " ");
+    old_append(sb, "200");
+    checksum += sb->length;
+    old_destroy(sb);
+  }
+  report("old append_sb", start, allocations - before, checksum);
+}
+void benchmark_heap_sb(void) {
+  size_t checksum = 0, before = allocations;
+  double start = bench_now_seconds();
+  for (int i = 0; i < LINES; i++) {
+    Stringbuilder *sb = create_sb(16);
+    sb_append_char(sb, '[');
+    append_sb(sb, levels[i & 3]);
+    sb_append_n(sb, "] ", 2);
+    sb_append_n(sb, "GET ", 4);
+    append_sb(sb, paths[(i >> 2) & 3]);
+    sb_append_char(sb, ' ');
+    sb_append_n(sb, "200", 3);
+    checksum += sb->length;
+    destroy_sb(sb);
+  }
+  report("create_sb (inline)", start, allocations - before, checksum);
+}
+void benchmark_stack_sb(void) {
+  size_t checksum = 0, before = allocations;
+  double start = bench_now_seconds();
+  for (int i = 0; i < LINES; i++) {
+    Stringbuilder sb;
+    sb_init(&sb, 0);
+    sb_append_char(&sb, '[');
+    append_sb(&sb, levels[i & 3]);
+    sb_append_n(&sb, "] ", 2);
+    sb_append_n(&sb, "GET ", 4);
+    append_sb(&sb, paths[(i >> 2) & 3]);
+    sb_append_char(&sb, ' ');
+    sb_append_n(&sb, "200", 3);
+    checksum += sb.length;
+    sb_release(&sb);
+  }
+  report("sb_init (stack)", start, allocations - before, checksum);
+}
+// one long builder, growth cost only
+void benchmark_growth(void) {
+  size_t before = allocations;
+  double start = bench_now_seconds();
+  Stringbuilder *sb = create_sb(0);
+  for (int i = 0; i < LINES; i++)
+    sb_append_n(sb, "0123456789", 10);
+  double elapsed = bench_now_seconds() - start;
+  printf("one 100 MB builder:    %6.2f ns/append, %zu allocations\n",
+         elapsed * 1e9 / LINES, allocations - before);
+  destroy_sb(sb);
+}
+
+int main() {
+  benchmark_old();
+  benchmark_heap_sb();
+  benchmark_stack_sb();
+  benchmark_growth();
+  return 0;
+}
@@ -0,0 +1,72 @@
+// create/append/destroy cycles, one builder per request like the udp server
+// would do it: malloc vs FreeListPool vs bump arena
+// usage: ./benchmark_allocator [cycles]   (default 10000000)
+#include "../bench/bench.h"
+#include "sb_allocator.h"
+#include <stdlib.h>
+#define ARENA_RESET 1024 // requests per arena reset
+
+static int cycles = 10000000;
+
+// ~70 byte reply, too long for the inline buffer
+static size_t build_reply(Stringbuilder *sb, int i) {
+  sb_append_n(sb, "HTTP/1.1 200 OK\r\nContent-Length: ", 33);
+  sb_append_u64(sb, i % 4096);
+  sb_append_n(sb, "\r\nX-Request-Id: ", 16);
+  sb_append_hex(sb, (uint64_t)i * 2654435761u);
+  sb_append_n(sb, "\r\n\r\n", 4);
+  return sb->length;
+}
+static void report(const char *name, double start, size_t checksum) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-8s %6.1f ns/cycle  %6.2f M cycles/s  (checksum %zu)\n", name,
+         elapsed * 1e9 / cycles, cycles / elapsed / 1e6, checksum);
+}
+static void benchmark_malloc(void) {
+  size_t checksum = 0;
+  double start = bench_now_seconds();
+  for (int i = 0; i < cycles; i++) {
+    Stringbuilder *sb = create_sb(128);
+    checksum += build_reply(sb, i);
+    destroy_sb(sb);
+  }
+  report("malloc", start, checksum);
+}
+static void benchmark_pool(void) {
+  // one slot holds either the struct or the 128 byte initial buffer
+  FreeListPool *pool = freelist_pool_create(128, 1024);
+  SbAllocator allocator = sb_pool_allocator(pool);
+  size_t checksum = 0;
+  double start = bench_now_seconds();
+  for (int i = 0; i < cycles; i++) {
+    Stringbuilder *sb = create_sb_with(128, &allocator);
+    checksum += build_reply(sb, i);
+    destroy_sb(sb);
+  }
+  report("pool", start, checksum);
+  freelist_pool_destroy(pool);
+}
+static void benchmark_arena(void) {
+  SbArena *arena = sb_arena_create(ARENA_RESET * 256);
+  SbAllocator allocator = sb_arena_allocator(arena);
+  size_t checksum = 0;
+  double start = bench_now_seconds();
+  for (int i = 0; i < cycles; i++) {
+    Stringbuilder *sb = create_sb_with(128, &allocator);
+    checksum += build_reply(sb, i);
+    destroy_sb(sb);
+    if (i % ARENA_RESET == ARENA_RESET - 1)
+      sb_arena_reset(arena);
+  }
+  report("arena", start, checksum);
+  sb_arena_destroy(arena);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    cycles = atoi(argv[1]);
+  benchmark_malloc();
+  benchmark_pool();
+  benchmark_arena();
+  return 0;
+}
@@ -0,0 +1,92 @@
+// numbers per second: typed appenders vs sb_append_format()
+#include "../bench/bench.h"
+#include "string_builder.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#define NUMBERS 10000000
+
+static void report(const char *name, double start, Stringbuilder *sb) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-28s %7.2f M numbers/s  %6.1f ns/number  (%zu bytes)\n", name,
+         NUMBERS / elapsed / 1e6, elapsed * 1e9 / NUMBERS, sb->length);
+  clear_sb(sb);
+}
+
+int main() {
+  Stringbuilder *sb = create_sb(256 << 20);
+  uint64_t state = 88172645463325252ULL;
+  uint64_t *values = malloc(NUMBERS * sizeof(uint64_t));
+  double *prices = malloc(NUMBERS * sizeof(double));
+  double *doubles = malloc(NUMBERS * sizeof(double));
+  for (int i = 0; i < NUMBERS; i++) {
+    // mix of small counters and full width ids
+    values[i] = bench_random(&state) >> (bench_random(&state) % 64);
+    prices[i] = (double)(bench_random(&state) % 1000000) / 100;
+    doubles[i] = (double)(bench_random(&state) >> 11) / (1ULL << 53) * 1e6;
+  }
+  double start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_format(sb, "%" PRIu64, values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("format %llu", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_u64(sb, values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("sb_append_u64", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_format(sb, "%" PRId64, (int64_t)values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("format %lld", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_i64(sb, (int64_t)values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("sb_append_i64", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_format(sb, "%" PRIx64, values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("format %llx", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_hex(sb, values[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("sb_append_hex", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_format(sb, "%.17g", prices[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("format %.17g (prices)", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_double(sb, prices[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("sb_append_double (prices)", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_format(sb, "%.17g", doubles[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("format %.17g (random)", start, sb);
+  start = bench_now_seconds();
+  for (int i = 0; i < NUMBERS; i++) {
+    sb_append_double(sb, doubles[i]);
+    sb_append_char(sb, ' ');
+  }
+  report("sb_append_double (random)", start, sb);
+  free(values);
+  free(prices);
+  free(doubles);
+  destroy_sb(sb);
+  return 0;
+}
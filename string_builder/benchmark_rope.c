@@ -0,0 +1,83 @@
+// insert heavy document building: 64 byte snippets at random positions until
+// the document reaches the target size, rope vs insert_sb. insert_sb moves
+// the whole tail every time, so it only runs up to 16 MB
+// usage: ./benchmark_rope [max_mb]   (default 256, 1024 for the 1 GB run)
+#include "../bench/bench.h"
+#include "rope.h"
+#include "string_builder.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define SNIPPET 64
+#define SB_LIMIT (16UL << 20)
+
+void benchmark_rope(size_t target, const char *snippet) {
+  uint64_t state = 88172645463325252ULL;
+  Rope *rope = rope_create();
+  double start = bench_now_seconds();
+  size_t inserts = 0;
+  while (rope_length(rope) < target) {
+    size_t pos = bench_random(&state) % (rope_length(rope) + 1);
+    rope_insert(rope, snippet, SNIPPET, pos);
+    inserts++;
+  }
+  double build = bench_now_seconds() - start;
+
+  start = bench_now_seconds();
+  char slice[4096];
+  size_t sum = 0;
+  for (int i = 0; i < 100000; i++)
+    sum += rope_slice(rope, bench_random(&state) % target, sizeof(slice),
+                      slice);
+  double slicing = bench_now_seconds() - start;
+
+  start = bench_now_seconds();
+  rope_get_string(rope);
+  double flatten = bench_now_seconds() - start;
+
+  int fd = open("/dev/null", O_WRONLY);
+  start = bench_now_seconds();
+  rope_write_fd(rope, fd);
+  double writing = bench_now_seconds() - start;
+  close(fd);
+  printf("rope     %5zu MB: %8.1f ns/insert, %7.1f ns/4K slice, flatten %.3f "
+         "s, writev %.3f s (%zu pieces, %zu)\n",
+         target >> 20, build * 1e9 / inserts, slicing * 1e9 / 100000, flatten,
+         writing, rope->pieces, sum);
+  rope_destroy(rope);
+}
+void benchmark_sb(size_t target, const char *snippet) {
+  uint64_t state = 88172645463325252ULL;
+  Stringbuilder *sb = create_sb(0);
+  char str[SNIPPET + 1];
+  memcpy(str, snippet, SNIPPET);
+  str[SNIPPET] = '\0';
+  double start = bench_now_seconds();
+  size_t inserts = 0;
+  while (sb->length < target) {
+    size_t pos = bench_random(&state) % (sb->length + 1);
+    if (pos < sb->length)
+      insert_sb(sb, str, pos);
+    else
+      sb_append_n(sb, str, SNIPPET);
+    inserts++;
+  }
+  double build = bench_now_seconds() - start;
+  printf("insert_sb %4zu MB: %8.1f ns/insert\n", target >> 20,
+         build * 1e9 / inserts);
+  destroy_sb(sb);
+}
+
+int main(int argc, char **argv) {
+  size_t max_mb = argc > 1 ? strtoul(argv[1], NULL, 10) : 256;
+  char snippet[SNIPPET];
+  for (int i = 0; i < SNIPPET; i++)
+    snippet[i] = 'a' + i % 26;
+  for (size_t mb = 1; mb <= max_mb; mb *= 4) {
+    benchmark_rope(mb << 20, snippet);
+    if ((mb << 20) <= SB_LIMIT)
+      benchmark_sb(mb << 20, snippet);
+  }
+  return 0;
+}
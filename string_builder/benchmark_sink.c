@@ -0,0 +1,110 @@
+// streaming output: build-then-write vs a sink that flushes at a watermark
+// usage: ./benchmark_sink [output file]   (default /tmp/sb_sink_bench.log)
+#include "../bench/bench.h"
+#include "sb_sink.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#define LINES 2000000
+#define DATAGRAMS 200000
+
+static void log_line(Stringbuilder *line, int i) {
+  sb_append_n(line, "[INFO] request ", 15);
+  sb_append_u64(line, i);
+  sb_append_n(line, " served in ", 11);
+  sb_append_u64(line, i % 97);
+  sb_append_n(line, " ms\n", 4);
+}
+static void report(const char *name, double start, size_t bytes,
+                   size_t peak) {
+  double elapsed = bench_now_seconds() - start;
+  printf("%-26s %7.1f MB/s  %7.3f s  peak buffer %zu KB\n", name,
+         bytes / elapsed / 1e6, elapsed, peak >> 10);
+}
+void benchmark_build_then_write(const char *filename) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  double start = bench_now_seconds();
+  Stringbuilder *document = create_sb(0);
+  for (int i = 0; i < LINES; i++)
+    log_line(document, i);
+  const char *text = get_string(document);
+  size_t length = strlen(text), done = 0;
+  while (done < length) {
+    ssize_t written = write(fd, text + done, length - done);
+    if (written <= 0)
+      break;
+    done += written;
+  }
+  report("build then write", start, length, document->size);
+  destroy_sb(document);
+  close(fd);
+}
+void benchmark_sink(const char *filename, size_t watermark) {
+  int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  double start = bench_now_seconds();
+  SbSink *sink = sb_sink_create_fd(fd, watermark);
+  for (int i = 0; i < LINES; i++)
+    log_line(&sink->sb, i);
+  sb_flush(sink);
+  char name[64];
+  snprintf(name, sizeof(name), "sink (%zu KB watermark)", watermark >> 10);
+  report(name, start, sink->bytes_flushed, sink->staging_size);
+  sb_sink_destroy(sink);
+  close(fd);
+}
+// udp: one sendto per reply vs replies batched into 1400 byte datagrams
+void benchmark_udp(void) {
+  int receiver = socket(AF_INET, SOCK_DGRAM, 0);
+  int sender = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(receiver, (struct sockaddr *)&addr, sizeof(addr));
+  socklen_t len = sizeof(addr);
+  getsockname(receiver, (struct sockaddr *)&addr, &len);
+  // nobody reads, the kernel drops what does not fit: only send cost counts
+  Stringbuilder line;
+  sb_init(&line, 0);
+  size_t bytes = 0;
+  double start = bench_now_seconds();
+  for (int i = 0; i < DATAGRAMS; i++) {
+    clear_sb(&line);
+    log_line(&line, i);
+    sendto(sender, line.data, line.length, 0, (struct sockaddr *)&addr,
+           sizeof(addr));
+    bytes += line.length;
+  }
+  report("udp sendto per line", start, bytes, line.size);
+  SbSink *sink = sb_sink_create_udp(sender, (struct sockaddr *)&addr,
+                                    sizeof(addr), 1400);
+  start = bench_now_seconds();
+  // a line is several appends: built on its own so it stays in one packet
+  for (int i = 0; i < DATAGRAMS; i++) {
+    clear_sb(&line);
+    log_line(&line, i);
+    sb_sink_append(sink, line.data, line.length);
+  }
+  sb_flush(sink);
+  report("udp sink (1400 B packets)", start, sink->bytes_flushed,
+         sink->staging_size);
+  printf("  %zu lines in %zu datagrams\n", (size_t)DATAGRAMS, sink->flushes);
+  sb_sink_destroy(sink);
+  sb_release(&line);
+  close(sender);
+  close(receiver);
+}
+
+int main(int argc, char **argv) {
+  const char *filename = argc > 1 ? argv[1] : "/tmp/sb_sink_bench.log";
+  benchmark_build_then_write(filename);
+  benchmark_sink(filename, 4 << 10);
+  benchmark_sink(filename, 64 << 10);
+  benchmark_sink(filename, 1 << 20);
+  benchmark_udp();
+  remove(filename);
+  return 0;
+}
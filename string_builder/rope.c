@@ -0,0 +1,290 @@
+#include "rope.h"
+#include <errno.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#define ROPE_IOV_BATCH 1024 // IOV_MAX on linux
+
+static size_t subtree(RopeNode *n) { return n ? n->total : 0; }
+static void update(RopeNode *n) {
+  n->total = subtree(n->left) + n->len + subtree(n->right);
+}
+static uint32_t next_priority(Rope *rope) {
+  rope->seed ^= rope->seed << 13;
+  rope->seed ^= rope->seed >> 17;
+  rope->seed ^= rope->seed << 5;
+  return rope->seed;
+}
+static RopeNode *new_node(Rope *rope, const char *text, size_t len,
+                          uint32_t priority) {
+  if (rope->slabs == NULL || rope->slab_used == ROPE_NODES_PER_SLAB) {
+    RopeNodeSlab *slab = malloc(sizeof(RopeNodeSlab));
+    if (slab == NULL)
+      return NULL;
+    slab->next = rope->slabs;
+    rope->slabs = slab;
+    rope->slab_used = 0;
+  }
+  RopeNode *n = &rope->slabs->nodes[rope->slab_used++];
+  n->text = text;
+  n->len = len;
+  n->total = len;
+  n->priority = priority;
+  n->left = n->right = NULL;
+  rope->pieces++;
+  return n;
+}
+// copy str into the current block, big strings get a block of their own
+static const char *store(Rope *rope, const char *str, size_t len) {
+  RopeBlock *block = rope->blocks;
+  if (block == NULL || block->size - block->used < len) {
+    size_t size = len > ROPE_BLOCK_SIZE / 4 ? len : ROPE_BLOCK_SIZE;
+    RopeBlock *fresh = malloc(sizeof(RopeBlock) + size);
+    if (fresh == NULL)
+      return NULL;
+    fresh->used = 0;
+    fresh->size = size;
+    if (size == len && block != NULL) {
+      // keep filling the current block afterwards
+      fresh->next = block->next;
+      block->next = fresh;
+    } else {
+      fresh->next = block;
+      rope->blocks = fresh;
+    }
+    block = fresh;
+  }
+  char *dest = block->data + block->used;
+  memcpy(dest, str, len);
+  block->used += len;
+  return dest;
+}
+
+static RopeNode *merge(RopeNode *a, RopeNode *b) {
+  if (a == NULL)
+    return b;
+  if (b == NULL)
+    return a;
+  if (a->priority > b->priority) {
+    a->right = merge(a->right, b);
+    update(a);
+    return a;
+  }
+  b->left = merge(a, b->left);
+  update(b);
+  return b;
+}
+// left gets the first pos bytes, right the rest. a piece that straddles pos
+// is cut in two, the new right half keeps the priority so the heap stays valid
+static bool split(Rope *rope, RopeNode *n, size_t pos, RopeNode **left,
+                  RopeNode **right) {
+  if (n == NULL) {
+    *left = *right = NULL;
+    return true;
+  }
+  size_t left_total = subtree(n->left);
+  bool ok = true;
+  if (pos <= left_total) {
+    ok = split(rope, n->left, pos, left, &n->left);
+    *right = n;
+  } else if (pos >= left_total + n->len) {
+    ok = split(rope, n->right, pos - left_total - n->len, &n->right, right);
+    *left = n;
+  } else {
+    size_t offset = pos - left_total;
+    RopeNode *tail =
+        new_node(rope, n->text + offset, n->len - offset, n->priority);
+    if (tail == NULL)
+      return false;
+    n->len = offset;
+    tail->right = n->right;
+    n->right = NULL;
+    update(tail);
+    *left = n;
+    *right = tail;
+  }
+  update(n);
+  return ok;
+}
+// the piece whose text ends exactly at byte position pos, or NULL
+static RopeNode *piece_ending_at(RopeNode *n, size_t pos) {
+  while (n != NULL) {
+    size_t left_total = subtree(n->left);
+    if (pos <= left_total) {
+      n = n->left;
+    } else if (pos <= left_total + n->len) {
+      return pos == left_total + n->len ? n : NULL;
+    } else {
+      pos -= left_total + n->len;
+      n = n->right;
+    }
+  }
+  return NULL;
+}
+// adds len to the piece ending at pos and to every total on the way down
+static void extend_piece(RopeNode *n, size_t pos, size_t len) {
+  while (n != NULL) {
+    size_t left_total = subtree(n->left);
+    n->total += len;
+    if (pos <= left_total) {
+      n = n->left;
+    } else if (pos == left_total + n->len) {
+      n->len += len;
+      return;
+    } else {
+      pos -= left_total + n->len;
+      n = n->right;
+    }
+  }
+}
+
+Rope *rope_create(void) {
+  Rope *rope = calloc(1, sizeof(Rope));
+  if (rope == NULL)
+    return NULL;
+  rope->seed = 2463534242u;
+  return rope;
+}
+void rope_destroy(Rope *rope) {
+  while (rope->blocks != NULL) {
+    RopeBlock *next = rope->blocks->next;
+    free(rope->blocks);
+    rope->blocks = next;
+  }
+  while (rope->slabs != NULL) {
+    RopeNodeSlab *next = rope->slabs->next;
+    free(rope->slabs);
+    rope->slabs = next;
+  }
+  free(rope->flat);
+  free(rope);
+}
+size_t rope_length(Rope *rope) { return subtree(rope->root); }
+bool rope_append(Rope *rope, const char *str, size_t len) {
+  return rope_insert(rope, str, len, rope_length(rope));
+}
+bool rope_insert(Rope *rope, const char *str, size_t len, size_t position) {
+  if (position > rope_length(rope))
+    return false;
+  if (len == 0)
+    return true;
+  const char *text = store(rope, str, len);
+  if (text == NULL)
+    return false;
+  rope->flat_valid = false;
+  // typing/appending at the same spot: the new text directly follows the
+  // piece before it in the block, so just make that piece longer
+  RopeNode *before = piece_ending_at(rope->root, position);
+  if (before != NULL && before->text + before->len == text) {
+    extend_piece(rope->root, position, len);
+    return true;
+  }
+  RopeNode *n = new_node(rope, text, len, next_priority(rope));
+  RopeNode *left, *right;
+  if (n == NULL || !split(rope, rope->root, position, &left, &right))
+    return false;
+  rope->root = merge(merge(left, n), right);
+  return true;
+}
+// in order copy of [start, end) of the subtree, skips subtrees outside it
+static void copy_range(RopeNode *n, size_t start, size_t end, char *dest) {
+  while (n != NULL && start < end) {
+    size_t left_total = subtree(n->left);
+    if (start < left_total)
+      copy_range(n->left, start, end < left_total ? end : left_total, dest);
+    size_t piece_start = left_total, piece_end = left_total + n->len;
+    if (start < piece_end && end > piece_start) {
+      size_t from = start > piece_start ? start : piece_start;
+      size_t to = end < piece_end ? end : piece_end;
+      memcpy(dest + (from - start), n->text + (from - piece_start),
+             to - from);
+    }
+    if (end <= piece_end)
+      return;
+    // continue in the right subtree without recursion
+    dest += (start < piece_end ? piece_end - start : 0);
+    start = start > piece_end ? start - piece_end : 0;
+    end -= piece_end;
+    n = n->right;
+  }
+}
+size_t rope_slice(Rope *rope, size_t start, size_t len, char *dest) {
+  size_t length = rope_length(rope);
+  if (start >= length)
+    return 0;
+  if (len > length - start)
+    len = length - start;
+  copy_range(rope->root, start, start + len, dest);
+  return len;
+}
+const char *rope_get_string(Rope *rope) {
+  if (rope->flat_valid)
+    return rope->flat;
+  size_t length = rope_length(rope);
+  if (rope->flat == NULL || rope->flat_size < length + 1) {
+    char *flat = realloc(rope->flat, length + 1);
+    if (flat == NULL)
+      return NULL;
+    rope->flat = flat;
+    rope->flat_size = length + 1;
+  }
+  copy_range(rope->root, 0, length, rope->flat);
+  rope->flat[length] = '\0';
+  rope->flat_valid = true;
+  return rope->flat;
+}
+
+typedef struct {
+  int fd;
+  struct iovec iov[ROPE_IOV_BATCH];
+  int count;
+  bool failed;
+} iov_batch;
+// writev until the whole batch is out, partial writes move the iov forward
+static void flush_batch(iov_batch *batch) {
+  struct iovec *iov = batch->iov;
+  int count = batch->count;
+  while (count > 0 && !batch->failed) {
+    ssize_t written = writev(batch->fd, iov, count);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      batch->failed = true;
+      break;
+    }
+    while (count > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  batch->count = 0;
+}
+static void collect(RopeNode *n, iov_batch *batch) {
+  while (n != NULL && !batch->failed) {
+    collect(n->left, batch);
+    batch->iov[batch->count].iov_base = (void *)n->text;
+    batch->iov[batch->count].iov_len = n->len;
+    if (++batch->count == ROPE_IOV_BATCH)
+      flush_batch(batch);
+    n = n->right;
+  }
+}
+bool rope_write_fd(Rope *rope, int fd) {
+  iov_batch *batch = malloc(sizeof(iov_batch));
+  if (batch == NULL)
+    return false;
+  batch->fd = fd;
+  batch->count = 0;
+  batch->failed = false;
+  collect(rope->root, batch);
+  flush_batch(batch);
+  bool ok = !batch->failed;
+  free(batch);
+  return ok;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* chunked builder for big documents with many inserts in the middle.
+ * text is copied once into append-only blocks and never moved again; the
+ * document is a treap (ordered by position, balanced by random priorities)
+ * of pieces pointing into those blocks. inserting splits at most one piece,
+ * so appends, inserts and finding a position are O(log n). the flat string
+ * only exists after rope_get_string(), rope_write_fd() writes the pieces
+ * with writev() without flattening. */
+#define ROPE_BLOCK_SIZE (64 * 1024)
+#define ROPE_NODES_PER_SLAB 1024
+
+typedef struct RopeNode {
+  const char *text;
+  size_t len;
+  size_t total; // bytes in the whole subtree
+  uint32_t priority;
+  struct RopeNode *left;
+  struct RopeNode *right;
+} RopeNode;
+
+typedef struct RopeBlock {
+  struct RopeBlock *next;
+  size_t used;
+  size_t size;
+  char data[];
+} RopeBlock;
+
+typedef struct RopeNodeSlab {
+  struct RopeNodeSlab *next;
+  RopeNode nodes[ROPE_NODES_PER_SLAB];
+} RopeNodeSlab;
+
+typedef struct {
+  RopeNode *root;
+  RopeBlock *blocks;   // head is the block currently filled
+  RopeNodeSlab *slabs; // nodes are only freed with the whole rope
+  size_t slab_used;
+  size_t pieces;
+  uint32_t seed;
+  char *flat; // cache for rope_get_string()
+  size_t flat_size;
+  bool flat_valid;
+} Rope;
+
+Rope *rope_create(void);
+void rope_destroy(Rope *rope);
+size_t rope_length(Rope *rope);
+bool rope_append(Rope *rope, const char *str, size_t len);
+bool rope_insert(Rope *rope, const char *str, size_t len, size_t position);
+// copies up to len bytes starting at start into dest (no '\0' added),
+// returns the number of bytes copied
+size_t rope_slice(Rope *rope, size_t start, size_t len, char *dest);
+// flattened copy, valid until the next modification of the rope
+const char *rope_get_string(Rope *rope);
+// writes the whole document with writev(), returns false on error (errno)
+bool rope_write_fd(Rope *rope, int fd);
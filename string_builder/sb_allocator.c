@@ -0,0 +1,108 @@
+#include "sb_allocator.h"
+#include <stdlib.h>
+#include <string.h>
+#define SB_ARENA_ALIGN 16
+
+static bool in_pool(FreeListPool *pool, void *ptr) {
+  char *start = pool->memory;
+  return (char *)ptr >= start &&
+         (char *)ptr < start + pool->capacity * pool->object_size;
+}
+static void *pool_alloc(void *context, size_t size) {
+  FreeListPool *pool = context;
+  if (size <= pool->object_size) {
+    void *ptr = freelist_pool_alloc(pool);
+    if (ptr != NULL)
+      return ptr;
+  }
+  // too big for a slot or pool exhausted
+  return malloc(size);
+}
+static void pool_free(void *context, void *ptr, size_t size) {
+  FreeListPool *pool = context;
+  (void)size;
+  if (in_pool(pool, ptr))
+    freelist_pool_free(pool, ptr);
+  else
+    free(ptr);
+}
+static void *pool_realloc(void *context, void *ptr, size_t old_size,
+                          size_t new_size) {
+  FreeListPool *pool = context;
+  if (!in_pool(pool, ptr))
+    return realloc(ptr, new_size);
+  if (new_size <= pool->object_size)
+    return ptr;
+  void *grown = malloc(new_size);
+  if (grown == NULL)
+    return NULL;
+  memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+  freelist_pool_free(pool, ptr);
+  return grown;
+}
+SbAllocator sb_pool_allocator(FreeListPool *pool) {
+  return (SbAllocator){pool_alloc, pool_realloc, pool_free, pool, NULL};
+}
+
+SbArena *sb_arena_create(size_t size) {
+  SbArena *arena = malloc(sizeof(SbArena));
+  if (arena == NULL)
+    return NULL;
+  arena->memory = malloc(size);
+  if (arena->memory == NULL) {
+    free(arena);
+    return NULL;
+  }
+  arena->size = size;
+  arena->used = 0;
+  arena->last = SIZE_MAX;
+  return arena;
+}
+void sb_arena_reset(SbArena *arena) {
+  arena->used = 0;
+  arena->last = SIZE_MAX;
+}
+void sb_arena_destroy(SbArena *arena) {
+  free(arena->memory);
+  free(arena);
+}
+static void *arena_alloc(void *context, size_t size) {
+  SbArena *arena = context;
+  size_t start = (arena->used + SB_ARENA_ALIGN - 1) & ~(SB_ARENA_ALIGN - 1);
+  if (start > arena->size || size > arena->size - start)
+    return NULL; // arena is full, the builder reports the failed append
+  arena->used = start + size;
+  arena->last = start;
+  return arena->memory + start;
+}
+// last is SIZE_MAX when there is no newest block, memory + last would
+// be out of bounds
+static bool is_last(SbArena *arena, void *ptr) {
+  return arena->last != SIZE_MAX &&
+         (size_t)((char *)ptr - arena->memory) == arena->last;
+}
+// only the newest block can be given back
+static void arena_free(void *context, void *ptr, size_t size) {
+  SbArena *arena = context;
+  (void)size;
+  if (is_last(arena, ptr)) {
+    arena->used = arena->last;
+    arena->last = SIZE_MAX;
+  }
+}
+static void *arena_realloc(void *context, void *ptr, size_t old_size,
+                           size_t new_size) {
+  SbArena *arena = context;
+  // the newest block just moves the bump pointer
+  if (is_last(arena, ptr) && new_size <= arena->size - arena->last) {
+    arena->used = arena->last + new_size;
+    return ptr;
+  }
+  void *grown = arena_alloc(arena, new_size);
+  if (grown != NULL)
+    memcpy(grown, ptr, old_size < new_size ? old_size : new_size);
+  return grown;
+}
+SbAllocator sb_arena_allocator(SbArena *arena) {
+  return (SbAllocator){arena_alloc, arena_realloc, arena_free, arena, NULL};
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include "../memory_pool/freelist.h"
+#include "string_builder.h"
+
+/* ready made SbAllocators for builders that are created and destroyed very
+ * often (one per request/packet):
+ * - pool: struct and small buffers come from a FreeListPool whose objects
+ *   are object_size bytes, bigger buffers fall back to malloc
+ * - arena: bump allocation, free is a no-op, everything goes away with one
+ *   sb_arena_reset() */
+SbAllocator sb_pool_allocator(FreeListPool *pool);
+
+typedef struct {
+  char *memory;
+  size_t size;
+  size_t used;
+  size_t last; // offset of the newest block, it can grow in place
+} SbArena;
+
+SbArena *sb_arena_create(size_t size);
+void sb_arena_reset(SbArena *arena);
+void sb_arena_destroy(SbArena *arena);
+SbAllocator sb_arena_allocator(SbArena *arena);
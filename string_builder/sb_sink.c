@@ -0,0 +1,188 @@
+#include "sb_sink.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// sb's buffer: plain malloc that keeps staging_size up to date
+static void *sink_alloc(void *context, size_t size) {
+  char *buffer = malloc(size);
+  if (buffer != NULL)
+    ((SbSink *)context)->staging_size = size;
+  return buffer;
+}
+static void *sink_realloc(void *context, void *ptr, size_t old_size,
+                          size_t new_size) {
+  (void)old_size;
+  char *buffer = realloc(ptr, new_size);
+  if (buffer != NULL)
+    ((SbSink *)context)->staging_size = new_size;
+  return buffer;
+}
+static void sink_free(void *context, void *ptr, size_t size) {
+  (void)context;
+  (void)size;
+  free(ptr);
+}
+static bool sink_full(void *context, Stringbuilder *sb) {
+  (void)sb;
+  return sb_flush(context);
+}
+
+static SbSink *sb_sink_create(int fd, bool datagram, size_t watermark) {
+  SbSink *sink = malloc(sizeof(SbSink));
+  if (sink == NULL)
+    return NULL;
+  sink->allocator =
+      (SbAllocator){sink_alloc, sink_realloc, sink_free, sink, sink_full};
+  sink->fd = fd;
+  sink->datagram = datagram;
+  sink->dest_len = 0;
+  sink->watermark = watermark;
+  // + 1 for the '\0': watermark bytes of text fit
+  sb_init_with(&sink->sb, watermark + 1, &sink->allocator);
+  if (sink->sb.data == NULL) {
+    free(sink);
+    return NULL;
+  }
+  sink->staging_size = sink->sb.size;
+  sink->queued = 0;
+  sink->segments = 0;
+  sink->pending = 0;
+  sink->bytes_flushed = 0;
+  sink->flushes = 0;
+  sink->error = 0;
+  return sink;
+}
+SbSink *sb_sink_create_fd(int fd, size_t watermark) {
+  return sb_sink_create(fd, false, watermark);
+}
+SbSink *sb_sink_create_udp(int fd, const struct sockaddr *dest,
+                           socklen_t dest_len, size_t watermark) {
+  SbSink *sink = sb_sink_create(fd, true, watermark);
+  if (sink != NULL && dest != NULL && dest_len <= sizeof(sink->dest)) {
+    memcpy(&sink->dest, dest, dest_len);
+    sink->dest_len = dest_len;
+  }
+  return sink;
+}
+bool sb_sink_destroy(SbSink *sink) {
+  bool ok = sb_flush(sink);
+  sb_release(&sink->sb);
+  free(sink);
+  return ok;
+}
+
+static bool flush_stream(SbSink *sink) {
+  struct iovec *iov = sink->iov;
+  int count = sink->segments;
+  while (count > 0) {
+    ssize_t written = writev(sink->fd, iov, count);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      sink->error = errno;
+      return false;
+    }
+    sink->bytes_flushed += written;
+    // skip the fully written segments, cut into a partially written one
+    while (count > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+  return true;
+}
+static bool flush_datagram(SbSink *sink) {
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  if (sink->dest_len > 0) {
+    msg.msg_name = &sink->dest;
+    msg.msg_namelen = sink->dest_len;
+  }
+  msg.msg_iov = sink->iov;
+  msg.msg_iovlen = sink->segments;
+  ssize_t sent;
+  do {
+    sent = sendmsg(sink->fd, &msg, 0);
+  } while (sent == -1 && errno == EINTR);
+  if (sent == -1) {
+    sink->error = errno;
+    return false;
+  }
+  sink->bytes_flushed += sent;
+  return true;
+}
+// sb's text since the last segment becomes one. there is always a free
+// segment for it, sb_sink_append_ref() makes sure
+static void queue_text(SbSink *sink) {
+  Stringbuilder *sb = &sink->sb;
+  if (sb->length == sink->queued)
+    return;
+  sink->iov[sink->segments].iov_base = sb->data + sink->queued;
+  sink->iov[sink->segments].iov_len = sb->length - sink->queued;
+  sink->segments++;
+  sink->pending += sb->length - sink->queued;
+  sink->queued = sb->length;
+}
+bool sb_flush(SbSink *sink) {
+  if (sink->error != 0)
+    return false;
+  queue_text(sink);
+  bool ok = true;
+  if (sink->segments > 0) {
+    ok = sink->datagram ? flush_datagram(sink) : flush_stream(sink);
+    sink->flushes++;
+  }
+  sink->segments = 0;
+  sink->pending = 0;
+  sink->queued = 0;
+  sink->sb.length = 0;
+  sink->sb.data[0] = '\0';
+  sink->sb.size = sink->staging_size;
+  return ok;
+}
+bool sb_sink_append_ref(SbSink *sink, const void *data, size_t len) {
+  if (sink->error != 0)
+    return false;
+  size_t unsent = sink->pending + (sink->sb.length - sink->queued);
+  // datagrams: make room before the append, so it stays in one packet.
+  // the text before it, the reference and the text sb_flush() queues
+  // need three segments
+  if ((sink->datagram && unsent > 0 && unsent + len > sink->watermark) ||
+      sink->segments + 3 > SB_SINK_MAX_SEGMENTS) {
+    if (!sb_flush(sink))
+      return false;
+  }
+  if (len == 0)
+    return true;
+  queue_text(sink);
+  sink->iov[sink->segments].iov_base = (void *)data;
+  sink->iov[sink->segments].iov_len = len;
+  sink->segments++;
+  sink->pending += len;
+  if (!sink->datagram)
+    return sink->pending < sink->watermark || sb_flush(sink);
+  // the rest of the datagram is what sb may still take
+  size_t room = sink->pending < sink->watermark
+                    ? sink->watermark - sink->pending
+                    : 0;
+  sink->sb.size = sink->sb.length + 1 + room;
+  return true;
+}
+bool sb_sink_append(SbSink *sink, const char *str, size_t len) {
+  if (sink->error != 0)
+    return false;
+  // bigger than the whole buffer: send it from where it is
+  if (len >= sink->staging_size)
+    return sb_sink_append_ref(sink, str, len) && sb_flush(sink);
+  return sb_append_n(&sink->sb, str, len);
+}
+bool sb_sink_append_sb(SbSink *sink, Stringbuilder *sb) {
+  return sb_sink_append_ref(sink, sb->data, sb->length);
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include "string_builder.h"
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+/* builder bound to an output: sink->sb is an ordinary Stringbuilder whose
+ * buffer (watermark bytes) is the staging area, every sb_append_*() and
+ * sb_append_format() writes straight into it. an append that does not fit
+ * flushes first (SbAllocator.full), so pending data goes out with one
+ * writev()/sendmsg() at the watermark and nothing ever holds the whole
+ * document. references to caller memory (sb_sink_append_ref) go out in the
+ * same call without being copied.
+ * - stream mode (files, pipes, tcp): written once the watermark is reached
+ * - datagram mode (udp): every flush is exactly one datagram of at most
+ *   watermark bytes, a single append never gets split over two packets
+ *   (records made of several appends: build them in a builder of their own
+ *   and sb_sink_append() them)
+ * only append to sink->sb: clear_sb(), sb_reserve() and friends would
+ * take back text that is already queued. an append bigger than the whole
+ * buffer grows it */
+#define SB_SINK_MAX_SEGMENTS 1024 // IOV_MAX on linux
+
+typedef struct {
+  Stringbuilder sb;
+  SbAllocator allocator; // sb's, flushes when sb is full
+  int fd;
+  bool datagram;
+  struct sockaddr_storage dest; // only used for unconnected udp sockets
+  socklen_t dest_len;
+  size_t watermark;
+  size_t staging_size; // allocated for sb, sb.size is less while a
+                       // datagram has references queued
+  size_t queued;       // bytes of sb already in iov
+  struct iovec iov[SB_SINK_MAX_SEGMENTS];
+  int segments;
+  size_t pending; // bytes in iov
+  size_t bytes_flushed;
+  size_t flushes;
+  int error; // errno of the first failed write, appends fail after that
+} SbSink;
+
+SbSink *sb_sink_create_fd(int fd, size_t watermark);
+// dest may be NULL for a connected socket
+SbSink *sb_sink_create_udp(int fd, const struct sockaddr *dest,
+                           socklen_t dest_len, size_t watermark);
+// flushes what is left, does not close the fd
+bool sb_sink_destroy(SbSink *sink);
+// copies str into sink->sb
+bool sb_sink_append(SbSink *sink, const char *str, size_t len);
+// zero copy: only the pointer is stored, data has to stay valid (and
+// unchanged) until the next sb_flush()
+bool sb_sink_append_ref(SbSink *sink, const void *data, size_t len);
+// sb_sink_append_ref() of sb's text: sb must not change until sb_flush()
+bool sb_sink_append_sb(SbSink *sink, Stringbuilder *sb);
+bool sb_flush(SbSink *sink);
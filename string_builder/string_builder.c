@@ -1,63 +1,128 @@
 #include "string_builder.h"
+#include "../bench/trace.h"
+#include "sb_double_table.h"
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 
-Stringbuilder *create_sb(size_t size) {
-  Stringbuilder *sb = malloc(sizeof(Stringbuilder));
+static void *sb_alloc(const SbAllocator *a, size_t size) {
+  return a ? a->alloc(a->context, size) : malloc(size);
+}
+static void *sb_realloc(const SbAllocator *a, void *ptr, size_t old_size,
+                        size_t new_size) {
+  return a ? a->realloc(a->context, ptr, old_size, new_size)
+           : realloc(ptr, new_size);
+}
+static void sb_free(const SbAllocator *a, void *ptr, size_t size) {
+  if (a)
+    a->free(a->context, ptr, size);
+  else
+    free(ptr);
+}
+
+Stringbuilder *create_sb(size_t size) { return create_sb_with(size, NULL); }
+Stringbuilder *create_sb_with(size_t size, const SbAllocator *allocator) {
+  Stringbuilder *sb = sb_alloc(allocator, sizeof(Stringbuilder));
   if (sb == NULL) {
     printf("error string building failed");
+    return NULL;
   }
-  sb->length = 0;
-  sb->size = size;
-  sb->data = calloc(size, sizeof(char));
+  sb_init_with(sb, size, allocator);
   if (sb->data == NULL) {
-
     printf("error data allocation failed");
+    sb_free(allocator, sb, sizeof(Stringbuilder));
+    return NULL;
   }
   return sb;
 }
 void destroy_sb(Stringbuilder *sb) {
-  free(sb->data);
-  free(sb);
+  const SbAllocator *allocator = sb->allocator;
+  sb_release(sb);
+  sb_free(allocator, sb, sizeof(Stringbuilder));
+}
+void sb_init(Stringbuilder *sb, size_t size) { sb_init_with(sb, size, NULL); }
+void sb_init_with(Stringbuilder *sb, size_t size,
+                  const SbAllocator *allocator) {
+  sb->length = 0;
+  sb->allocator = allocator;
+  if (size <= SB_INLINE_CAPACITY) {
+    sb->size = SB_INLINE_CAPACITY;
+    sb->data = sb->inline_data;
+  } else {
+    sb->size = size;
+    sb->data = sb_alloc(allocator, size);
+  }
+  if (sb->data != NULL)
+    sb->data[0] = '\0';
+}
+void sb_release(Stringbuilder *sb) {
+  if (sb->data != sb->inline_data && sb->data != NULL)
+    sb_free(sb->allocator, sb->data, sb->size);
+  sb->data = NULL;
+  sb->length = sb->size = 0;
+}
+// geometric growth, keeps appends amortized O(1). needed is length + n + 1
+// at every call site: not above length means that sum wrapped around
+static bool sb_grow(Stringbuilder *sb, size_t needed) {
+  if (needed <= sb->length)
+    return false;
+  const SbAllocator *a = sb->allocator;
+  if (a != NULL && a->full != NULL) {
+    size_t more = needed - sb->length;
+    if (!a->full(a->context, sb))
+      return false;
+    needed = sb->length + more;
+    if (needed <= sb->size)
+      return true;
+  }
+  size_t new_cap = sb->size > SB_INLINE_CAPACITY ? sb->size
+                                                 : SB_INLINE_CAPACITY;
+  while (new_cap < needed) {
+    if (new_cap > SIZE_MAX / 2)
+      return false;
+    new_cap *= 2;
+  }
+  return sb_reserve(sb, new_cap);
 }
 bool append_sb(Stringbuilder *sb, const char *str) {
+  return sb_append_n(sb, str, strlen(str));
+}
+// append len bytes of str, str does not need to be '\0' terminated
+bool sb_append_n(Stringbuilder *sb, const char *str, size_t len) {
   // testing branch prediction hints 1 means likely
-  if (__builtin_expect((strlen(str) <= (sb->size - sb->length - 1)), 1)) {
-    // logic for just one char: else a string
-    if (strlen(str) == 1) {
-      sb->data[sb->length] = str[0];
-      sb->length++;
-      sb->data[sb->length] = '\0';
-
-    } else {
-      strcpy(sb->data + sb->length, str);
-      sb->length += strlen(str);
-      return true;
-    }
-  } else {
-    size_t needed = sb->length + strlen(str) + 1;
-    size_t new_cap = sb->size * 2;
-    while (new_cap < needed)
-      new_cap *= 2;
-    sb_reserve(sb, new_cap);
-    append_sb(sb, str);
+  if (__builtin_expect(len >= sb->size - sb->length, 0)) {
+    if (!sb_grow(sb, sb->length + len + 1))
+      return false;
   }
-  return false;
+  memcpy(sb->data + sb->length, str, len);
+  sb->length += len;
+  sb->data[sb->length] = '\0';
+  return true;
+}
+bool sb_append_char(Stringbuilder *sb, char c) {
+  if (__builtin_expect(sb->size - sb->length <= 1, 0)) {
+    if (!sb_grow(sb, sb->length + 2))
+      return false;
+  }
+  sb->data[sb->length++] = c;
+  sb->data[sb->length] = '\0';
+  return true;
 }
+// shifts the tail in place, still O(n) per insert: use the rope (rope.h)
+// for documents with many inserts in the middle
 bool insert_sb(Stringbuilder *sb, const char *str, size_t position) {
   // check if position is valid:
   if (position < sb->length) {
-    // delete all strings right of the position:
-    size_t rightlen = sb->length - position;
-    char *rightstr = malloc(rightlen + 1);
-    memcpy(rightstr, sb->data + position, rightlen);
-    rightstr[rightlen] = '\0';
-    sb->data[position] = '\0';
-    sb->length = position;
-    append_sb(sb, str);
-    append_sb(sb, rightstr);
-    free(rightstr);
+    size_t len = strlen(str);
+    if (len >= sb->size - sb->length && !sb_grow(sb, sb->length + len + 1))
+      return 0;
+    if (position >= sb->length) // allocator->full took the text
+      return 0;
+    // move the right part (with its '\0') out of the way, then fill the gap
+    memmove(sb->data + position + len, sb->data + position,
+            sb->length - position + 1);
+    memcpy(sb->data + position, str, len);
+    sb->length += len;
     return 1;
   } else {
     return 0;
@@ -69,13 +134,38 @@ void clear_sb(Stringbuilder *sb) {
   sb->data[0] = '\0';
   sb->length = 0;
 }
+// set the buffer size to new_capacity bytes (including the '\0'), moves
+// between the inline buffer and the heap as needed
 bool sb_reserve(Stringbuilder *sb, size_t new_capacity) {
-  size_t old_size = sb->size;
+  if (new_capacity < sb->length + 1)
+    return false;
+  // released (sb_release): starts over in the inline buffer
+  if (sb->data == NULL) {
+    sb->data = sb->inline_data;
+    sb->data[0] = '\0';
+    sb->size = SB_INLINE_CAPACITY;
+  }
+  TRACE_SCOPE("sb_reserve");
+  if (sb->data == sb->inline_data) {
+    if (new_capacity <= SB_INLINE_CAPACITY)
+      return true;
+    char *heap = sb_alloc(sb->allocator, new_capacity);
+    if (heap == NULL)
+      return false;
+    memcpy(heap, sb->data, sb->length + 1);
+    sb->data = heap;
+  } else if (new_capacity <= SB_INLINE_CAPACITY) {
+    memcpy(sb->inline_data, sb->data, sb->length + 1);
+    sb_free(sb->allocator, sb->data, sb->size);
+    sb->data = sb->inline_data;
+    new_capacity = SB_INLINE_CAPACITY;
+  } else {
+    char *heap = sb_realloc(sb->allocator, sb->data, sb->size, new_capacity);
+    if (heap == NULL)
+      return false;
+    sb->data = heap;
+  }
   sb->size = new_capacity;
-  const char *old_data = sb->data;
-  sb->data = calloc(sb->size, sizeof(char));
-  memcpy(sb->data, old_data, old_size);
-  free((void *)old_data);
   return true;
 }
 // shrink the string builder to exactly fit the string size:
@@ -92,17 +182,340 @@ void sb_shrink_to_fit(Stringbuilder *sb) {
 bool sb_append_format(Stringbuilder *sb, const char *format, ...) {
   va_list args;
   va_start(args, format);
-  va_list copyarg;
-  va_copy(copyarg, args);
-  int size = vsnprintf(NULL, 0, format, copyarg);
-  va_end(copyarg);
   size_t remaining_space = sb->size - sb->length;
-  if (remaining_space <= size) {
-    // Refactor to exactly the size we need:
-    sb_reserve(sb, sb->length + size + 1);
+  // one pass if it fits, the return value says how much was really needed
+  int size = vsnprintf(sb->data + sb->length, remaining_space, format, args);
+  va_end(args);
+  if (size < 0)
+    return false;
+  if ((size_t)size >= remaining_space) {
+    if (!sb_grow(sb, sb->length + size + 1))
+      return false;
+    va_start(args, format);
+    vsnprintf(sb->data + sb->length, sb->size - sb->length, format, args);
+    va_end(args);
   }
-  vsnprintf(sb->data + sb->length, sb->size - sb->length, format, args);
   sb->length += size;
-  va_end(args);
-  return 0;
+  return true;
+}
+
+static const char digit_pairs[201] = "00010203040506070809"
+                                     "10111213141516171819"
+                                     "20212223242526272829"
+                                     "30313233343536373839"
+                                     "40414243444546474849"
+                                     "50515253545556575859"
+                                     "60616263646566676869"
+                                     "70717273747576777879"
+                                     "80818283848586878889"
+                                     "90919293949596979899";
+static int count_digits(uint64_t value) {
+  int digits = 1;
+  while (value >= 10000) {
+    value /= 10000;
+    digits += 4;
+  }
+  if (value >= 1000)
+    return digits + 3;
+  if (value >= 100)
+    return digits + 2;
+  if (value >= 10)
+    return digits + 1;
+  return digits;
+}
+// writes the digits backwards so end is one past the last digit
+static void write_digits(char *end, uint64_t value) {
+  while (value >= 100) {
+    memcpy(end -= 2, digit_pairs + (value % 100) * 2, 2);
+    value /= 100;
+  }
+  if (value >= 10)
+    memcpy(end - 2, digit_pairs + value * 2, 2);
+  else
+    end[-1] = '0' + value;
+}
+// makes room for len more chars (plus '\0'), the caller fills them in
+static char *sb_extend(Stringbuilder *sb, size_t len) {
+  if (__builtin_expect(len >= sb->size - sb->length, 0)) {
+    if (!sb_grow(sb, sb->length + len + 1))
+      return NULL;
+  }
+  char *dest = sb->data + sb->length;
+  sb->length += len;
+  sb->data[sb->length] = '\0';
+  return dest;
+}
+bool sb_append_u64(Stringbuilder *sb, uint64_t value) {
+  int digits = count_digits(value);
+  char *dest = sb_extend(sb, digits);
+  if (dest == NULL)
+    return false;
+  write_digits(dest + digits, value);
+  return true;
+}
+bool sb_append_i64(Stringbuilder *sb, int64_t value) {
+  if (value >= 0)
+    return sb_append_u64(sb, value);
+  // negate in unsigned so INT64_MIN does not overflow
+  uint64_t magnitude = -(uint64_t)value;
+  int digits = count_digits(magnitude);
+  char *dest = sb_extend(sb, digits + 1);
+  if (dest == NULL)
+    return false;
+  dest[0] = '-';
+  write_digits(dest + 1 + digits, magnitude);
+  return true;
+}
+bool sb_append_hex(Stringbuilder *sb, uint64_t value) {
+  static const char hex_digits[] = "0123456789abcdef";
+  int digits = (64 - __builtin_clzll(value | 1) + 3) / 4;
+  char *dest = sb_extend(sb, digits);
+  if (dest == NULL)
+    return false;
+  for (int i = digits - 1; i >= 0; i--) {
+    dest[i] = hex_digits[value & 0xF];
+    value >>= 4;
+  }
+  return true;
+}
+/* shortest round trip, Ryu (Ulf Adams, PLDI 2018): the interval of reals
+ * that round to value is [mm, mp] around mv = 4 * mantissa, scaled by
+ * 10^-q with 128 bit powers of five (sb_double_table.h) so that vm, vr, vp
+ * are its bounds and midpoint in decimal. digits are dropped while vm and
+ * vp still differ in front of them, the rest is vr rounded. the
+ * *IsTrailingZeros flags track whether a bound is exact, only then it
+ * matters if it is inside (round half even, like strtod()) */
+static inline uint32_t pow5_bits(int32_t e) {
+  return (((uint32_t)e * 1217359) >> 19) + 1; // bit length of 5^e
+}
+static inline uint32_t log10_pow2(int32_t e) {
+  return ((uint32_t)e * 78913) >> 18;
+}
+static inline uint32_t log10_pow5(int32_t e) {
+  return ((uint32_t)e * 732923) >> 20;
+}
+static inline bool multiple_of_pow5(uint64_t value, uint32_t p) {
+  uint32_t count = 0;
+  while (value % 5 == 0 && count < p) {
+    value /= 5;
+    count++;
+  }
+  return count >= p;
+}
+static inline bool multiple_of_pow2(uint64_t value, uint32_t p) {
+  return (value & ((1ull << p) - 1)) == 0;
+}
+static inline uint64_t mul_shift(uint64_t m, const uint64_t *mul, int32_t j) {
+  unsigned __int128 low = (unsigned __int128)m * mul[0];
+  unsigned __int128 high = (unsigned __int128)m * mul[1];
+  return (uint64_t)(((low >> 64) + high) >> (j - 64));
+}
+// value = *digits * 10^*exponent with as few digits as possible, finite
+// and not zero
+static void shortest_digits(uint64_t bits, uint64_t *digits,
+                            int32_t *exponent) {
+  uint64_t mantissa = bits & ((1ull << 52) - 1);
+  uint32_t biased = (bits >> 52) & 0x7FF;
+  int32_t e2;
+  uint64_t m2;
+  if (biased == 0) { // subnormal
+    e2 = 1 - 1023 - 52 - 2;
+    m2 = mantissa;
+  } else {
+    e2 = (int32_t)biased - 1023 - 52 - 2;
+    m2 = (1ull << 52) | mantissa;
+  }
+  bool even = (m2 & 1) == 0; // bounds are inside on a tie
+  uint64_t mv = 4 * m2;
+  // the gap below a power of two is half the one above
+  uint32_t mm_shift = mantissa != 0 || biased <= 1;
+  uint64_t vr, vp, vm;
+  int32_t e10;
+  bool vm_zeros = false, vr_zeros = false;
+  if (e2 >= 0) {
+    uint32_t q = log10_pow2(e2) - (e2 > 3);
+    e10 = q;
+    int32_t k = SB_POW5_INV_BITS + pow5_bits(q) - 1;
+    int32_t i = -e2 + (int32_t)q + k;
+    vr = mul_shift(mv, sb_pow5_inv[q], i);
+    vp = mul_shift(mv + 2, sb_pow5_inv[q], i);
+    vm = mul_shift(mv - 1 - mm_shift, sb_pow5_inv[q], i);
+    if (q <= 21) {
+      // only one of mv, mp, mm can be a multiple of 5
+      if (mv % 5 == 0)
+        vr_zeros = multiple_of_pow5(mv, q);
+      else if (even)
+        vm_zeros = multiple_of_pow5(mv - 1 - mm_shift, q);
+      else
+        vp -= multiple_of_pow5(mv + 2, q);
+    }
+  } else {
+    uint32_t q = log10_pow5(-e2) - (-e2 > 1);
+    e10 = (int32_t)q + e2;
+    int32_t i = -e2 - (int32_t)q;
+    int32_t k = pow5_bits(i) - SB_POW5_BITS;
+    int32_t j = (int32_t)q - k;
+    vr = mul_shift(mv, sb_pow5[i], j);
+    vp = mul_shift(mv + 2, sb_pow5[i], j);
+    vm = mul_shift(mv - 1 - mm_shift, sb_pow5[i], j);
+    if (q <= 1) {
+      // mv has at least q trailing zero bits, so all three are exact
+      vr_zeros = true;
+      if (even)
+        vm_zeros = mm_shift == 1;
+      else
+        vp--;
+    } else if (q < 63) {
+      vr_zeros = multiple_of_pow2(mv, q);
+    }
+  }
+  int32_t removed = 0;
+  uint64_t output;
+  if (vm_zeros || vr_zeros) {
+    // rare: an exact bound or midpoint, every dropped digit is looked at
+    uint8_t last = 0;
+    while (vp / 10 > vm / 10) {
+      vm_zeros &= vm % 10 == 0;
+      vr_zeros &= last == 0;
+      last = vr % 10;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      removed++;
+    }
+    if (vm_zeros) {
+      while (vm % 10 == 0) {
+        vr_zeros &= last == 0;
+        last = vr % 10;
+        vr /= 10;
+        vp /= 10;
+        vm /= 10;
+        removed++;
+      }
+    }
+    if (vr_zeros && last == 5 && vr % 2 == 0)
+      last = 4; // exactly halfway: round to even
+    output = vr + ((vr == vm && (!even || !vm_zeros)) || last >= 5);
+  } else {
+    // no tie possible: only the first dropped digit decides the rounding.
+    // short decimals (prices) drop 10+ digits, four at a time first
+    bool round_up = false;
+    while (vp / 10000 > vm / 10000) {
+      round_up = vr % 10000 >= 5000;
+      vr /= 10000;
+      vp /= 10000;
+      vm /= 10000;
+      removed += 4;
+    }
+    if (vp / 100 > vm / 100) {
+      round_up = vr % 100 >= 50;
+      vr /= 100;
+      vp /= 100;
+      vm /= 100;
+      removed += 2;
+    }
+    while (vp / 10 > vm / 10) {
+      round_up = vr % 10 >= 5;
+      vr /= 10;
+      vp /= 10;
+      vm /= 10;
+      removed++;
+    }
+    output = vr + (vr == vm || round_up);
+  }
+  *digits = output;
+  *exponent = e10 + removed;
+}
+// short decimals (prices, stats...) without Ryu: m / 10^k with m < 2^53
+// is correctly rounded like strtod(), so if it is value the text "m with k
+// decimals" parses back to value, and the first k that works is the
+// shortest. cheaper than Ryu for them, a few ns more for everything else
+static bool short_decimal(double magnitude, uint64_t *m, int32_t *exponent) {
+  static const double powers_of_ten[] = {1e0, 1e1, 1e2, 1e3};
+  if (magnitude < 1e-3 || magnitude >= 1e12)
+    return false;
+  for (int k = 0; k < 4; k++) {
+    uint64_t scaled = (uint64_t)(magnitude * powers_of_ten[k] + 0.5);
+    if ((double)scaled / powers_of_ten[k] != magnitude)
+      continue;
+    *exponent = -k;
+    while (k == 0 && scaled % 10 == 0) { // whole numbers: 1200 is 12e2
+      scaled /= 10;
+      (*exponent)++;
+    }
+    *m = scaled;
+    return true;
+  }
+  return false;
+}
+// fixed notation like %g: from 1e-4 up, and for whole numbers with fewer
+// than 5 zeros behind the digits (1200, 1.2e+06); %g style exponent
+// otherwise
+bool sb_append_double(Stringbuilder *sb, double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  bool negative = bits >> 63;
+  if (((bits >> 52) & 0x7FF) == 0x7FF) {
+    if (bits << 12 != 0)
+      return sb_append_n(sb, "nan", 3);
+    return negative ? sb_append_n(sb, "-inf", 4) : sb_append_n(sb, "inf", 3);
+  }
+  if (bits << 1 == 0)
+    return negative ? sb_append_n(sb, "-0", 2) : sb_append_n(sb, "0", 1);
+  double magnitude = negative ? -value : value;
+  uint64_t m;
+  int32_t exponent;
+  if (!short_decimal(magnitude, &m, &exponent))
+    shortest_digits(bits, &m, &exponent);
+  int digits = count_digits(m);
+  int point = digits + exponent; // digits in front of the point
+  char *dest;
+  if (point > -4 && exponent < 5) {
+    if (exponent >= 0) { // 1200
+      dest = sb_extend(sb, negative + point);
+      if (dest == NULL)
+        return false;
+      dest += negative;
+      write_digits(dest + digits, m);
+      memset(dest + digits, '0', exponent);
+    } else if (point > 0) { // 12.5
+      dest = sb_extend(sb, negative + digits + 1);
+      if (dest == NULL)
+        return false;
+      dest += negative;
+      write_digits(dest + digits + 1, m);
+      memmove(dest, dest + 1, point);
+      dest[point] = '.';
+    } else { // 0.0125
+      dest = sb_extend(sb, negative + 2 - point + digits);
+      if (dest == NULL)
+        return false;
+      dest += negative;
+      memcpy(dest, "0.000", 2 - point);
+      write_digits(dest + 2 - point + digits, m);
+    }
+  } else { // 1.25e-07, first digit, point, the rest, e, sign, 2 or 3 digits
+    int e = point - 1;
+    uint32_t magnitude = e < 0 ? -e : e;
+    int e_digits = magnitude >= 100 ? 3 : 2;
+    dest = sb_extend(sb, negative + digits + (digits > 1) + 2 + e_digits);
+    if (dest == NULL)
+      return false;
+    dest += negative;
+    write_digits(dest + digits + 1, m);
+    dest[0] = dest[1];
+    if (digits > 1)
+      dest[1] = '.';
+    char *tail = dest + digits + (digits > 1);
+    tail[0] = 'e';
+    tail[1] = e < 0 ? '-' : '+';
+    if (e_digits == 3) {
+      tail[2] = '0' + magnitude / 100;
+      magnitude %= 100;
+    }
+    memcpy(tail + e_digits, digit_pairs + magnitude * 2, 2);
+  }
+  if (negative)
+    dest[-1] = '-';
+  return true;
 }
@@ -1,20 +1,59 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 
+// strings up to SB_INLINE_CAPACITY - 1 chars live inside the struct, no
+// buffer allocation at all. 32 keeps the whole struct one 64 byte cache line
+#define SB_INLINE_CAPACITY 32
+
+typedef struct Stringbuilder Stringbuilder;
+
+// where the struct (create_sb_with) and the heap buffer come from. NULL
+// means malloc/realloc/free. size is the size the block was allocated with,
+// so pools and arenas do not have to store it (see sb_allocator.h).
+// full is optional: called when an append does not fit, before the buffer
+// grows. it may hand the text on and empty sb (sb_sink.h does), the buffer
+// only grows if the append still does not fit. false fails the append
 typedef struct {
-  char *data;
+  void *(*alloc)(void *context, size_t size);
+  void *(*realloc)(void *context, void *ptr, size_t old_size,
+                   size_t new_size);
+  void (*free)(void *context, void *ptr, size_t size);
+  void *context;
+  bool (*full)(void *context, Stringbuilder *sb);
+} SbAllocator;
+
+struct Stringbuilder {
+  char *data; // points to inline_data while the string is small
   size_t length;
   size_t size;
-
-} Stringbuilder;
+  const SbAllocator *allocator;
+  char inline_data[SB_INLINE_CAPACITY];
+};
 
 Stringbuilder *create_sb(size_t size);
 void destroy_sb(Stringbuilder *sb);
+Stringbuilder *create_sb_with(size_t size, const SbAllocator *allocator);
+// for builders on the stack or embedded in other structs (zero allocations
+// for short strings). XXX: data may point into the struct, never copy it
+void sb_init(Stringbuilder *sb, size_t size);
+void sb_init_with(Stringbuilder *sb, size_t size,
+                  const SbAllocator *allocator);
+void sb_release(Stringbuilder *sb);
 bool append_sb(Stringbuilder *sb, const char *str);
+bool sb_append_n(Stringbuilder *sb, const char *str, size_t len);
+bool sb_append_char(Stringbuilder *sb, char c);
 bool insert_sb(Stringbuilder *sb, const char *str, size_t position);
 const char *get_string(Stringbuilder *sb);
 void clear_sb(Stringbuilder *sb);
 bool sb_reserve(Stringbuilder *sb, size_t new_capacity);
 void sb_shrink_to_fit(Stringbuilder *sb);
 bool sb_append_format(Stringbuilder *sb, const char *format, ...);
+// number appenders, written straight into the buffer without printf
+bool sb_append_u64(Stringbuilder *sb, uint64_t value);
+bool sb_append_i64(Stringbuilder *sb, int64_t value);
+bool sb_append_hex(Stringbuilder *sb, uint64_t value); // lowercase, no 0x
+// shortest text that strtod() turns back into exactly the same double,
+// laid out like %g: 1200, 0.0125, 1.5e-05, 1e+20; nan, inf, -inf
+bool sb_append_double(Stringbuilder *sb, double value);
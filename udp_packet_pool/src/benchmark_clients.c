@@ -0,0 +1,164 @@
+// client table lookups at 100K concurrent clients (half IPv4, half IPv6):
+// - admit: the receive path call (expire check, lookup, token bucket) for
+//   random known clients, the table is far bigger than the caches
+// - batch: the same through client_admit_batch() 32 packets at a time, as
+//   the recvmmsg loops call it
+// - churn: a new client per packet while old ones idle out of the wheel
+// - string: the same lookups through the string keyed hash_table
+//   (inet_ntop + port as the key), what a table without binary keys costs
+// usage: benchmark_clients [clients (default 100000)] [lookups (10000000)]
+#include "../../bench/bench.h"
+#include "client_table.h"
+#include "../../hash_table/hash_table.h"
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t xorshift(void) {
+  return bench_random(&rng_state);
+}
+static void make_address(struct sockaddr_storage *addr, socklen_t *len,
+                         uint64_t id) {
+  memset(addr, 0, sizeof(*addr));
+  if (id % 2) {
+    struct sockaddr_in *in = (struct sockaddr_in *)addr;
+    in->sin_family = AF_INET;
+    in->sin_addr.s_addr = htonl(0x0a000000 + (uint32_t)(id / 2 / 64));
+    in->sin_port = htons(1024 + id / 2 % 64);
+    *len = sizeof(*in);
+  } else {
+    struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)addr;
+    in6->sin6_family = AF_INET6;
+    in6->sin6_addr.s6_addr[0] = 0x20;
+    in6->sin6_addr.s6_addr[1] = 0x01;
+    memcpy(&in6->sin6_addr.s6_addr[8], &id, sizeof(id));
+    in6->sin6_port = htons(4000);
+    *len = sizeof(*in6);
+  }
+}
+static void address_string(char *out, size_t size,
+                           const struct sockaddr_storage *addr) {
+  char ip[INET6_ADDRSTRLEN];
+  if (addr->ss_family == AF_INET) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    inet_ntop(AF_INET, &in->sin_addr, ip, sizeof(ip));
+    snprintf(out, size, "%s:%u", ip, ntohs(in->sin_port));
+  } else {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+    inet_ntop(AF_INET6, &in6->sin6_addr, ip, sizeof(ip));
+    snprintf(out, size, "[%s]:%u", ip, ntohs(in6->sin6_port));
+  }
+}
+
+int main(int argc, char **argv) {
+  uint32_t clients = argc > 1 ? strtoul(argv[1], NULL, 10) : 100000;
+  long lookups = argc > 2 ? atol(argv[2]) : 10000000;
+  struct sockaddr_storage *addrs = malloc(clients * sizeof(*addrs));
+  socklen_t *lens = malloc(clients * sizeof(*lens));
+  uint32_t *order = malloc(lookups * sizeof(*order));
+  for (uint32_t i = 0; i < clients; i++)
+    make_address(&addrs[i], &lens[i], i);
+  for (long i = 0; i < lookups; i++)
+    order[i] = xorshift() % clients;
+
+  // 1000 packets/s each with bursts of 100: random access never hits it
+  uint64_t idle = 10 * 1000000000ull;
+  client_table *table = client_table_create(clients, 1000, 100, idle);
+  uint64_t now = 1000000000ull;
+  double start = bench_now_seconds();
+  for (uint32_t i = 0; i < clients; i++)
+    client_admit(table, (struct sockaddr *)&addrs[i], lens[i], 64, now);
+  double elapsed = bench_now_seconds() - start;
+  printf("insert %u clients: %.1f ns/client\n", clients,
+         elapsed * 1e9 / clients);
+
+  // the address is built in place as recvmmsg would have written it, the
+  // addrs array would add a cache miss of its own
+  long admitted = 0;
+  start = bench_now_seconds();
+  for (long i = 0; i < lookups; i++) {
+    now += 100; // 10M packets/s of simulated time
+    struct sockaddr_storage addr;
+    socklen_t len;
+    make_address(&addr, &len, order[i]);
+    admitted +=
+        client_admit(table, (struct sockaddr *)&addr, len, 64, now) != NULL;
+  }
+  elapsed = bench_now_seconds() - start;
+  printf("admit, %u clients: %.1f ns/packet, %.1f M packets/s (%ld "
+         "admitted, %u in table)\n",
+         clients, elapsed * 1e9 / lookups, lookups / elapsed / 1e6, admitted,
+         table->count);
+
+  admitted = 0;
+  start = bench_now_seconds();
+  for (long i = 0; i + 32 <= lookups; i += 32) {
+    struct sockaddr_storage addrs_batch[32];
+    const struct sockaddr *addr_ptrs[32];
+    socklen_t addr_lens[32];
+    size_t lengths[32];
+    client_entry *ok[32];
+    for (int j = 0; j < 32; j++) {
+      make_address(&addrs_batch[j], &addr_lens[j], order[i + j]);
+      addr_ptrs[j] = (struct sockaddr *)&addrs_batch[j];
+      lengths[j] = 64;
+    }
+    now += 3200;
+    client_admit_batch(table, addr_ptrs, addr_lens, lengths, 32, now, ok);
+    for (int j = 0; j < 32; j++)
+      admitted += ok[j] != NULL;
+  }
+  elapsed = bench_now_seconds() - start;
+  printf("batch, %u clients: %.1f ns/packet, %.1f M packets/s (%ld "
+         "admitted)\n",
+         clients, elapsed * 1e9 / lookups, lookups / elapsed / 1e6,
+         admitted);
+
+  // every packet a client not seen for longer than idle: lookup misses,
+  // inserts, and the wheel evicts the old entries as time moves on
+  uint64_t churn_step = idle / clients + 1;
+  uint64_t id = clients;
+  size_t evicted_before = table->evicted;
+  start = bench_now_seconds();
+  for (long i = 0; i < lookups / 4; i++) {
+    now += churn_step;
+    struct sockaddr_storage addr;
+    socklen_t len;
+    make_address(&addr, &len, id++);
+    client_admit(table, (struct sockaddr *)&addr, len, 64, now);
+  }
+  elapsed = bench_now_seconds() - start;
+  printf("churn: %.1f ns/packet (%zu evicted, %u in table)\n",
+         elapsed * 1e9 / (lookups / 4), table->evicted - evicted_before,
+         table->count);
+  client_table_destroy(table);
+
+  ht *strings = hash_create();
+  char key[64];
+  for (uint32_t i = 0; i < clients; i++) {
+    address_string(key, sizeof(key), &addrs[i]);
+    // the table frees its values
+    uint32_t *value = malloc(sizeof(uint32_t));
+    *value = i;
+    hash_insert(strings, (ht_entry){key, value});
+  }
+  long found = 0;
+  start = bench_now_seconds();
+  for (long i = 0; i < lookups; i++) {
+    struct sockaddr_storage addr;
+    socklen_t len;
+    make_address(&addr, &len, order[i]);
+    address_string(key, sizeof(key), &addr);
+    found += hash_get(strings, key) != NULL;
+  }
+  elapsed = bench_now_seconds() - start;
+  printf("string keys: %.1f ns/packet, %.1f M packets/s (%ld found)\n",
+         elapsed * 1e9 / lookups, lookups / elapsed / 1e6, found);
+  hash_destroy(strings);
+  free(addrs);
+  free(lens);
+  free(order);
+  return 0;
+}
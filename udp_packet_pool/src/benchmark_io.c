@@ -0,0 +1,115 @@
+// echo throughput and syscalls per packet on loopback: the blocking
+// recvfrom/sendto loop, the recvmmsg/sendmmsg loop and the io_uring loop.
+// the server runs in a thread, the client keeps WINDOW packets in flight
+// with sendmmsg/recvmmsg so every backend sees the same load.
+// usage: benchmark_io [packets (default 200000)] [payload bytes (64)]
+#define _GNU_SOURCE
+#include "../../bench/bench.h"
+#include "packet.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define PORT "18888"
+#define WINDOW 32
+
+typedef struct {
+  const char *name;
+  int mode; // 0 blocking, 1 batched, 2 uring
+  int socketfd;
+  io_counters counters;
+  bool ok;
+} server_run;
+
+static void *server_thread(void *arg) {
+  server_run *run = arg;
+  run->ok = true;
+  if (run->mode == 0)
+    server_loop(run->socketfd, &run->counters);
+  else if (run->mode == 1)
+    server_loop_batched(run->socketfd, &run->counters);
+  else
+    run->ok = server_loop_uring(run->socketfd, &run->counters);
+  return NULL;
+}
+
+static void run_client(server_run *run, long packets, size_t payload) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in server = {.sin_family = AF_INET,
+                               .sin_port = htons(atoi(PORT))};
+  inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+  connect(fd, (struct sockaddr *)&server, sizeof(server));
+  // lost packets (full socket buffers) must not hang the benchmark
+  struct timeval timeout = {0, 200000};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  static uint8_t out[WINDOW][PACKET_SIZE], in[WINDOW][PACKET_SIZE];
+  struct mmsghdr send_msgs[WINDOW], recv_msgs[WINDOW];
+  struct iovec send_iov[WINDOW], recv_iov[WINDOW];
+  memset(send_msgs, 0, sizeof(send_msgs));
+  memset(recv_msgs, 0, sizeof(recv_msgs));
+  for (int i = 0; i < WINDOW; i++) {
+    memset(out[i], 'a' + i % 26, payload);
+    send_iov[i] = (struct iovec){out[i], payload};
+    recv_iov[i] = (struct iovec){in[i], PACKET_SIZE};
+    send_msgs[i].msg_hdr.msg_iov = &send_iov[i];
+    send_msgs[i].msg_hdr.msg_iovlen = 1;
+    recv_msgs[i].msg_hdr.msg_iov = &recv_iov[i];
+    recv_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  pthread_t tid;
+  run->counters = (io_counters){0};
+  pthread_create(&tid, NULL, server_thread, run);
+  usleep(20000);
+
+  long received = 0, lost = 0;
+  double start = bench_now_seconds();
+  while (received + lost < packets) {
+    long want = packets - received - lost < WINDOW ? packets - received - lost
+                                                   : WINDOW;
+    sendmmsg(fd, send_msgs, want, 0);
+    long got = 0;
+    while (got < want) {
+      int n = recvmmsg(fd, recv_msgs, want - got, MSG_WAITFORONE, NULL);
+      if (n == -1) {
+        lost += want - got; // timed out
+        break;
+      }
+      got += n;
+    }
+    received += got;
+  }
+  double elapsed = bench_now_seconds() - start;
+
+  server_stop();
+  send(fd, "x", 1, 0); // wakes a blocking recv
+  pthread_join(tid, NULL);
+  close(fd);
+  if (!run->ok) {
+    printf("%-10s not available: %s\n", run->name, strerror(errno));
+    return;
+  }
+  printf("%-10s %8.0f packets/s  %6.3f server syscalls/packet  %ld lost\n",
+         run->name, received / elapsed,
+         (double)run->counters.syscalls / run->counters.packets, lost);
+}
+
+int main(int argc, char **argv) {
+  long packets = argc > 1 ? atol(argv[1]) : 200000;
+  size_t payload = argc > 2 ? strtoul(argv[2], NULL, 10) : 64;
+  if (payload == 0 || payload > PACKET_SIZE)
+    payload = 64;
+  server_run runs[] = {{"blocking", 0, 0, {0}, false},
+                       {"batched", 1, 0, {0}, false},
+                       {"io_uring", 2, 0, {0}, false}};
+  for (int i = 0; i < 3; i++) {
+    runs[i].socketfd = create_udp_socket(PORT);
+    run_client(&runs[i], packets, payload);
+    close(runs[i].socketfd);
+  }
+  return 0;
+}
@@ -0,0 +1,114 @@
+// echo through the staged pipeline with a simulated per-packet cost, for
+// 1/2/4 workers. CLIENTS sockets (the receiver hashes clients to workers)
+// keep WINDOW packets in flight together, more than one worker ring batch,
+// so the queue depths and drops show which stage limits.
+// usage: benchmark_pipeline [packets (default 100000)]
+#define _GNU_SOURCE
+#include "../../bench/bench.h"
+#include "pipeline.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#define PORT "18889"
+#define WINDOW 256
+#define CLIENT_BATCH 32
+#define CLIENTS 8
+
+// spins for *arg nanoseconds, stands in for real packet processing
+static void busy_handler(PacketBuffer *packet, void *arg) {
+  (void)packet;
+  double until = bench_now_seconds() + *(long *)arg / 1e9;
+  while (bench_now_seconds() < until)
+    ;
+}
+
+static void run(int workers, long work_ns, long packets) {
+  int server_socket = create_udp_socket(PORT);
+  pipeline *p = pipeline_start(server_socket, workers,
+                               work_ns > 0 ? busy_handler : NULL, &work_ns);
+  struct sockaddr_in server = {.sin_family = AF_INET,
+                               .sin_port = htons(atoi(PORT))};
+  inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+  struct pollfd fds[CLIENTS];
+  long in_flight[CLIENTS] = {0};
+  for (int c = 0; c < CLIENTS; c++) {
+    fds[c] = (struct pollfd){socket(AF_INET, SOCK_DGRAM, 0), POLLIN, 0};
+    connect(fds[c].fd, (struct sockaddr *)&server, sizeof(server));
+    // the default buffer holds less than WINDOW echoes of small packets
+    int rcvbuf = 4 << 20;
+    setsockopt(fds[c].fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+  }
+  static uint8_t out[64], in[CLIENT_BATCH][PACKET_SIZE];
+  memset(out, 'p', sizeof(out));
+  struct mmsghdr send_msgs[CLIENT_BATCH], recv_msgs[CLIENT_BATCH];
+  struct iovec send_iov = {out, sizeof(out)}, recv_iov[CLIENT_BATCH];
+  memset(send_msgs, 0, sizeof(send_msgs));
+  memset(recv_msgs, 0, sizeof(recv_msgs));
+  for (int i = 0; i < CLIENT_BATCH; i++) {
+    send_msgs[i].msg_hdr.msg_iov = &send_iov;
+    send_msgs[i].msg_hdr.msg_iovlen = 1;
+    recv_iov[i] = (struct iovec){in[i], PACKET_SIZE};
+    recv_msgs[i].msg_hdr.msg_iov = &recv_iov[i];
+    recv_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  long sent = 0, received = 0, lost = 0;
+  double start = bench_now_seconds();
+  while (received + lost < packets) {
+    // top every client's share of the window up, then take what came back
+    for (int c = 0; c < CLIENTS; c++) {
+      while (sent < packets && in_flight[c] < WINDOW / CLIENTS) {
+        long n = WINDOW / CLIENTS - in_flight[c];
+        if (n > CLIENT_BATCH)
+          n = CLIENT_BATCH;
+        if (n > packets - sent)
+          n = packets - sent;
+        int r = sendmmsg(fds[c].fd, send_msgs, n, 0);
+        if (r <= 0)
+          break;
+        sent += r;
+        in_flight[c] += r;
+      }
+    }
+    if (poll(fds, CLIENTS, 200) <= 0) {
+      lost = sent - received; // timed out: the rest is gone
+      memset(in_flight, 0, sizeof(in_flight));
+      continue;
+    }
+    for (int c = 0; c < CLIENTS; c++) {
+      if (!(fds[c].revents & POLLIN))
+        continue;
+      int r = recvmmsg(fds[c].fd, recv_msgs, CLIENT_BATCH, MSG_DONTWAIT, NULL);
+      if (r > 0) {
+        received += r;
+        in_flight[c] -= r;
+      }
+    }
+  }
+  double elapsed = bench_now_seconds() - start;
+
+  pipeline_stats stats;
+  pipeline_read_stats(p, &stats);
+  pipeline_stop(p);
+  for (int c = 0; c < CLIENTS; c++)
+    close(fds[c].fd);
+  close(server_socket);
+  printf("%d workers, %ld ns/packet: %.0f packets/s, %ld lost\n", workers,
+         work_ns, received / elapsed, lost);
+  pipeline_print_stats(stdout, &stats);
+}
+
+int main(int argc, char **argv) {
+  long packets = argc > 1 ? atol(argv[1]) : 100000;
+  long costs[] = {0, 2000};
+  int workers[] = {1, 2, 4};
+  for (int c = 0; c < 2; c++)
+    for (int w = 0; w < 3; w++)
+      run(workers[w], costs[c], packets);
+  return 0;
+}
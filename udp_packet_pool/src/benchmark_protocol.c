@@ -0,0 +1,136 @@
+// cost of the framed protocol per packet at 64, 512 and 1400 byte payloads,
+// over a few hundred packets that stay in the cache (the checksum, not the
+// memory, is what is measured):
+// - crc 1 stream: one crc32 chain like ht_hash_crc32c, the latency bound
+//   baseline
+// - crc32c: the three stream crc32c() of protocol.c
+// - parse: proto_parse(), header checks + checksum
+// - copy: memcpy of the datagram, what recv costs at least
+// - copy+handle: copy, then proto_handle() with a duplicate window (checks,
+//   window, echo reply with its header checksum)
+// usage: benchmark_protocol [packets per size (default 2000000)]
+#include "../../bench/bench.h"
+#include "packet.h"
+#include "protocol.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#define PACKETS 256
+// results go here so the loops are not optimized away
+static volatile uint64_t sink;
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t xorshift(void) {
+  return bench_random(&rng_state);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t
+crc_one_stream(const uint8_t *p, size_t length) {
+  uint64_t crc = ~0u;
+  for (; length >= 8; length -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc = _mm_crc32_u64(crc, v);
+  }
+  uint32_t crc32 = (uint32_t)crc;
+  for (; length > 0; length--)
+    crc32 = _mm_crc32_u8(crc32, *p++);
+  return ~crc32;
+}
+#endif
+
+static void report(const char *name, size_t payload, long packets,
+                   double elapsed) {
+  printf("%-12s %4zu B: %6.1f ns/packet, %6.2f GB/s of payload\n", name,
+         payload, elapsed * 1e9 / packets,
+         (double)packets * payload / elapsed / 1e9);
+}
+
+int main(int argc, char **argv) {
+  long packets = argc > 1 ? atol(argv[1]) : 2000000;
+  // "123456789" is the check value of every CRC catalogue
+  if (crc32c(0, "123456789", 9) != 0xE3069283) {
+    fprintf(stderr, "crc32c: wrong check value\n");
+    return 1;
+  }
+  PacketBuffer *buffers = aligned_alloc(64, PACKETS * sizeof(PacketBuffer));
+  uint8_t(*templates)[PACKET_SIZE] = malloc(PACKETS * PACKET_SIZE);
+  size_t lengths[PACKETS];
+  const size_t payloads[] = {64, 512, 1400};
+  for (size_t s = 0; s < sizeof(payloads) / sizeof(payloads[0]); s++) {
+    size_t payload = payloads[s];
+    for (int i = 0; i < PACKETS; i++) {
+      uint8_t *data = templates[i];
+      for (size_t j = 0; j < payload; j++)
+        data[sizeof(proto_header) + j] = (uint8_t)xorshift();
+      lengths[i] = proto_finish(data, PROTO_ECHO, i, payload);
+      memcpy(buffers[i].data, data, lengths[i]);
+    }
+    uint64_t sum = 0;
+    double start;
+#if defined(__x86_64__)
+    if (__builtin_cpu_supports("sse4.2")) {
+      start = bench_now_seconds();
+      for (long n = 0; n < packets; n++)
+        sum += crc_one_stream(buffers[n % PACKETS].data,
+                              lengths[n % PACKETS]);
+      report("crc 1 stream", payload, packets, bench_now_seconds() - start);
+    }
+#endif
+    start = bench_now_seconds();
+    for (long n = 0; n < packets; n++)
+      sum += crc32c(0, buffers[n % PACKETS].data, lengths[n % PACKETS]);
+    report("crc32c", payload, packets, bench_now_seconds() - start);
+
+    long valid = 0;
+    start = bench_now_seconds();
+    for (long n = 0; n < packets; n++) {
+      proto_status status;
+      valid += proto_parse(buffers[n % PACKETS].data, lengths[n % PACKETS],
+                           &status) != NULL;
+    }
+    report("parse", payload, packets, bench_now_seconds() - start);
+    if (valid != packets) {
+      fprintf(stderr, "parse: %ld of %ld packets valid\n", valid, packets);
+      return 1;
+    }
+
+    start = bench_now_seconds();
+    for (long n = 0; n < packets; n++) {
+      int i = n % PACKETS;
+      memcpy(buffers[i].data, templates[i], lengths[i]);
+      sum += buffers[i].data[lengths[i] - 1];
+    }
+    report("copy", payload, packets, bench_now_seconds() - start);
+    sink = sum;
+
+    // packet i has sequence number i: a fresh window every round so the
+    // numbers are new again
+    proto_peer peer = {0};
+    long handled = 0;
+    start = bench_now_seconds();
+    for (long n = 0; n < packets; n++) {
+      int i = n % PACKETS;
+      if (i == 0)
+        peer.seq_window = 0;
+      memcpy(buffers[i].data, templates[i], lengths[i]);
+      size_t length = lengths[i];
+      proto_status status;
+      handled += proto_handle(buffers[i].data, &length, PACKET_SIZE, &peer,
+                              &status);
+    }
+    report("copy+handle", payload, packets, bench_now_seconds() - start);
+    if (handled != packets) {
+      fprintf(stderr, "handle: %ld of %ld packets answered\n", handled,
+              packets);
+      return 1;
+    }
+  }
+  free(templates);
+  free(buffers);
+  return 0;
+}
@@ -0,0 +1,128 @@
+// reliable stream (reliable.h) against the framed server on loopback with
+// a drop shim in the client: every datagram out (first transmissions and
+// retransmissions) and every ack in is lost with the same probability.
+// per loss rate one fresh stream delivers the same number of packets:
+// goodput (payload the receiver has), how many packets went on the wire
+// for it, and the delivery latency from first transmission to ack.
+// the server is server_loop_batched() in a thread, --framed with a client
+// table as main runs it.
+// usage: benchmark_reliable [packets (default 50000)] [payload bytes (512)]
+#define _GNU_SOURCE
+#include "../../bench/bench.h"
+#include "packet.h"
+#include "reliable.h"
+#include "server.h"
+#include <arpa/inet.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#define PORT "18889"
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t xorshift(void) {
+  return bench_random(&rng_state);
+}
+// the drop shim
+static bool lose(double loss) {
+  return (xorshift() >> 11) * (1.0 / 9007199254740992.0) < loss;
+}
+
+static void *server_thread(void *arg) {
+  io_counters counters = {0};
+  server_loop_batched(*(int *)arg, &counters);
+  return NULL;
+}
+
+static void transmit(int fd, PacketBuffer *pb, double loss, long *wire) {
+  (*wire)++;
+  if (!lose(loss))
+    send(fd, pb->data, pb->length, 0);
+}
+
+static void run(double loss, long packets, size_t payload) {
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in server = {.sin_family = AF_INET,
+                               .sin_port = htons(atoi(PORT))};
+  inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+  connect(fd, (struct sockaddr *)&server, sizeof(server));
+  rel_sender *s = rel_sender_create();
+  uint8_t data[PACKET_SIZE];
+  memset(data, 'r', payload);
+  _Alignas(8) uint8_t in[PACKET_SIZE];
+  PacketBuffer *again[REL_RING];
+  long queued = 0, wire = 0;
+  double start = bench_now_seconds();
+  while ((long)s->delivered < packets) {
+    uint64_t now = stats_now_ns();
+    PacketBuffer *pb;
+    while (queued < packets && (pb = rel_send(s, data, payload, now))) {
+      transmit(fd, pb, loss, &wire);
+      queued++;
+    }
+    int n = rel_poll(s, now, again, REL_RING);
+    for (int i = 0; i < n; i++)
+      transmit(fd, again[i], loss, &wire);
+    bool acked = false;
+    ssize_t got;
+    while ((got = recv(fd, in, sizeof(in), MSG_DONTWAIT)) > 0) {
+      if (!lose(loss))
+        rel_on_ack(s, in, got, stats_now_ns());
+      acked = true;
+    }
+    // nothing came back: wait for an ack or the next timer tick
+    uint64_t timer = rel_next_timer(s);
+    now = stats_now_ns();
+    if (!acked && timer > now) {
+      struct pollfd pfd = {.fd = fd, .events = POLLIN};
+      struct timespec timeout = {0, timer - now};
+      ppoll(&pfd, 1, &timeout, NULL);
+    }
+  }
+  double elapsed = bench_now_seconds() - start;
+  const histogram *h = &s->latency;
+  printf("loss %4.1f%%: goodput %7.1f MB/s %8.0f packets/s, %.3f sent per "
+         "packet, %lu fast retransmits, %lu timeouts, latency us p50 %.1f "
+         "p99 %.1f p99.9 %.1f max %.1f\n",
+         loss * 100, s->delivered_bytes / elapsed / 1e6,
+         s->delivered / elapsed, (double)wire / packets,
+         (unsigned long)s->fast_retransmits, (unsigned long)s->timeouts,
+         histogram_percentile(h, 50) / 1e3, histogram_percentile(h, 99) / 1e3,
+         histogram_percentile(h, 99.9) / 1e3, h->max / 1e3);
+  rel_sender_destroy(s);
+  close(fd);
+}
+
+int main(int argc, char **argv) {
+  long packets = argc > 1 ? atol(argv[1]) : 50000;
+  size_t payload = argc > 2 ? strtoul(argv[2], NULL, 10) : 512;
+  if (payload == 0 || payload > PACKET_SIZE - sizeof(proto_header))
+    payload = 512;
+  // new client sockets every run: fresh ports, fresh streams at 0
+  client_table *clients = client_table_create(64, 0, 0, 60 * 1000000000ull);
+  server_set_clients(clients);
+  server_set_framed(true);
+  int socketfd = create_udp_socket(PORT);
+  pthread_t tid;
+  pthread_create(&tid, NULL, server_thread, &socketfd);
+  usleep(20000);
+  const double losses[] = {0, 0.01, 0.02, 0.05, 0.10};
+  for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++)
+    run(losses[i], packets, payload);
+
+  server_stop();
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in server = {.sin_family = AF_INET,
+                               .sin_port = htons(atoi(PORT))};
+  inet_pton(AF_INET, "127.0.0.1", &server.sin_addr);
+  sendto(fd, "x", 1, 0, (struct sockaddr *)&server, sizeof(server));
+  pthread_join(tid, NULL);
+  close(fd);
+  close(socketfd);
+  client_table_destroy(clients);
+  return 0;
+}
@@ -0,0 +1,256 @@
+#include "client_table.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdlib.h>
+#include <string.h>
+
+// multiply to 128 bit and fold, as ht_hash_wy (hash_table/hash_functions.c)
+// but for exactly three words
+static inline uint64_t mum(uint64_t a, uint64_t b) {
+  __uint128_t r = (__uint128_t)a * b;
+  return (uint64_t)r ^ (uint64_t)(r >> 64);
+}
+static inline uint64_t key_hash(const client_key *key) {
+  const uint64_t s0 = 0xa0761d6478bd642fULL;
+  const uint64_t s1 = 0xe7037ed1a0b428dbULL;
+  const uint64_t s2 = 0x8ebc6af09c88c6e3ULL;
+  return mum(mum(key->words[0] ^ s0, key->words[1] ^ s1) ^ key->words[2],
+             s2);
+}
+static inline bool key_equal(const client_key *a, const client_key *b) {
+  return ((a->words[0] ^ b->words[0]) | (a->words[1] ^ b->words[1]) |
+          (a->words[2] ^ b->words[2])) == 0;
+}
+
+bool client_key_from(client_key *key, const struct sockaddr *addr,
+                     socklen_t addr_len) {
+  uint8_t ip[16];
+  uint16_t port;
+  if (addr->sa_family == AF_INET6 &&
+      addr_len >= sizeof(struct sockaddr_in6)) {
+    const struct sockaddr_in6 *in6 = (const struct sockaddr_in6 *)addr;
+    memcpy(ip, &in6->sin6_addr, 16);
+    port = in6->sin6_port;
+  } else if (addr->sa_family == AF_INET &&
+             addr_len >= sizeof(struct sockaddr_in)) {
+    // the same client over a v4 or a dual stack v6 socket, the same key
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    memset(ip, 0, 10);
+    ip[10] = ip[11] = 0xff;
+    memcpy(ip + 12, &in->sin_addr, 4);
+    port = in->sin_port;
+  } else {
+    return false;
+  }
+  memcpy(&key->words[0], ip, 8);
+  memcpy(&key->words[1], ip + 8, 8);
+  key->words[2] = port;
+  return true;
+}
+
+uint64_t client_key_hash(const client_key *key) { return key_hash(key); }
+
+client_table *client_table_create(uint32_t max_clients, uint32_t rate,
+                                  uint32_t burst, uint64_t idle_ns) {
+  if (max_clients == 0 || max_clients > (1u << 30)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  client_table *table = calloc(1, sizeof(client_table));
+  if (table == NULL)
+    return NULL;
+  // at most half full, linear probing stays short
+  uint32_t size = 16;
+  while (size < 2 * max_clients)
+    size <<= 1;
+  table->slots = calloc(size, sizeof(uint64_t));
+  table->pool = freelist_pool_create(sizeof(client_entry), max_clients);
+  if (table->slots == NULL || table->pool == NULL) {
+    if (table->pool != NULL)
+      freelist_pool_destroy(table->pool);
+    free(table->slots);
+    free(table);
+    return NULL;
+  }
+  table->entries = table->pool->memory;
+  table->mask = size - 1;
+  table->max_clients = max_clients;
+  table->interval_ns = rate > 0 ? 1000000000ull / rate : 0;
+  table->burst_ns = (burst > 0 ? burst : 1) * table->interval_ns;
+  table->idle_ns = idle_ns > 0 ? idle_ns : 1;
+  // the whole idle time fits in one turn of the wheel
+  table->tick_ns = table->idle_ns / (CLIENT_WHEEL_SLOTS - 1) + 1;
+  return table;
+}
+void client_table_destroy(client_table *table) {
+  if (table == NULL)
+    return;
+  freelist_pool_destroy(table->pool);
+  free(table->slots);
+  free(table);
+}
+
+static void wheel_insert(client_table *table, client_entry *entry) {
+  uint64_t tick = (entry->last_ns + table->idle_ns) / table->tick_ns;
+  // never behind the cursor, it would wait a whole turn
+  if (tick < table->next_tick)
+    tick = table->next_tick;
+  client_entry **slot = &table->wheel[tick & (CLIENT_WHEEL_SLOTS - 1)];
+  entry->wheel_next = *slot;
+  *slot = entry;
+}
+
+static client_entry *lookup_hashed(client_table *table, const client_key *key,
+                                   uint64_t hash, uint64_t now_ns) {
+  uint64_t tag = hash >> 32 << 32;
+  for (uint32_t i = hash & table->mask;; i = (i + 1) & table->mask) {
+    uint64_t slot = table->slots[i];
+    if (slot == 0) {
+      // not there: insert at the first empty slot of the probe
+      client_entry *entry = freelist_pool_alloc(table->pool);
+      if (entry == NULL)
+        return NULL;
+      memset(entry, 0, sizeof(*entry));
+      entry->key = *key;
+      entry->hash = hash;
+      entry->last_ns = now_ns;
+      entry->credit_ns = table->burst_ns;
+      table->slots[i] = tag | (uint64_t)(entry - table->entries + 1);
+      table->count++;
+      wheel_insert(table, entry);
+      return entry;
+    }
+    if ((slot & 0xffffffff00000000ull) == tag) {
+      client_entry *entry = &table->entries[(uint32_t)slot - 1];
+      if (key_equal(&entry->key, key))
+        return entry;
+    }
+  }
+}
+
+client_entry *client_lookup(client_table *table, const client_key *key,
+                            uint64_t now_ns) {
+  return lookup_hashed(table, key, key_hash(key), now_ns);
+}
+
+// backward shift deletion: no tombstones, later entries of the same probe
+// run move up so every lookup still finds them
+static void table_remove(client_table *table, client_entry *entry) {
+  uint64_t want = (uint64_t)(entry - table->entries + 1);
+  uint32_t hole = entry->hash & table->mask;
+  while ((uint32_t)table->slots[hole] != want)
+    hole = (hole + 1) & table->mask;
+  for (uint32_t i = (hole + 1) & table->mask;; i = (i + 1) & table->mask) {
+    uint64_t slot = table->slots[i];
+    if (slot == 0)
+      break;
+    uint32_t home = table->entries[(uint32_t)slot - 1].hash & table->mask;
+    // moves into the hole unless its home lies (cyclically) in (hole, i]
+    if (((i - home) & table->mask) >= ((i - hole) & table->mask)) {
+      table->slots[hole] = slot;
+      hole = i;
+    }
+  }
+  table->slots[hole] = 0;
+  table->count--;
+  freelist_pool_free(table->pool, entry);
+}
+
+size_t client_table_expire(client_table *table, uint64_t now_ns) {
+  uint64_t now_tick = now_ns / table->tick_ns;
+  if (table->next_tick == 0)
+    table->next_tick = now_tick; // first call
+  if (now_tick < table->next_tick) {
+    table->next_tick_ns = table->next_tick * table->tick_ns;
+    return 0;
+  }
+  // a jump of more than one turn visits every slot once
+  if (now_tick - table->next_tick > CLIENT_WHEEL_SLOTS)
+    table->next_tick = now_tick - CLIENT_WHEEL_SLOTS;
+  size_t evicted = 0;
+  while (table->next_tick <= now_tick) {
+    client_entry **slot =
+        &table->wheel[table->next_tick & (CLIENT_WHEEL_SLOTS - 1)];
+    client_entry *list = *slot;
+    *slot = NULL;
+    table->next_tick++;
+    while (list != NULL) {
+      client_entry *entry = list;
+      list = entry->wheel_next;
+      if (entry->last_ns + table->idle_ns <= now_ns) {
+        table_remove(table, entry);
+        evicted++;
+      } else {
+        wheel_insert(table, entry); // was active, expires later
+      }
+    }
+  }
+  table->evicted += evicted;
+  table->next_tick_ns = table->next_tick * table->tick_ns;
+  return evicted;
+}
+
+// token bucket of one packet
+static bool admit_entry(client_table *table, client_entry *entry,
+                        size_t bytes, uint64_t now_ns) {
+  uint64_t credit = entry->credit_ns;
+  if (now_ns > entry->last_ns)
+    credit += now_ns - entry->last_ns;
+  if (credit > table->burst_ns)
+    credit = table->burst_ns;
+  entry->last_ns = now_ns;
+  if (credit < table->interval_ns) {
+    entry->credit_ns = credit;
+    entry->throttled++;
+    return false;
+  }
+  entry->credit_ns = credit - table->interval_ns;
+  entry->packets++;
+  entry->bytes += bytes;
+  return true;
+}
+
+client_entry *client_admit(client_table *table, const struct sockaddr *addr,
+                           socklen_t addr_len, size_t bytes, uint64_t now_ns) {
+  if (now_ns >= table->next_tick_ns)
+    client_table_expire(table, now_ns);
+  client_key key;
+  if (!client_key_from(&key, addr, addr_len))
+    return NULL;
+  client_entry *entry = lookup_hashed(table, &key, key_hash(&key), now_ns);
+  if (entry == NULL || !admit_entry(table, entry, bytes, now_ns))
+    return NULL;
+  return entry;
+}
+
+void client_admit_batch(client_table *table,
+                        const struct sockaddr *const *addrs,
+                        const socklen_t *addr_lens, const size_t *bytes,
+                        int n, uint64_t now_ns, client_entry **admitted) {
+  if (now_ns >= table->next_tick_ns)
+    client_table_expire(table, now_ns);
+  client_key keys[CLIENT_ADMIT_BATCH];
+  uint64_t hashes[CLIENT_ADMIT_BATCH];
+  bool valid[CLIENT_ADMIT_BATCH];
+  if (n > CLIENT_ADMIT_BATCH)
+    n = CLIENT_ADMIT_BATCH;
+  for (int i = 0; i < n; i++) {
+    valid[i] = client_key_from(&keys[i], addrs[i], addr_lens[i]);
+    hashes[i] = valid[i] ? key_hash(&keys[i]) : 0;
+    __builtin_prefetch(&table->slots[hashes[i] & table->mask]);
+  }
+  // the home slot is there now, its entry is the one we want most of the
+  // time (short probes)
+  for (int i = 0; i < n; i++) {
+    uint32_t index = (uint32_t)table->slots[hashes[i] & table->mask];
+    if (index != 0)
+      __builtin_prefetch(&table->entries[index - 1]);
+  }
+  for (int i = 0; i < n; i++) {
+    client_entry *entry =
+        valid[i] ? lookup_hashed(table, &keys[i], hashes[i], now_ns) : NULL;
+    if (entry != NULL && !admit_entry(table, entry, bytes[i], now_ns))
+      entry = NULL;
+    admitted[i] = entry;
+  }
+}
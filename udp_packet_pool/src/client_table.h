@@ -0,0 +1,83 @@
+#pragma once
+#include "../../memory_pool/freelist.h"
+#include "protocol.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+// idle eviction wheel, a power of two
+#define CLIENT_WHEEL_SLOTS 256
+
+// the sender address as three words: IPv6 address (IPv4 as ::ffff:a.b.c.d)
+// and port + family. compared and hashed as integers, never as a string
+typedef struct {
+  uint64_t words[3];
+} client_key;
+
+typedef struct client_entry {
+  client_key key;
+  uint64_t hash;
+  // token bucket counted in time: credit_ns grows with the time since
+  // last_ns up to burst * interval, a packet costs one interval
+  uint64_t credit_ns;
+  uint64_t last_ns; // last packet, also what idle eviction looks at
+  uint64_t packets;
+  uint64_t bytes;
+  uint64_t throttled;
+  proto_peer peer; // framed protocol state
+  struct client_entry *wheel_next;
+} client_entry;
+
+// open addressing with linear probing. a slot holds the upper 32 hash bits
+// and the entry index + 1 (0 = empty), so most probes that miss never touch
+// the entry. entries come from a FreeListPool made at create time, nothing
+// is allocated per client. one thread only (the receiving one)
+typedef struct {
+  uint64_t *slots;
+  uint32_t mask;
+  uint32_t count;
+  uint32_t max_clients;
+  FreeListPool *pool;
+  client_entry *entries; // pool memory, for index <-> pointer
+  uint64_t interval_ns;  // 1e9 / rate, 0 = no limit
+  uint64_t burst_ns;     // burst * interval_ns
+  uint64_t idle_ns;
+  // entries sit in the wheel slot of the tick where they might expire.
+  // a packet does not move its entry, when the cursor reaches it the entry
+  // is evicted or put where its new expiry falls
+  client_entry *wheel[CLIENT_WHEEL_SLOTS];
+  uint64_t tick_ns;
+  uint64_t next_tick; // first tick the cursor has not processed
+  uint64_t next_tick_ns; // where it starts, client_admit() compares to it
+  uint64_t evicted;
+} client_table;
+
+// rate packets/s per client with bursts of burst packets (rate 0: count
+// only), entries unused for idle_ns are evicted. NULL if out of memory
+client_table *client_table_create(uint32_t max_clients, uint32_t rate,
+                                  uint32_t burst, uint64_t idle_ns);
+void client_table_destroy(client_table *table);
+// false for families other than AF_INET/AF_INET6
+bool client_key_from(client_key *key, const struct sockaddr *addr,
+                     socklen_t addr_len);
+// what the table hashes key with (client_entry.hash)
+uint64_t client_key_hash(const client_key *key);
+// the entry of key, inserted if new. NULL if the table is full
+client_entry *client_lookup(client_table *table, const client_key *key,
+                            uint64_t now_ns);
+// evicts idle entries up to now, returns how many. client_admit() calls it
+size_t client_table_expire(client_table *table, uint64_t now_ns);
+// the receive path in one call: expire, lookup, count, token bucket.
+// the client's entry, valid until the next call on the table. NULL if the
+// packet is over the client's rate, the table is full or the address is
+// not IP
+client_entry *client_admit(client_table *table, const struct sockaddr *addr,
+                           socklen_t addr_len, size_t bytes, uint64_t now_ns);
+// client_admit() for the n (up to CLIENT_ADMIT_BATCH) packets of one recvmmsg.
+// the slots of all packets are prefetched first, then the entries, so the
+// cache misses of a batch overlap instead of coming one after the other
+#define CLIENT_ADMIT_BATCH 64
+void client_admit_batch(client_table *table,
+                        const struct sockaddr *const *addrs,
+                        const socklen_t *addr_lens, const size_t *bytes,
+                        int n, uint64_t now_ns, client_entry **admitted);
@@ -0,0 +1,55 @@
+#include "histogram.h"
+#include <string.h>
+
+void histogram_reset(histogram *h) {
+  memset(h, 0, sizeof(*h));
+  h->min = UINT64_MAX;
+}
+void histogram_merge(histogram *dst, const histogram *src) {
+  for (int i = 0; i < HIST_BUCKETS; i++)
+    dst->counts[i] += src->counts[i];
+  dst->total += src->total;
+  if (src->min < dst->min)
+    dst->min = src->min;
+  if (src->max > dst->max)
+    dst->max = src->max;
+}
+static uint64_t bucket_highest(unsigned bucket) {
+  if (bucket < HIST_SUB)
+    return bucket;
+  unsigned shift = bucket / HIST_SUB - 1;
+  uint64_t lowest = (uint64_t)(bucket % HIST_SUB + HIST_SUB) << shift;
+  return lowest + ((uint64_t)1 << shift) - 1;
+}
+uint64_t histogram_percentile(const histogram *h, double p) {
+  if (h->total == 0)
+    return 0;
+  // rank of the sample we want, 1 based
+  uint64_t rank = (uint64_t)(p / 100.0 * h->total + 0.5);
+  if (rank < 1)
+    rank = 1;
+  uint64_t seen = 0;
+  for (int i = 0; i < HIST_BUCKETS; i++) {
+    seen += h->counts[i];
+    if (seen >= rank) {
+      uint64_t value = bucket_highest(i);
+      return value > h->max ? h->max : value;
+    }
+  }
+  return h->max;
+}
+void histogram_print(FILE *out, const char *name, const histogram *h,
+                     double scale, const char *unit) {
+  if (h->total == 0) {
+    fprintf(out, "%s: no samples\n", name);
+    return;
+  }
+  fprintf(out,
+          "%s: %lu samples, min %.1f p50 %.1f p90 %.1f p99 %.1f p99.9 %.1f "
+          "max %.1f %s\n",
+          name, (unsigned long)h->total, h->min / scale,
+          histogram_percentile(h, 50) / scale,
+          histogram_percentile(h, 90) / scale,
+          histogram_percentile(h, 99) / scale,
+          histogram_percentile(h, 99.9) / scale, h->max / scale, unit);
+}
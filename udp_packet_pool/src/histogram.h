@@ -0,0 +1,41 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+// HDR style log-linear histogram: values below HIST_SUB get their own bucket,
+// above that every power of two is split into HIST_SUB buckets, so a
+// recorded value is off by at most 1/HIST_SUB (~3%) over the full uint64
+// range, in a fixed 15 KB with no allocation
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+} histogram;
+
+void histogram_reset(histogram *h);
+static inline unsigned histogram_bucket(uint64_t value) {
+  if (value < HIST_SUB)
+    return value;
+  unsigned shift = 63 - __builtin_clzll(value) - HIST_SUB_BITS;
+  return (shift + 1) * HIST_SUB + (value >> shift) - HIST_SUB;
+}
+static inline void histogram_record(histogram *h, uint64_t value) {
+  h->counts[histogram_bucket(value)]++;
+  h->total++;
+  if (value < h->min)
+    h->min = value;
+  if (value > h->max)
+    h->max = value;
+}
+void histogram_merge(histogram *dst, const histogram *src);
+// highest value that lands in the same bucket as the value at percentile
+// p (0..100), 0 when empty
+uint64_t histogram_percentile(const histogram *h, double p);
+// "name: n samples, min .. p50 .. p99 .. p99.9 .. max" with values / scale
+// (e.g. 1000 for ns -> us)
+void histogram_print(FILE *out, const char *name, const histogram *h,
+                     double scale, const char *unit);
@@ -0,0 +1,455 @@
+// load generator for the echo server (the client of TODO.md phase 2/5).
+// every packet carries a sequence number and its send time, the echo gives
+// the round trip time, recorded in a log bucketed histogram per thread.
+// open loop (-r) sends at a fixed total rate no matter how fast echoes come
+// back, and takes the time a packet was due as its send time, so a stalled
+// server shows up as latency instead of as a lower send rate (coordinated
+// omission). closed loop (-c) keeps a fixed number of packets in flight per
+// socket.
+// -m reliable: every socket is a PROTO_DATA stream (reliable.h) to a
+// main --framed server, as much as its congestion window allows; goodput
+// and the delivery latency (first transmission to ack) are measured.
+// -L drops that share of the datagrams in the client (drop shim): in
+// reliable mode both ways, in echo mode the echoes (a lost request or a lost
+// echo look the same to the client).
+//
+// usage: loadgen [-h host] [-p port] [-t threads] [-s sockets per thread]
+//                [-r packets/s | -c in flight per socket] [-d seconds]
+//                [-l payload bytes] [-m echo|reliable] [-L loss percent]
+#define _GNU_SOURCE
+#include "histogram.h"
+#include "packet.h"
+#include "reliable.h"
+#include <errno.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#define MAX_THREADS 64
+#define MAX_SOCKETS 256 // per thread
+#define BATCH 32
+// closed loop: packets of a socket without any echo for this long are
+// given up as lost, so the socket sends again
+#define STALL_NS 100000000ull
+// echoes still accepted after the run
+#define DRAIN_NS 200000000ull
+
+// start of every payload, the server echoes it unchanged
+typedef struct {
+  uint64_t seq;
+  uint64_t sent_ns;
+} probe;
+
+typedef struct {
+  int fd;
+  uint64_t sent;
+  uint64_t received;
+  uint64_t highest; // highest sequence number received + 1
+  uint64_t reordered;
+  uint64_t in_flight;
+  uint64_t last_progress_ns;
+  rel_sender *sender; // reliable mode
+} flow;
+
+typedef struct {
+  const struct addrinfo *server;
+  int sockets;
+  double rate;     // packets/s of this thread, 0 = closed loop
+  int concurrency; // closed loop
+  double seconds;
+  size_t payload;
+  bool reliable;
+  double loss; // drop shim, 0..1
+  uint64_t rng;
+  flow flows[MAX_SOCKETS];
+  histogram rtt; // reliable mode: delivery latency
+  // reliable mode, summed over the streams
+  uint64_t transmissions; // datagrams sent, retransmissions included
+  uint64_t delivered_bytes;
+  uint64_t fast_retransmits;
+  uint64_t timeouts;
+  int error;
+} thread_state;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// the drop shim: true for the share loss of all calls
+static bool lose(thread_state *st) {
+  if (st->loss <= 0)
+    return false;
+  st->rng ^= st->rng << 13;
+  st->rng ^= st->rng >> 7;
+  st->rng ^= st->rng << 17;
+  return (st->rng >> 11) * (1.0 / 9007199254740992.0) < st->loss;
+}
+
+// takes what arrived on one socket, true if anything did
+static bool receive(thread_state *st, flow *f, struct mmsghdr *msgs) {
+  int n = recvmmsg(f->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+  if (n <= 0)
+    return false;
+  uint64_t now = now_ns();
+  for (int i = 0; i < n; i++) {
+    if (msgs[i].msg_len < sizeof(probe) || lose(st))
+      continue; // not ours
+    probe p;
+    memcpy(&p, msgs[i].msg_hdr.msg_iov->iov_base, sizeof(p));
+    histogram_record(&st->rtt, now > p.sent_ns ? now - p.sent_ns : 0);
+    f->received++;
+    if (f->in_flight > 0)
+      f->in_flight--;
+    if (p.seq < f->highest)
+      f->reordered++;
+    else
+      f->highest = p.seq + 1;
+  }
+  f->last_progress_ns = now;
+  return true;
+}
+
+static void transmit(thread_state *st, flow *f, PacketBuffer *pb) {
+  st->transmissions++;
+  if (!lose(st))
+    send(f->fd, pb->data, pb->length, MSG_DONTWAIT);
+}
+
+// every socket sends whatever its stream lets it, then retransmissions,
+// then takes the acks. sleeps until an ack or the next retransmission timer
+static void run_reliable(thread_state *st, struct pollfd *fds,
+                         struct mmsghdr *msgs) {
+  static _Thread_local uint8_t payload[PACKET_SIZE];
+  memset(payload, 'l', st->payload);
+  for (int s = 0; s < st->sockets; s++) {
+    st->flows[s].sender = rel_sender_create();
+    if (st->flows[s].sender == NULL) {
+      while (s-- > 0)
+        rel_sender_destroy(st->flows[s].sender);
+      st->error = ENOMEM;
+      return;
+    }
+  }
+  uint64_t end = now_ns() + (uint64_t)(st->seconds * 1e9);
+  uint64_t now;
+  while ((now = now_ns()) < end) {
+    bool progress = false;
+    uint64_t next_due = now + 1000000;
+    for (int s = 0; s < st->sockets; s++) {
+      flow *f = &st->flows[s];
+      PacketBuffer *pb;
+      while ((pb = rel_send(f->sender, payload, st->payload, now)) != NULL) {
+        transmit(st, f, pb);
+        progress = true;
+      }
+      PacketBuffer *again[BATCH];
+      int n = rel_poll(f->sender, now, again, BATCH);
+      for (int i = 0; i < n; i++)
+        transmit(st, f, again[i]);
+      int got = recvmmsg(f->fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+      uint64_t arrived = now_ns();
+      for (int i = 0; i < got; i++) {
+        if (!lose(st))
+          rel_on_ack(f->sender, msgs[i].msg_hdr.msg_iov->iov_base,
+                     msgs[i].msg_len, arrived);
+        progress = true;
+      }
+      if (rel_next_timer(f->sender) < next_due)
+        next_due = rel_next_timer(f->sender);
+    }
+    now = now_ns();
+    if (!progress && next_due > now) {
+      struct timespec timeout = {0, next_due - now};
+      ppoll(fds, st->sockets, &timeout, NULL);
+    }
+  }
+  for (int s = 0; s < st->sockets; s++) {
+    flow *f = &st->flows[s];
+    f->sent = f->sender->sent;
+    f->received = f->sender->delivered;
+    st->delivered_bytes += f->sender->delivered_bytes;
+    st->fast_retransmits += f->sender->fast_retransmits;
+    st->timeouts += f->sender->timeouts;
+    histogram_merge(&st->rtt, &f->sender->latency);
+    rel_sender_destroy(f->sender);
+  }
+}
+
+static void *run_thread(void *arg) {
+  thread_state *st = arg;
+  // aligned for the in place proto_header of reliable mode
+  static _Thread_local _Alignas(8) uint8_t out[BATCH][PACKET_SIZE],
+      in[BATCH][PACKET_SIZE];
+  struct mmsghdr send_msgs[BATCH], recv_msgs[BATCH];
+  struct iovec send_iov[BATCH], recv_iov[BATCH];
+  struct pollfd fds[MAX_SOCKETS];
+  memset(send_msgs, 0, sizeof(send_msgs));
+  memset(recv_msgs, 0, sizeof(recv_msgs));
+  for (int i = 0; i < BATCH; i++) {
+    memset(out[i], 'l', st->payload);
+    send_iov[i] = (struct iovec){out[i], st->payload};
+    recv_iov[i] = (struct iovec){in[i], PACKET_SIZE};
+    send_msgs[i].msg_hdr.msg_iov = &send_iov[i];
+    send_msgs[i].msg_hdr.msg_iovlen = 1;
+    recv_msgs[i].msg_hdr.msg_iov = &recv_iov[i];
+    recv_msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  histogram_reset(&st->rtt);
+  for (int s = 0; s < st->sockets; s++) {
+    flow *f = &st->flows[s];
+    memset(f, 0, sizeof(*f));
+    f->fd = socket(st->server->ai_family, SOCK_DGRAM, 0);
+    if (f->fd == -1 ||
+        connect(f->fd, st->server->ai_addr, st->server->ai_addrlen) == -1) {
+      st->error = errno;
+      // this one (if it opened) and the ones before it
+      for (int i = f->fd == -1 ? s - 1 : s; i >= 0; i--)
+        close(st->flows[i].fd);
+      return NULL;
+    }
+    int rcvbuf = 1 << 20;
+    setsockopt(f->fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    fds[s] = (struct pollfd){.fd = f->fd, .events = POLLIN};
+  }
+  if (st->reliable) {
+    run_reliable(st, fds, recv_msgs);
+    for (int s = 0; s < st->sockets; s++)
+      close(st->flows[s].fd);
+    return NULL;
+  }
+  // open loop: every socket sends rate / sockets, packet k of a socket is
+  // due at start + k * interval
+  double interval = st->rate > 0 ? 1e9 * st->sockets / st->rate : 0;
+  uint64_t start = now_ns();
+  uint64_t end = start + (uint64_t)(st->seconds * 1e9);
+  uint64_t now = start;
+  while (now < end) {
+    bool progress = false;
+    uint64_t next_due = now + 1000000; // wake up at least every ms
+    for (int s = 0; s < st->sockets; s++) {
+      flow *f = &st->flows[s];
+      uint64_t want;
+      if (interval > 0) {
+        uint64_t due = (uint64_t)((now - start) / interval) + 1;
+        want = due > f->sent ? due - f->sent : 0;
+      } else {
+        if (f->in_flight > 0 && now - f->last_progress_ns > STALL_NS)
+          f->in_flight = 0;
+        want = st->concurrency - f->in_flight;
+      }
+      if (want > BATCH)
+        want = BATCH;
+      for (uint64_t i = 0; i < want; i++) {
+        probe p = {f->sent + i, now};
+        if (interval > 0)
+          p.sent_ns = start + (uint64_t)((f->sent + i) * interval);
+        memcpy(out[i], &p, sizeof(p));
+      }
+      if (want > 0) {
+        int n = sendmmsg(f->fd, send_msgs, want, MSG_DONTWAIT);
+        if (n > 0) {
+          if (f->in_flight == 0)
+            f->last_progress_ns = now;
+          f->sent += n;
+          f->in_flight += n;
+          progress = true;
+        }
+      }
+      progress |= receive(st, f, recv_msgs);
+      if (interval > 0 && start + (uint64_t)(f->sent * interval) < next_due)
+        next_due = start + (uint64_t)(f->sent * interval);
+    }
+    // sleep until an echo arrives or the next packet is due. ppoll: poll
+    // only has ms, which would send open loop packets up to 1 ms late
+    now = now_ns();
+    if (!progress && next_due > now) {
+      struct timespec timeout = {0, next_due - now};
+      ppoll(fds, st->sockets, &timeout, NULL);
+    }
+    now = now_ns();
+  }
+  // late echoes still count, they are not lost
+  uint64_t drain_end = now_ns() + DRAIN_NS;
+  while (now_ns() < drain_end) {
+    bool progress = false;
+    for (int s = 0; s < st->sockets; s++)
+      progress |= receive(st, &st->flows[s], recv_msgs);
+    if (!progress)
+      poll(fds, st->sockets, 10);
+  }
+  for (int s = 0; s < st->sockets; s++)
+    close(st->flows[s].fd);
+  return NULL;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr,
+          "usage: %s [-h host] [-p port] [-t threads] [-s sockets per "
+          "thread] [-r packets/s | -c in flight per socket] [-d seconds] "
+          "[-l payload bytes] [-m echo|reliable] [-L loss percent]\n",
+          name);
+}
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1", *port = "8888";
+  int threads = 1, sockets = 4, concurrency = 16;
+  double rate = 0, seconds = 5;
+  size_t payload = 64;
+  bool reliable = false;
+  double loss = 0;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc || argv[i][0] != '-' || strlen(argv[i]) != 2) {
+      usage(argv[0]);
+      return 1;
+    }
+    const char *value = argv[++i];
+    switch (argv[i - 1][1]) {
+    case 'h':
+      host = value;
+      break;
+    case 'p':
+      port = value;
+      break;
+    case 't':
+      threads = atoi(value);
+      break;
+    case 's':
+      sockets = atoi(value);
+      break;
+    case 'r':
+      rate = atof(value);
+      break;
+    case 'c':
+      concurrency = atoi(value);
+      break;
+    case 'd':
+      seconds = atof(value);
+      break;
+    case 'l':
+      payload = strtoul(value, NULL, 10);
+      break;
+    case 'm':
+      if (strcmp(value, "reliable") == 0) {
+        reliable = true;
+      } else if (strcmp(value, "echo") != 0) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'L':
+      loss = atof(value) / 100;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (threads < 1 || threads > MAX_THREADS || sockets < 1 ||
+      sockets > MAX_SOCKETS || concurrency < 1 || seconds <= 0 ||
+      payload < sizeof(probe) || payload > PACKET_SIZE ||
+      (reliable && payload > PACKET_SIZE - sizeof(proto_header)) ||
+      loss < 0 || loss >= 1) {
+    fprintf(stderr,
+            "%s: 1..%d threads, 1..%d sockets, payload %zu..%d bytes "
+            "(reliable: %zu less), loss below 100%%\n",
+            argv[0], MAX_THREADS, MAX_SOCKETS, sizeof(probe), PACKET_SIZE,
+            sizeof(proto_header));
+    return 1;
+  }
+  struct addrinfo hints = {.ai_family = AF_UNSPEC, .ai_socktype = SOCK_DGRAM};
+  struct addrinfo *server;
+  int rv = getaddrinfo(host, port, &hints, &server);
+  if (rv != 0) {
+    fprintf(stderr, "%s: %s\n", host, gai_strerror(rv));
+    return 1;
+  }
+
+  thread_state *states = calloc(threads, sizeof(thread_state));
+  if (states == NULL) {
+    fprintf(stderr, " %d : %s \n", errno, strerror(errno));
+    freeaddrinfo(server);
+    return 1;
+  }
+  pthread_t tids[MAX_THREADS];
+  int haderrors = 0;
+  for (int t = 0; t < threads; t++) {
+    states[t] = (thread_state){.server = server,
+                               .sockets = sockets,
+                               .rate = rate / threads,
+                               .concurrency = concurrency,
+                               .seconds = seconds,
+                               .payload = payload,
+                               .reliable = reliable,
+                               .loss = loss,
+                               .rng = 88172645463325252ull + t};
+    int err = pthread_create(&tids[t], NULL, run_thread, &states[t]);
+    if (err != 0) {
+      // go on with the threads already running
+      fprintf(stderr, "thread %d: %d : %s\n", t, err, strerror(err));
+      haderrors++;
+      threads = t;
+    }
+  }
+  static histogram rtt;
+  histogram_reset(&rtt);
+  uint64_t sent = 0, received = 0, reordered = 0;
+  uint64_t transmissions = 0, delivered_bytes = 0, fast = 0, timeouts = 0;
+  for (int t = 0; t < threads; t++) {
+    pthread_join(tids[t], NULL);
+    if (states[t].error != 0) {
+      fprintf(stderr, "thread %d: %d : %s\n", t, states[t].error,
+              strerror(states[t].error));
+      haderrors++;
+      continue;
+    }
+    histogram_merge(&rtt, &states[t].rtt);
+    transmissions += states[t].transmissions;
+    delivered_bytes += states[t].delivered_bytes;
+    fast += states[t].fast_retransmits;
+    timeouts += states[t].timeouts;
+    for (int s = 0; s < sockets; s++) {
+      sent += states[t].flows[s].sent;
+      received += states[t].flows[s].received;
+      reordered += states[t].flows[s].reordered;
+    }
+  }
+  freeaddrinfo(server);
+  free(states);
+
+  if (reliable) {
+    printf("reliable, %d threads x %d sockets, %zu bytes, %.1f s, %.1f%% "
+           "loss\n",
+           threads, sockets, payload, seconds, loss * 100);
+    printf("sent %lu delivered %lu, %lu datagrams (%.3f per packet), %lu "
+           "fast retransmits, %lu timeouts\n",
+           (unsigned long)sent, (unsigned long)received,
+           (unsigned long)transmissions,
+           received ? (double)transmissions / received : 0.0,
+           (unsigned long)fast, (unsigned long)timeouts);
+    printf("goodput %.0f packets/s, %.1f MB/s\n", received / seconds,
+           delivered_bytes / seconds / 1e6);
+    histogram_print(stdout, "delivery", &rtt, 1000.0, "us");
+    return haderrors > 0;
+  }
+  if (rate > 0)
+    printf("open loop %.0f packets/s", rate);
+  else
+    printf("closed loop %d in flight per socket", concurrency);
+  printf(", %d threads x %d sockets, %zu bytes, %.1f s\n", threads, sockets,
+         payload, seconds);
+  uint64_t lost = sent > received ? sent - received : 0;
+  printf("sent %lu received %lu lost %lu (%.3f%%) reordered %lu\n",
+         (unsigned long)sent, (unsigned long)received, (unsigned long)lost,
+         sent ? 100.0 * lost / sent : 0.0, (unsigned long)reordered);
+  printf("throughput %.0f packets/s\n", received / seconds);
+  histogram_print(stdout, "rtt", &rtt, 1000.0, "us");
+  return haderrors > 0;
+}
@@ -1,12 +1,126 @@
+#include "../../bench/trace.h"
+#include "pipeline.h"
 #include "server.h"
+#include "stats.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
+static void on_signal(int sig) {
+  (void)sig;
+  server_stop();
+}
 // here both server and client run on the same machine
 // check if:
 // echo works correctly
 // no memory leaks
+// usage: main [port] [blocking|batched|uring|pipeline [workers]]
+//             [--limit packets/s burst] [--clients max] [--framed]
+// --limit: per client token bucket (client_table.h), --clients: how many
+// clients it tracks at once (default 65536), idle ones go after 60 s
+// --framed: only framed packets (protocol.h) are answered, duplicates are
+// dropped per client (turns on the client table, unlimited without --limit)
+// built with -DBENCH_TRACE (link ../../bench/trace.c bench.c
+// perf_counters.c) it takes --trace file: the trace points of every thread
+// go there as Chrome trace JSON when the server stops
+// pipeline prints its stage stats to stderr every second.
+// the counters of every mode go to the shared memory segment
+// STATS_SHM_PREFIX<port> once a second (read it with statsview) and come back for a "stats" packet
 int main(int argc, char **argv) {
-  int server_socket = create_udp_socket("8888");
-  server_loop(server_socket);
+  char *args[3] = {"8888", "blocking", "2"};
+  int positional = 0;
+  uint32_t rate = 0, burst = 0, max_clients = 65536;
+  bool framed = false;
+#ifdef BENCH_TRACE
+  const char *trace = NULL;
+#endif
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--limit") == 0 && i + 2 < argc) {
+      rate = strtoul(argv[i + 1], NULL, 10);
+      burst = strtoul(argv[i + 2], NULL, 10);
+      i += 2;
+    } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+      max_clients = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(argv[i], "--framed") == 0) {
+      framed = true;
+#ifdef BENCH_TRACE
+    } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+      trace = argv[++i];
+#endif
+    } else if (positional < 3) {
+      args[positional++] = argv[i];
+    }
+  }
+  char *port = args[0];
+  const char *mode = args[1];
+  // no SA_RESTART: ctrl+c interrupts the blocking recv and the loop ends
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  int server_socket = create_udp_socket(port);
+  char shm_name[64];
+  snprintf(shm_name, sizeof(shm_name), STATS_SHM_PREFIX "%s", port);
+  if (!stats_publish_start(shm_name, 1000))
+    fprintf(stderr, "%s: %d : %s, no shared memory stats%s\n", shm_name,
+            errno, strerror(errno),
+            errno == EEXIST
+                ? " (another server on this port, or left in /dev/shm)"
+                : "");
+  client_table *clients = NULL;
+  server_set_framed(framed);
+  if (rate > 0 || framed) {
+    clients = client_table_create(max_clients, rate, burst,
+                                  60 * 1000000000ull);
+    if (clients == NULL) {
+      fprintf(stderr, "client table: %d : %s\n", errno, strerror(errno));
+      return 1;
+    }
+    server_set_clients(clients);
+  }
+  io_counters counters = {0};
+  if (strcmp(mode, "pipeline") == 0) {
+    int workers = atoi(args[2]);
+    pipeline *p = pipeline_start(server_socket, workers, NULL, NULL);
+    if (p == NULL) {
+      fprintf(stderr, "pipeline: %d : %s\n", errno, strerror(errno));
+      stats_publish_stop();
+      client_table_destroy(clients);
+      return 1;
+    }
+    while (server_running) {
+      sleep(1); // a signal ends it early
+      pipeline_stats stats;
+      pipeline_read_stats(p, &stats);
+      pipeline_print_stats(stderr, &stats);
+    }
+    pipeline_stop(p);
+  } else if (strcmp(mode, "uring") == 0) {
+    if (!server_loop_uring(server_socket, &counters)) {
+      fprintf(stderr, "io_uring: %d : %s, using batched\n", errno,
+              strerror(errno));
+      server_loop_batched(server_socket, &counters);
+    }
+  } else if (strcmp(mode, "batched") == 0) {
+    server_loop_batched(server_socket, &counters);
+  } else {
+    server_loop(server_socket, &counters);
+  }
+  if (counters.packets > 0)
+    fprintf(stderr, "%lu packets, %.2f syscalls per packet\n",
+            (unsigned long)counters.packets,
+            (double)counters.syscalls / counters.packets);
+#ifdef BENCH_TRACE
+  if (trace != NULL && !trace_dump_chrome(trace))
+    fprintf(stderr, "%s: %d : %s\n", trace, errno, strerror(errno));
+#endif
+  stats_publish_stop();
+  client_table_destroy(clients);
 
   return 0;
 }
@@ -0,0 +1,23 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// a full 1500 byte ethernet frame fits
+#define PACKET_SIZE 2048
+// room in front of data for what the kernel writes before the payload of a
+// multishot recvmsg (struct io_uring_recvmsg_out + sender address), so the
+// payload still lands at data[0]
+#define PACKET_HEADROOM 64
+
+// pool object, see ARCHITECTURE.md. all buffers come from one FreeListPool,
+// so a buffer is also identified by its index in the pool memory
+typedef struct {
+  uint8_t headroom[PACKET_HEADROOM];
+  uint8_t data[PACKET_SIZE];
+  size_t length; // bytes in data
+  struct sockaddr_storage sender;
+  socklen_t sender_len;
+  uint64_t timestamp_ns; // CLOCK_MONOTONIC when received
+  uint64_t processed_ns; // pipeline: when the worker was done with it
+} PacketBuffer;
@@ -0,0 +1,450 @@
+#define _GNU_SOURCE
+#include "pipeline.h"
+#include "../../bench/trace.h"
+#include "../../memory_pool/freelist.h"
+#include "server.h"
+#include "spsc.h"
+#include "stats.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// stage latencies of one thread, written like the thread_stats counters
+// (stats.h), one cache line each so the stages do not invalidate each other
+typedef struct {
+  _Atomic uint64_t packets;
+  _Atomic uint64_t total_ns;
+  _Atomic uint64_t max_ns;
+} stage_counter;
+typedef struct {
+  _Alignas(CACHE_LINE) stage_counter queue_wait;
+  stage_counter processing;
+} worker_counters;
+typedef struct {
+  _Alignas(CACHE_LINE) stage_counter send_wait;
+} send_counters;
+
+typedef struct {
+  pipeline *p;
+  int index;
+} worker_arg;
+
+struct pipeline {
+  int socketfd;
+  int workers;
+  packet_handler handler;
+  void *handler_arg;
+  FreeListPool *pool; // receive thread only
+  spsc_ring *to_worker[PIPELINE_MAX_WORKERS];
+  spsc_ring *to_send[PIPELINE_MAX_WORKERS];
+  spsc_ring *recycle;
+  // --framed with a client table: duplicate windows and PROTO_DATA streams
+  // of the clients a worker gets, only that worker touches them
+  client_table *peers[PIPELINE_MAX_WORKERS];
+  atomic_bool stop;
+  atomic_bool receive_done;
+  atomic_int workers_done;
+  pthread_t receive_thread, send_thread;
+  pthread_t worker_threads[PIPELINE_MAX_WORKERS];
+  worker_arg worker_args[PIPELINE_MAX_WORKERS];
+  // packet counters, shared with the other server loops (stats.h)
+  thread_stats *rx_stats;
+  thread_stats *tx_stats;
+  worker_counters work[PIPELINE_MAX_WORKERS];
+  send_counters tx;
+};
+
+static void record(stage_counter *c, uint64_t ns) {
+  stats_add(&c->packets, 1);
+  stats_add(&c->total_ns, ns);
+  if (ns > atomic_load_explicit(&c->max_ns, memory_order_relaxed))
+    atomic_store_explicit(&c->max_ns, ns, memory_order_relaxed);
+}
+// nothing to do: yield a few times (cheap when another stage is runnable),
+// then sleep so idle stages do not burn a core
+static void backoff(int *idle) {
+  if (++*idle < 16)
+    sched_yield();
+  else
+    usleep(50);
+}
+
+// every packet of a client goes to the same worker, so its packets stay in
+// order and the worker can keep per client state. addresses that are not
+// IP all go to worker 0
+static int worker_of(pipeline *p, PacketBuffer *pb, client_entry *client) {
+  if (p->workers == 1)
+    return 0;
+  uint64_t hash;
+  if (client != NULL) {
+    hash = client->hash;
+  } else {
+    client_key key;
+    if (!client_key_from(&key, (struct sockaddr *)&pb->sender,
+                         pb->sender_len))
+      return 0;
+    hash = client_key_hash(&key);
+  }
+  // the table indexes with the low bits, here the high ones
+  return (hash >> 32) % p->workers;
+}
+
+static void *receive_stage(void *arg) {
+  pipeline *p = arg;
+  thread_stats *stats = p->rx_stats;
+  PacketBuffer *ready[PIPELINE_BATCH];
+  struct mmsghdr msgs[PIPELINE_BATCH];
+  struct iovec iovs[PIPELINE_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  int have = 0, idle = 0;
+  bool exhausted = false;
+  TRACE_THREAD_NAME("receive");
+  while (!atomic_load_explicit(&p->stop, memory_order_relaxed)) {
+    // refill the free slots, used buffers first so the pool stays cold
+    while (have < PIPELINE_BATCH) {
+      PacketBuffer *pb = spsc_pop(p->recycle);
+      if (pb == NULL)
+        pb = freelist_pool_alloc(p->pool);
+      if (pb == NULL)
+        break;
+      ready[have++] = pb;
+    }
+    // counted once each time the pool runs dry, not per idle pass
+    if (have < PIPELINE_BATCH && !exhausted)
+      stats_add(&stats->pool_exhausted, 1);
+    exhausted = have < PIPELINE_BATCH;
+    if (have == 0) {
+      backoff(&idle);
+      continue;
+    }
+    idle = 0;
+    for (int i = 0; i < have; i++) {
+      iovs[i].iov_base = ready[i]->data;
+      iovs[i].iov_len = PACKET_SIZE;
+      msgs[i].msg_hdr.msg_name = &ready[i]->sender;
+      msgs[i].msg_hdr.msg_namelen = sizeof(ready[i]->sender);
+      msgs[i].msg_hdr.msg_iov = &iovs[i];
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    int received = recvmmsg(p->socketfd, msgs, have, MSG_WAITFORONE, NULL);
+    if (received == -1) {
+      if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)
+        continue; // timeout: look at stop again
+      fprintf(stderr, " %d : %s \n", errno, strerror(errno));
+      break;
+    }
+    TRACE_BEGIN("receive");
+    TRACE_COUNTER("received", received);
+    uint64_t now = stats_now_ns();
+    client_entry *admitted[PIPELINE_BATCH];
+    if (server_clients != NULL) {
+      const struct sockaddr *addrs[PIPELINE_BATCH];
+      socklen_t addr_lens[PIPELINE_BATCH];
+      size_t lengths[PIPELINE_BATCH];
+      for (int i = 0; i < received; i++) {
+        addrs[i] = (struct sockaddr *)&ready[i]->sender;
+        addr_lens[i] = msgs[i].msg_hdr.msg_namelen;
+        lengths[i] = msgs[i].msg_len;
+      }
+      client_admit_batch(server_clients, addrs, addr_lens, lengths, received,
+                         now, admitted);
+    }
+    int keep = 0;
+    uint64_t bytes = 0;
+    for (int i = 0; i < received; i++) {
+      PacketBuffer *pb = ready[i];
+      pb->length = msgs[i].msg_len;
+      bytes += pb->length;
+      pb->sender_len = msgs[i].msg_hdr.msg_namelen;
+      pb->timestamp_ns = now;
+      if (server_clients != NULL && admitted[i] == NULL) {
+        stats_add(&stats->throttled, 1);
+        ready[keep++] = pb;
+        continue;
+      }
+      client_entry *client = server_clients != NULL ? admitted[i] : NULL;
+      // no other worker as a fallback, that would reorder the client
+      if (!spsc_push(p->to_worker[worker_of(p, pb, client)], pb)) {
+        stats_add(&stats->drops, 1);
+        ready[keep++] = pb; // reused for the next recv
+      }
+    }
+    stats_rx(stats, received, bytes);
+    stats_batch(stats, received);
+    // slots recvmmsg did not fill move to the front
+    for (int i = received; i < have; i++)
+      ready[keep++] = ready[i];
+    have = keep;
+    TRACE_END("receive");
+  }
+  for (int i = 0; i < have; i++)
+    freelist_pool_free(p->pool, ready[i]);
+  atomic_store_explicit(&p->receive_done, true, memory_order_release);
+  return NULL;
+}
+
+static void *worker_stage(void *arg) {
+  worker_arg *wa = arg;
+  pipeline *p = wa->p;
+  spsc_ring *in = p->to_worker[wa->index];
+  spsc_ring *out = p->to_send[wa->index];
+  client_table *peers = p->peers[wa->index];
+  worker_counters *counters = &p->work[wa->index];
+  thread_stats *stats = stats_register();
+  void *batch[PIPELINE_BATCH];
+  int idle = 0;
+  TRACE_THREAD_NAME("worker");
+  while (1) {
+    size_t n = spsc_pop_batch(in, batch, PIPELINE_BATCH);
+    if (n == 0) {
+      // the receiver is gone: one last look, everything it pushed is
+      // visible after the acquire
+      if (atomic_load_explicit(&p->receive_done, memory_order_acquire)) {
+        n = spsc_pop_batch(in, batch, PIPELINE_BATCH);
+        if (n == 0)
+          break;
+      } else {
+        backoff(&idle);
+        continue;
+      }
+    }
+    idle = 0;
+    TRACE_BEGIN("work");
+    uint64_t start = stats_now_ns();
+    for (size_t i = 0; i < n; i++) {
+      PacketBuffer *pb = batch[i];
+      record(&counters->queue_wait, start - pb->timestamp_ns);
+      // length 0 is dropped by the send stage
+      if (server_framed) {
+        size_t length = pb->length;
+        client_entry *client =
+            peers != NULL ? client_admit(peers, (struct sockaddr *)&pb->sender,
+                                         pb->sender_len, length,
+                                         pb->timestamp_ns)
+                          : NULL;
+        pb->length =
+            server_handle(pb->data, &length, PACKET_SIZE, client, stats)
+                ? length
+                : 0;
+      } else if (!stats_handle_request(pb->data, &pb->length, PACKET_SIZE) &&
+                 p->handler != NULL) {
+        p->handler(pb, p->handler_arg);
+      }
+      uint64_t done = stats_now_ns();
+      record(&counters->processing, done - start);
+      stats_processing(stats, done - start, 1);
+      pb->processed_ns = done;
+      start = done;
+      // the sender is fast and recycles every buffer, a full ring only
+      // means it is behind for a moment
+      while (!spsc_push(out, pb))
+        sched_yield();
+    }
+    TRACE_END("work");
+  }
+  atomic_fetch_add_explicit(&p->workers_done, 1, memory_order_release);
+  return NULL;
+}
+
+static void *send_stage(void *arg) {
+  pipeline *p = arg;
+  thread_stats *stats = p->tx_stats;
+  void *batch[PIPELINE_BATCH];
+  PacketBuffer *echo[PIPELINE_BATCH];
+  struct mmsghdr msgs[PIPELINE_BATCH];
+  struct iovec iovs[PIPELINE_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  int next = 0, idle = 0;
+  TRACE_THREAD_NAME("send");
+  while (1) {
+    bool finished = atomic_load_explicit(&p->workers_done,
+                                         memory_order_acquire) == p->workers;
+    // collect up to a batch, round robin so no worker is starved
+    size_t n = 0;
+    for (int w = 0; w < p->workers && n < PIPELINE_BATCH; w++) {
+      n += spsc_pop_batch(p->to_send[next], batch + n, PIPELINE_BATCH - n);
+      next = (next + 1) % p->workers;
+    }
+    if (n == 0) {
+      if (finished)
+        break;
+      backoff(&idle);
+      continue;
+    }
+    idle = 0;
+    TRACE_BEGIN("send");
+    int count = 0;
+    for (size_t i = 0; i < n; i++) {
+      PacketBuffer *pb = batch[i];
+      if (pb->length == 0) {
+        spsc_push(p->recycle, pb);
+        continue;
+      }
+      iovs[count].iov_base = pb->data;
+      iovs[count].iov_len = pb->length;
+      msgs[count].msg_hdr.msg_name = &pb->sender;
+      msgs[count].msg_hdr.msg_namelen = pb->sender_len;
+      msgs[count].msg_hdr.msg_iov = &iovs[count];
+      msgs[count].msg_hdr.msg_iovlen = 1;
+      echo[count++] = pb;
+    }
+    // only what sendmmsg took counts as tx, a failed packet is a drop
+    int transmitted = 0;
+    uint64_t bytes = 0;
+    for (int sent = 0; sent < count;) {
+      int r = sendmmsg(p->socketfd, msgs + sent, count - sent, 0);
+      if (r == -1 && errno == EINTR)
+        continue;
+      if (r == -1) {
+        stats_add(&stats->drops, 1);
+        sent++; // this one is lost, go on with the rest
+        continue;
+      }
+      for (int i = sent; i < sent + r; i++)
+        bytes += iovs[i].iov_len;
+      transmitted += r;
+      sent += r;
+    }
+    uint64_t now = stats_now_ns();
+    for (int i = 0; i < count; i++) {
+      record(&p->tx.send_wait, now - echo[i]->processed_ns);
+      // recycle holds every buffer of the pool, this never fails
+      spsc_push(p->recycle, echo[i]);
+    }
+    stats_tx(stats, transmitted, bytes);
+    stats_batch(stats, count);
+    TRACE_END("send");
+  }
+  return NULL;
+}
+
+pipeline *pipeline_start(int socketfd, int workers, packet_handler handler,
+                         void *arg) {
+  if (workers < 1 || workers > PIPELINE_MAX_WORKERS) {
+    errno = EINVAL;
+    return NULL;
+  }
+  pipeline *p = aligned_alloc(CACHE_LINE, sizeof(pipeline));
+  if (p == NULL)
+    return NULL;
+  memset(p, 0, sizeof(*p));
+  p->socketfd = socketfd;
+  p->workers = workers;
+  p->handler = handler;
+  p->handler_arg = arg;
+  p->pool = freelist_pool_create(sizeof(PacketBuffer), PIPELINE_BUFFERS);
+  p->recycle = spsc_create(PIPELINE_BUFFERS);
+  bool ok = p->pool != NULL && p->recycle != NULL;
+  for (int i = 0; i < workers; i++) {
+    p->to_worker[i] = spsc_create(PIPELINE_RING);
+    p->to_send[i] = spsc_create(PIPELINE_RING);
+    ok = ok && p->to_worker[i] != NULL && p->to_send[i] != NULL;
+    // count only, the receive stage's table does the rate limit
+    if (server_framed && server_clients != NULL) {
+      p->peers[i] = client_table_create(server_clients->max_clients, 0, 0,
+                                        server_clients->idle_ns);
+      ok = ok && p->peers[i] != NULL;
+    }
+  }
+  struct timeval timeout = {0, 100000};
+  if (!ok ||
+      setsockopt(socketfd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                 sizeof(timeout)) == -1) {
+    int saved = ok ? errno : ENOMEM;
+    for (int i = 0; i < workers; i++) {
+      spsc_destroy(p->to_worker[i]);
+      spsc_destroy(p->to_send[i]);
+      client_table_destroy(p->peers[i]);
+    }
+    spsc_destroy(p->recycle);
+    if (p->pool != NULL)
+      freelist_pool_destroy(p->pool);
+    free(p);
+    errno = saved;
+    return NULL;
+  }
+  p->rx_stats = stats_register();
+  p->tx_stats = stats_register();
+  pthread_create(&p->receive_thread, NULL, receive_stage, p);
+  for (int i = 0; i < workers; i++) {
+    p->worker_args[i] = (worker_arg){p, i};
+    pthread_create(&p->worker_threads[i], NULL, worker_stage,
+                   &p->worker_args[i]);
+  }
+  pthread_create(&p->send_thread, NULL, send_stage, p);
+  return p;
+}
+
+static uint64_t load(_Atomic uint64_t *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+// counters of this pipeline only, stats_collect() sums all threads
+static void sum_stage(stage_latency *out, stage_counter *c) {
+  out->packets += load(&c->packets);
+  out->total_ns += load(&c->total_ns);
+  uint64_t max = load(&c->max_ns);
+  if (max > out->max_ns)
+    out->max_ns = max;
+}
+void pipeline_read_stats(pipeline *p, pipeline_stats *out) {
+  memset(out, 0, sizeof(*out));
+  out->workers = p->workers;
+  out->received = load(&p->rx_stats->rx_packets);
+  out->dropped = load(&p->rx_stats->drops);
+  out->pool_exhausted = load(&p->rx_stats->pool_exhausted);
+  out->sent = load(&p->tx_stats->tx_packets);
+  for (int i = 0; i < p->workers; i++) {
+    sum_stage(&out->queue_wait, &p->work[i].queue_wait);
+    sum_stage(&out->processing, &p->work[i].processing);
+    out->worker_depth[i] = spsc_depth(p->to_worker[i]);
+    out->worker_max_depth[i] = load(&p->to_worker[i]->max_depth);
+    out->send_depth[i] = spsc_depth(p->to_send[i]);
+    out->send_max_depth[i] = load(&p->to_send[i]->max_depth);
+  }
+  sum_stage(&out->send_wait, &p->tx.send_wait);
+  out->recycle_depth = spsc_depth(p->recycle);
+}
+
+static void print_stage(FILE *out, const char *name, const stage_latency *s) {
+  fprintf(out, "  %-10s avg %8.0f ns  max %8lu ns\n", name,
+          s->packets ? (double)s->total_ns / s->packets : 0.0,
+          (unsigned long)s->max_ns);
+}
+void pipeline_print_stats(FILE *out, const pipeline_stats *stats) {
+  fprintf(out, "received %lu sent %lu dropped %lu pool exhausted %lu\n",
+          (unsigned long)stats->received, (unsigned long)stats->sent,
+          (unsigned long)stats->dropped,
+          (unsigned long)stats->pool_exhausted);
+  print_stage(out, "queue", &stats->queue_wait);
+  print_stage(out, "process", &stats->processing);
+  print_stage(out, "send", &stats->send_wait);
+  for (int i = 0; i < stats->workers; i++)
+    fprintf(out, "  worker %2d depth %4zu (max %4zu)  send depth %4zu (max "
+                 "%4zu)\n",
+            i, stats->worker_depth[i], stats->worker_max_depth[i],
+            stats->send_depth[i], stats->send_max_depth[i]);
+  fprintf(out, "  recycle depth %zu\n", stats->recycle_depth);
+}
+
+void pipeline_stop(pipeline *p) {
+  atomic_store(&p->stop, true);
+  // each stage drains its input once the one before it is done
+  pthread_join(p->receive_thread, NULL);
+  for (int i = 0; i < p->workers; i++)
+    pthread_join(p->worker_threads[i], NULL);
+  pthread_join(p->send_thread, NULL);
+  for (int i = 0; i < p->workers; i++) {
+    spsc_destroy(p->to_worker[i]);
+    spsc_destroy(p->to_send[i]);
+    client_table_destroy(p->peers[i]);
+  }
+  spsc_destroy(p->recycle);
+  // buffers still in recycle live in the pool memory too
+  freelist_pool_destroy(p->pool);
+  free(p);
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include "packet.h"
+#include <stdint.h>
+#include <stdio.h>
+#define PIPELINE_MAX_WORKERS 16
+// buffers in the pool, shared by all stages
+#define PIPELINE_BUFFERS 4096
+// capacity of each receive->worker and worker->send ring
+#define PIPELINE_RING 1024
+// packets per recvmmsg/sendmmsg
+#define PIPELINE_BATCH 32
+
+// staged echo server:
+//
+//   receive --spsc--> worker 0..n-1 --spsc--> send
+//      ^                                       |
+//      +------------------spsc-----------------+  (used buffers)
+//
+// the receive thread is the only one using the FreeListPool, the send
+// thread hands buffers back over the recycle ring, so no stage takes a lock.
+// the receiver picks the worker from a hash of the client address, so the
+// packets of a client stay in order. when that worker's ring is full the
+// packet is dropped (counted) instead of stalling recv.
+// with server_set_clients() the receiver also runs the client table, with
+// --framed (server_set_framed()) as well every worker keeps the duplicate
+// windows and PROTO_DATA streams of its clients in a table of its own.
+
+// runs on a worker thread for every packet, may change data and length.
+// length 0: the packet is not echoed
+typedef void (*packet_handler)(PacketBuffer *packet, void *arg);
+
+typedef struct {
+  uint64_t packets;
+  uint64_t total_ns;
+  uint64_t max_ns;
+} stage_latency;
+
+typedef struct {
+  int workers;
+  uint64_t received;
+  uint64_t sent;
+  uint64_t dropped;        // the client's worker ring was full
+  uint64_t pool_exhausted; // times the receiver ran out of free buffers
+  stage_latency queue_wait; // received -> picked up by a worker
+  stage_latency processing; // handler
+  stage_latency send_wait;  // handler done -> sendmmsg returned
+  // current and highest depth of every ring
+  size_t worker_depth[PIPELINE_MAX_WORKERS];
+  size_t worker_max_depth[PIPELINE_MAX_WORKERS];
+  size_t send_depth[PIPELINE_MAX_WORKERS];
+  size_t send_max_depth[PIPELINE_MAX_WORKERS];
+  size_t recycle_depth;
+} pipeline_stats;
+
+typedef struct pipeline pipeline;
+// starts receive, workers (1..PIPELINE_MAX_WORKERS) and send threads on
+// socketfd. handler may be NULL (plain echo). sets a 100 ms receive timeout
+// on the socket so the receiver notices pipeline_stop(). NULL with errno set
+// on failure
+pipeline *pipeline_start(int socketfd, int workers, packet_handler handler,
+                         void *arg);
+// any thread, while running. the counters of each stage are read without
+// stopping it, so the numbers of different stages can be a few packets apart
+void pipeline_read_stats(pipeline *p, pipeline_stats *out);
+void pipeline_print_stats(FILE *out, const pipeline_stats *stats);
+// drains what is already received, joins the threads and frees everything
+void pipeline_stop(pipeline *p);
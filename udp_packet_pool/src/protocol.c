@@ -0,0 +1,276 @@
+#include "protocol.h"
+#include "stats.h"
+#include <arpa/inet.h>
+#include <endian.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+#define CRC32C_POLY 0x82F63B78u // reflected
+// block sizes of the three stream loop. a long round covers 3 * 128 bytes,
+// what is left of a packet goes through short rounds of 3 * 32
+#define CRC_LONG 128
+#define CRC_SHORT 32
+
+static uint32_t crc_table[256];
+// crc_long[k][b]: the crc state (b << 8k) after CRC_LONG zero bytes. the
+// state is linear in its bits, so moving any state over CRC_LONG bytes is
+// four lookups
+static uint32_t crc_long[4][256];
+static uint32_t crc_short[4][256];
+static bool crc_hardware;
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+// set once the tables are there, so only the first calls go to pthread_once
+static _Atomic bool crc_ready;
+
+// state in, state out, no inversion
+static uint32_t crc_software(uint32_t crc, const uint8_t *p, size_t length) {
+  for (size_t i = 0; i < length; i++)
+    crc = crc_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  return crc;
+}
+
+static inline uint32_t shift(uint32_t table[4][256], uint32_t crc) {
+  return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^
+         table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+static void zeros_table(uint32_t table[4][256], size_t length) {
+  static const uint8_t zeros[CRC_LONG];
+  for (int k = 0; k < 4; k++)
+    for (uint32_t b = 0; b < 256; b++)
+      table[k][b] = crc_software(b << (8 * k), zeros, length);
+}
+
+static void crc_init(void) {
+  for (uint32_t b = 0; b < 256; b++) {
+    uint32_t crc = b;
+    for (int i = 0; i < 8; i++)
+      crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+    crc_table[b] = crc;
+  }
+  zeros_table(crc_long, CRC_LONG);
+  zeros_table(crc_short, CRC_SHORT);
+#if defined(__x86_64__)
+  crc_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+  atomic_store_explicit(&crc_ready, true, memory_order_release);
+}
+
+#if defined(__x86_64__)
+static inline uint64_t read64(const uint8_t *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+// three independent crc32 chains over three neighbouring blocks, joined by
+// moving the first over the second and that over the third
+__attribute__((target("sse4.2"))) static uint32_t
+crc_hardware3(uint32_t crc, const uint8_t *p, size_t length) {
+  uint64_t crc0 = crc;
+  while (length >= 3 * CRC_LONG) {
+    uint64_t crc1 = 0, crc2 = 0;
+    for (const uint8_t *end = p + CRC_LONG; p < end; p += 8) {
+      crc0 = _mm_crc32_u64(crc0, read64(p));
+      crc1 = _mm_crc32_u64(crc1, read64(p + CRC_LONG));
+      crc2 = _mm_crc32_u64(crc2, read64(p + 2 * CRC_LONG));
+    }
+    crc0 = shift(crc_long, crc0) ^ crc1;
+    crc0 = shift(crc_long, crc0) ^ crc2;
+    p += 2 * CRC_LONG;
+    length -= 3 * CRC_LONG;
+  }
+  while (length >= 3 * CRC_SHORT) {
+    uint64_t crc1 = 0, crc2 = 0;
+    for (const uint8_t *end = p + CRC_SHORT; p < end; p += 8) {
+      crc0 = _mm_crc32_u64(crc0, read64(p));
+      crc1 = _mm_crc32_u64(crc1, read64(p + CRC_SHORT));
+      crc2 = _mm_crc32_u64(crc2, read64(p + 2 * CRC_SHORT));
+    }
+    crc0 = shift(crc_short, crc0) ^ crc1;
+    crc0 = shift(crc_short, crc0) ^ crc2;
+    p += 2 * CRC_SHORT;
+    length -= 3 * CRC_SHORT;
+  }
+  for (; length >= 8; length -= 8, p += 8)
+    crc0 = _mm_crc32_u64(crc0, read64(p));
+  crc = (uint32_t)crc0;
+  for (; length > 0; length--)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+static inline void crc_setup(void) {
+  if (!atomic_load_explicit(&crc_ready, memory_order_acquire))
+    pthread_once(&crc_once, crc_init);
+}
+// state in, state out, crc_setup() done
+static inline uint32_t crc_update(uint32_t crc, const uint8_t *p,
+                                  size_t length) {
+#if defined(__x86_64__)
+  if (crc_hardware)
+    return crc_hardware3(crc, p, length);
+#endif
+  return crc_software(crc, p, length);
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t length) {
+  crc_setup();
+  return ~crc_update(~crc, data, length);
+}
+
+// the payload first, then the header: a reply that keeps the payload goes
+// on from the payload crc of the request and only checksums its new header.
+// both return crc states (not inverted), header_crc() the checksum
+static uint32_t payload_crc(const uint8_t *data, size_t payload) {
+  crc_setup();
+  return crc_update(~0u, data + sizeof(proto_header), payload);
+}
+static uint32_t header_crc(uint32_t crc, const uint8_t *data) {
+  return ~crc_update(crc, data, PROTO_CHECKED_BYTES);
+}
+
+static proto_header *parse(uint8_t *data, size_t length, proto_status *status,
+                           uint32_t *crc) {
+  proto_header *h = (proto_header *)data;
+  if (length < sizeof(proto_header)) {
+    *status = PROTO_TOO_SHORT;
+    return NULL;
+  }
+  if (ntohs(h->magic) != PROTO_MAGIC || h->version != PROTO_VERSION) {
+    *status = PROTO_BAD_MAGIC;
+    return NULL;
+  }
+  size_t payload = ntohs(h->length);
+  if (payload != length - sizeof(proto_header)) {
+    *status = PROTO_BAD_LENGTH;
+    return NULL;
+  }
+  *crc = payload_crc(data, payload);
+  if (ntohl(h->checksum) != header_crc(*crc, data)) {
+    *status = PROTO_BAD_CHECKSUM;
+    return NULL;
+  }
+  *status = PROTO_OK;
+  return h;
+}
+
+proto_header *proto_parse(uint8_t *data, size_t length, proto_status *status) {
+  uint32_t crc;
+  return parse(data, length, status, &crc);
+}
+
+bool proto_window_accept(uint32_t *highest, uint64_t *window, uint32_t seq) {
+  if (*window == 0) {
+    *highest = seq;
+    *window = 1;
+    return true;
+  }
+  // signed distance, right across a wrap of the sequence numbers
+  int32_t ahead = (int32_t)(seq - *highest);
+  if (ahead > 0) {
+    *window = ahead >= PROTO_WINDOW ? 1 : (*window << ahead) | 1;
+    *highest = seq;
+    return true;
+  }
+  uint32_t behind = -(uint32_t)ahead;
+  if (behind >= PROTO_WINDOW)
+    return false;
+  uint64_t bit = 1ull << behind;
+  if (*window & bit)
+    return false;
+  *window |= bit;
+  return true;
+}
+
+proto_status proto_stream_receive(proto_stream *stream, uint32_t seq) {
+  int32_t ahead = (int32_t)(seq - stream->next);
+  if (ahead < 0)
+    return PROTO_DUPLICATE;
+  if (ahead > PROTO_ACK_WINDOW)
+    return PROTO_OUT_OF_WINDOW;
+  if (ahead > 0) {
+    uint64_t bit = 1ull << (ahead - 1);
+    if (stream->sack & bit)
+      return PROTO_DUPLICATE;
+    stream->sack |= bit;
+    return PROTO_OK;
+  }
+  // the gap is filled: move next past everything that is there now. bit 0
+  // is next + 1 before the shift
+  stream->next++;
+  while (stream->sack & 1) {
+    stream->sack >>= 1;
+    stream->next++;
+  }
+  stream->sack >>= 1;
+  return PROTO_OK;
+}
+
+static size_t finish(uint8_t *data, uint8_t type, uint32_t sequence,
+                     size_t length, uint32_t crc) {
+  proto_header *h = (proto_header *)data;
+  h->magic = htons(PROTO_MAGIC);
+  h->version = PROTO_VERSION;
+  h->type = type;
+  h->sequence = htonl(sequence);
+  h->length = htons(length);
+  h->reserved = 0;
+  h->checksum = htonl(header_crc(crc, data));
+  return sizeof(proto_header) + length;
+}
+
+size_t proto_finish(uint8_t *data, uint8_t type, uint32_t sequence,
+                    size_t length) {
+  return finish(data, type, sequence, length, payload_crc(data, length));
+}
+
+bool proto_handle(uint8_t *data, size_t *length, size_t capacity,
+                  proto_peer *peer, proto_status *status) {
+  uint32_t crc;
+  proto_header *h = parse(data, *length, status, &crc);
+  if (h == NULL)
+    return false;
+  uint8_t type = h->type;
+  uint32_t sequence = ntohl(h->sequence);
+  if (type == PROTO_DATA && peer != NULL) {
+    // retransmissions are expected here, the stream itself tells duplicates
+    *status = proto_stream_receive(&peer->stream, sequence);
+    if (*status == PROTO_OUT_OF_WINDOW)
+      return false;
+    proto_ack *ack = (proto_ack *)(data + sizeof(proto_header));
+    ack->next = htonl(peer->stream.next);
+    ack->reserved = 0;
+    ack->sack = htobe64(peer->stream.sack);
+    *length = proto_finish(data, type | PROTO_REPLY, sequence, sizeof(*ack));
+    return true;
+  }
+  if (type != PROTO_ECHO && type != PROTO_PING && type != PROTO_STATS) {
+    *status = PROTO_BAD_TYPE;
+    return false;
+  }
+  if (peer != NULL &&
+      !proto_window_accept(&peer->seq_highest, &peer->seq_window, sequence)) {
+    *status = PROTO_DUPLICATE;
+    return false;
+  }
+  size_t payload = ntohs(h->length);
+  if (type == PROTO_PING) {
+    payload = 0;
+    crc = payload_crc(data, 0);
+  } else if (type == PROTO_STATS) {
+    stats_snapshot snapshot;
+    stats_collect(&snapshot);
+    size_t room = capacity - sizeof(proto_header);
+    if (room > UINT16_MAX)
+      room = UINT16_MAX;
+    payload = stats_format(&snapshot, (char *)data + sizeof(proto_header),
+                           room);
+    crc = payload_crc(data, payload);
+  }
+  *length = finish(data, type | PROTO_REPLY, sequence, payload, crc);
+  return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+// framed packets: a proto_header, then length bytes of payload. all header
+// fields are big endian
+#define PROTO_MAGIC 0x5550 // "UP"
+#define PROTO_VERSION 1
+// message types, the reply has PROTO_REPLY set in type
+#define PROTO_ECHO 1  // payload comes back unchanged
+#define PROTO_PING 2  // empty reply, only the sequence number comes back
+#define PROTO_STATS 3 // reply payload is the stats text (stats_format())
+#define PROTO_DATA 4  // reliable stream (reliable.h), the reply is a proto_ack
+#define PROTO_REPLY 0x80
+// sequence numbers a client may be behind its highest one and still not be
+// taken for a duplicate
+#define PROTO_WINDOW 64
+// how far past the first missing PROTO_DATA packet a receiver keeps track,
+// a sender never has more in flight
+#define PROTO_ACK_WINDOW 64
+
+// read and written in place in the packet buffer (no copy). checksum is
+// CRC32C over the payload and then the first 12 header bytes: it never
+// covers itself, and an echo reply only checksums its new header. needs 4
+// byte alignment, PacketBuffer.data has it
+typedef struct {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t type;
+  uint32_t sequence;
+  uint16_t length;
+  uint16_t reserved;
+  uint32_t checksum;
+} proto_header;
+_Static_assert(sizeof(proto_header) == 16, "proto_header is 16 bytes");
+#define PROTO_CHECKED_BYTES 12
+
+// payload of the reply to PROTO_DATA (big endian): every packet before next
+// arrived, and bit i of sack is set if next + 1 + i did. the header carries
+// the sequence number of the packet that is answered
+typedef struct {
+  uint32_t next;
+  uint32_t reserved;
+  uint64_t sack;
+} proto_ack;
+
+// receiving end of a PROTO_DATA stream, same meaning as proto_ack. streams
+// start at sequence number 0
+typedef struct {
+  uint32_t next;
+  uint64_t sack;
+} proto_stream;
+
+// what the server keeps per client (client_entry), zeroed for a new one
+typedef struct {
+  uint32_t seq_highest; // duplicate window, proto_window_accept()
+  uint64_t seq_window;
+  proto_stream stream;
+} proto_peer;
+
+typedef enum {
+  PROTO_OK,
+  PROTO_TOO_SHORT,  // less than a header
+  PROTO_BAD_MAGIC,  // not a framed packet (or another version)
+  PROTO_BAD_LENGTH, // length does not match the datagram
+  PROTO_BAD_CHECKSUM,
+  PROTO_BAD_TYPE,
+  PROTO_DUPLICATE,
+  PROTO_OUT_OF_WINDOW, // PROTO_DATA too far ahead of the stream
+} proto_status;
+
+// zlib style: crc32c(0, ...) starts, crc32c(crc, ...) continues. SSE4.2
+// crc32 on three interleaved streams when the cpu has it (one stream is
+// bound by the instruction latency, three fill the pipeline), a table
+// otherwise
+uint32_t crc32c(uint32_t crc, const void *data, size_t length);
+
+// the header of a datagram of length bytes if it is a valid framed packet
+// (magic, version, length, checksum), NULL otherwise with *status saying
+// why. no copy: the result points into data
+proto_header *proto_parse(uint8_t *data, size_t length, proto_status *status);
+// sliding window duplicate check, RFC 4303 style: *highest is the highest
+// sequence number seen, bit i of *window is set if highest - i was seen.
+// true (and marks seq) the first time seq is seen, false for a duplicate or
+// a number more than PROTO_WINDOW - 1 behind. window 0 is a fresh client.
+// sequence numbers may wrap around
+bool proto_window_accept(uint32_t *highest, uint64_t *window, uint32_t seq);
+// PROTO_DATA seq arrived: PROTO_OK if it is new, PROTO_DUPLICATE if it was
+// there before, PROTO_OUT_OF_WINDOW if it is more than PROTO_ACK_WINDOW past
+// next (not taken)
+proto_status proto_stream_receive(proto_stream *stream, uint32_t seq);
+// writes header and checksum in front of the length bytes of payload that
+// are already at data + sizeof(proto_header), returns the datagram length
+size_t proto_finish(uint8_t *data, uint8_t type, uint32_t sequence,
+                    size_t length);
+// the server side: parse, duplicate check against the window of peer (if
+// not NULL), then the reply built in place over the request and *length set
+// to it. false if the packet is dropped, *status says why. PROTO_DATA needs
+// a peer and is answered with a proto_ack even when it is a duplicate (its
+// first ack may have been lost), *status is PROTO_DUPLICATE then
+bool proto_handle(uint8_t *data, size_t *length, size_t capacity,
+                  proto_peer *peer, proto_status *status);
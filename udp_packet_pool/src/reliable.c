@@ -0,0 +1,273 @@
+#include "reliable.h"
+#include <arpa/inet.h>
+#include <endian.h>
+#include <stdlib.h>
+#include <string.h>
+_Static_assert((REL_RING & (REL_RING - 1)) == 0, "REL_RING power of two");
+_Static_assert(REL_RING > PROTO_ACK_WINDOW, "a slot for the whole window");
+
+rel_sender *rel_sender_create(void) {
+  rel_sender *s = malloc(sizeof(rel_sender));
+  if (s == NULL)
+    return NULL;
+  memset(s, 0, sizeof(*s));
+  // one buffer per slot, rel_send() never finds the pool empty
+  s->pool = freelist_pool_create(sizeof(PacketBuffer), REL_RING);
+  if (s->pool == NULL) {
+    free(s);
+    return NULL;
+  }
+  s->cwnd = 4;
+  s->ssthresh = REL_RING;
+  s->rto_ns = REL_INITIAL_RTO_NS;
+  histogram_reset(&s->latency);
+  return s;
+}
+
+void rel_sender_destroy(rel_sender *s) {
+  if (s == NULL)
+    return;
+  freelist_pool_destroy(s->pool);
+  free(s);
+}
+
+static inline rel_slot *slot_of(rel_sender *s, uint32_t seq) {
+  rel_slot *slot = &s->slots[seq & (REL_RING - 1)];
+  return slot->packet != NULL && slot->seq == seq ? slot : NULL;
+}
+
+// a deadline goes in the slot of the first tick at or after it, so the
+// tick that finds it is never early. further out than the wheel turns it
+// waits in its slot and is looked at once per turn. the cursor starts at
+// the first send: started at its deadline, rel_poll() would look at no
+// slot before the initial RTO even after the RTO got shorter
+static void wheel_insert(rel_sender *s, rel_slot *slot, uint64_t now_ns,
+                         uint64_t deadline) {
+  uint64_t tick = (deadline + REL_TICK_NS - 1) / REL_TICK_NS;
+  if (s->wheel_tick == 0)
+    s->wheel_tick = now_ns / REL_TICK_NS;
+  if (tick < s->wheel_tick)
+    tick = s->wheel_tick;
+  slot->deadline_ns = deadline;
+  slot->wheel_index = tick % REL_WHEEL_SLOTS;
+  slot->wheel_prev = NULL;
+  slot->wheel_next = s->wheel[slot->wheel_index];
+  if (slot->wheel_next != NULL)
+    slot->wheel_next->wheel_prev = slot;
+  s->wheel[slot->wheel_index] = slot;
+  slot->timed = true;
+}
+
+static void wheel_remove(rel_sender *s, rel_slot *slot) {
+  if (!slot->timed)
+    return;
+  if (slot->wheel_prev != NULL)
+    slot->wheel_prev->wheel_next = slot->wheel_next;
+  else
+    s->wheel[slot->wheel_index] = slot->wheel_next;
+  if (slot->wheel_next != NULL)
+    slot->wheel_next->wheel_prev = slot->wheel_prev;
+  slot->timed = false;
+}
+
+PacketBuffer *rel_send(rel_sender *s, const void *payload, size_t length,
+                       uint64_t now_ns) {
+  uint32_t outstanding = s->next_seq - s->una;
+  // the receiver takes up to PROTO_ACK_WINDOW past its next, which is at
+  // least una
+  if (s->pipe >= s->cwnd || outstanding > PROTO_ACK_WINDOW ||
+      length > PACKET_SIZE - sizeof(proto_header))
+    return NULL;
+  PacketBuffer *pb = freelist_pool_alloc(s->pool);
+  if (pb == NULL)
+    return NULL;
+  memcpy(pb->data + sizeof(proto_header), payload, length);
+  pb->length = proto_finish(pb->data, PROTO_DATA, s->next_seq, length);
+  rel_slot *slot = &s->slots[s->next_seq & (REL_RING - 1)];
+  slot->packet = pb;
+  slot->seq = s->next_seq;
+  slot->transmissions = 1;
+  slot->sacked = false;
+  slot->queued = false;
+  slot->first_ns = now_ns;
+  slot->sent_ns = now_ns;
+  wheel_insert(s, slot, now_ns, now_ns + s->rto_ns);
+  s->next_seq++;
+  s->pipe++;
+  s->sent++;
+  return pb;
+}
+
+// RFC 6298
+static void rtt_sample(rel_sender *s, uint64_t rtt) {
+  if (s->srtt_ns == 0) {
+    s->srtt_ns = rtt;
+    s->rttvar_ns = rtt / 2;
+  } else {
+    uint64_t diff = s->srtt_ns > rtt ? s->srtt_ns - rtt : rtt - s->srtt_ns;
+    s->rttvar_ns = (3 * s->rttvar_ns + diff) / 4;
+    s->srtt_ns = (7 * s->srtt_ns + rtt) / 8;
+  }
+  uint64_t var = 4 * s->rttvar_ns;
+  s->rto_ns = s->srtt_ns + (var > REL_TICK_NS ? var : REL_TICK_NS);
+  if (s->rto_ns < REL_MIN_RTO_NS)
+    s->rto_ns = REL_MIN_RTO_NS;
+  if (s->rto_ns > REL_MAX_RTO_NS)
+    s->rto_ns = REL_MAX_RTO_NS;
+}
+
+// the receiver has it (acked or sacked), counted once
+static void deliver(rel_sender *s, rel_slot *slot, uint64_t now_ns) {
+  if (!slot->queued)
+    s->pipe--;
+  slot->queued = false;
+  wheel_remove(s, slot);
+  histogram_record(&s->latency, now_ns - slot->first_ns);
+  s->delivered++;
+  s->delivered_bytes += slot->packet->length - sizeof(proto_header);
+  // slow start: one packet more per ack, congestion avoidance: one per
+  // window. no growth while the loss is repaired
+  if (s->recovery)
+    return;
+  if (s->cwnd < s->ssthresh)
+    s->cwnd++;
+  else if (++s->acked >= s->cwnd) {
+    s->acked = 0;
+    s->cwnd++;
+  }
+  if (s->cwnd > REL_RING)
+    s->cwnd = REL_RING;
+}
+
+static void lost(rel_sender *s, rel_slot *slot) {
+  wheel_remove(s, slot);
+  slot->queued = true;
+  s->pipe--;
+}
+
+static void reduce(rel_sender *s) {
+  uint32_t flight = s->next_seq - s->una;
+  s->ssthresh = flight / 2 > 2 ? flight / 2 : 2;
+  s->acked = 0;
+}
+
+int rel_on_ack(rel_sender *s, uint8_t *data, size_t length, uint64_t now_ns) {
+  proto_status status;
+  proto_header *h = proto_parse(data, length, &status);
+  if (h == NULL || h->type != (PROTO_DATA | PROTO_REPLY) ||
+      ntohs(h->length) != sizeof(proto_ack))
+    return 0;
+  proto_ack *ack = (proto_ack *)(data + sizeof(proto_header));
+  uint32_t next = ntohl(ack->next);
+  uint64_t sack = be64toh(ack->sack);
+  uint32_t outstanding = s->next_seq - s->una;
+  if (next - s->una > outstanding)
+    return 0; // older than what we know, or not ours
+  // Karn: the time of a retransmitted packet could belong to any of its
+  // transmissions
+  rel_slot *answered = slot_of(s, ntohl(h->sequence));
+  if (answered != NULL && answered->transmissions == 1 && !answered->sacked)
+    rtt_sample(s, now_ns - answered->sent_ns);
+
+  int delivered = 0;
+  for (; s->una != next; s->una++) {
+    rel_slot *slot = slot_of(s, s->una);
+    if (!slot->sacked) {
+      deliver(s, slot, now_ns);
+      delivered++;
+    }
+    freelist_pool_free(s->pool, slot->packet);
+    slot->packet = NULL;
+  }
+  if (s->recovery && (int32_t)(s->una - s->recover) > 0)
+    s->recovery = false;
+  if (sack == 0)
+    return delivered;
+
+  for (uint64_t bits = sack; bits != 0; bits &= bits - 1) {
+    uint32_t seq = next + 1 + __builtin_ctzll(bits);
+    rel_slot *slot = slot_of(s, seq);
+    if (slot != NULL && !slot->sacked) {
+      slot->sacked = true;
+      deliver(s, slot, now_ns);
+      delivered++;
+    }
+  }
+  // RFC 6675: a hole with PROTO_DUPTHRESH sacked packets above it is lost.
+  // packets sent again are left to the timer
+  uint32_t highest = next + 1 + (63 - __builtin_clzll(sack));
+  int above = 0;
+  bool found = false;
+  for (uint32_t seq = highest; seq != next - 1; seq--) {
+    rel_slot *slot = slot_of(s, seq);
+    if (slot == NULL)
+      continue;
+    if (slot->sacked) {
+      above++;
+    } else if (above >= REL_DUPTHRESH && !slot->queued &&
+               slot->transmissions == 1) {
+      lost(s, slot);
+      s->fast_retransmits++;
+      found = true;
+    }
+  }
+  // one window reduction per loss event
+  if (found && !s->recovery) {
+    reduce(s);
+    s->cwnd = s->ssthresh;
+    s->recovery = true;
+    s->recover = s->next_seq - 1;
+  }
+  return delivered;
+}
+
+int rel_poll(rel_sender *s, uint64_t now_ns, PacketBuffer **out, int max) {
+  uint64_t now_tick = now_ns / REL_TICK_NS;
+  for (int ticks = 0; s->wheel_tick <= now_tick && ticks < REL_WHEEL_SLOTS;
+       ticks++, s->wheel_tick++) {
+    rel_slot *slot = s->wheel[s->wheel_tick % REL_WHEEL_SLOTS];
+    while (slot != NULL) {
+      rel_slot *next = slot->wheel_next;
+      if (slot->deadline_ns <= now_ns) {
+        // the oldest packet timing out is the RTO of RFC 6298: back off
+        // and start over from one packet. later packets have timers of
+        // their own, they are only sent again
+        if (slot->seq == s->una) {
+          reduce(s);
+          s->cwnd = 1;
+          s->recovery = false;
+          s->rto_ns = s->rto_ns * 2 < REL_MAX_RTO_NS ? s->rto_ns * 2
+                                                      : REL_MAX_RTO_NS;
+        }
+        lost(s, slot);
+        s->timeouts++;
+      }
+      slot = next;
+    }
+  }
+  // more than a turn went by: every slot was looked at once
+  if (s->wheel_tick <= now_tick)
+    s->wheel_tick = now_tick + 1;
+
+  // lost packets oldest first. the oldest always goes, even with a full
+  // window, or a window of one could wait forever
+  int count = 0;
+  for (uint32_t seq = s->una; seq != s->next_seq && count < max; seq++) {
+    rel_slot *slot = slot_of(s, seq);
+    if (slot == NULL || !slot->queued)
+      continue;
+    if (s->pipe >= s->cwnd && seq != s->una)
+      break;
+    slot->queued = false;
+    slot->transmissions++;
+    slot->sent_ns = now_ns;
+    wheel_insert(s, slot, now_ns, now_ns + s->rto_ns);
+    s->pipe++;
+    out[count++] = slot->packet;
+  }
+  return count;
+}
+
+uint64_t rel_next_timer(const rel_sender *s) {
+  return rel_idle(s) ? UINT64_MAX : s->wheel_tick * REL_TICK_NS;
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include "../../memory_pool/freelist.h"
+#include "histogram.h"
+#include "packet.h"
+#include "protocol.h"
+#include <stdbool.h>
+#include <stdint.h>
+// sending end of a PROTO_DATA stream (the receiving end is the server,
+// protocol.c). unacked packets stay in pool buffers indexed by sequence
+// number until the cumulative ack passes them, the SACK bits of every ack
+// mark what arrived out of order. a timer wheel holds the retransmission
+// timeout of every packet in flight, a packet with PROTO_DUPTHRESH sacked
+// packets after it is sent again without waiting for it (fast retransmit).
+// congestion window, slow start and recovery as in RFC 5681/6675, RTO as in
+// RFC 6298 (with Karn: no rtt sample from a retransmitted packet). nothing
+// is allocated after rel_sender_create(). one thread only
+#define REL_RING 128 // packets, a power of two above PROTO_ACK_WINDOW
+#define REL_WHEEL_SLOTS 256
+#define REL_TICK_NS 50000ull // wheel resolution
+// bounds of the RTO. the minimum is far below the 1 s of RFC 6298, this
+// runs on a LAN or loopback
+#define REL_MIN_RTO_NS 1000000ull
+#define REL_MAX_RTO_NS 1000000000ull
+#define REL_INITIAL_RTO_NS 50000000ull
+#define REL_DUPTHRESH 3
+
+typedef struct rel_slot {
+  PacketBuffer *packet; // NULL: free
+  uint32_t seq;
+  uint16_t transmissions;
+  bool sacked; // the receiver has it, the buffer goes with the cumulative ack
+  bool queued; // given up as lost, rel_poll() sends it again
+  bool timed;  // in the wheel
+  uint16_t wheel_index;
+  uint64_t first_ns; // first transmission, for the delivery latency
+  uint64_t sent_ns;  // last transmission, for the rtt sample
+  uint64_t deadline_ns;
+  struct rel_slot *wheel_prev;
+  struct rel_slot *wheel_next;
+} rel_slot;
+
+typedef struct {
+  FreeListPool *pool;
+  rel_slot slots[REL_RING]; // slots[seq % REL_RING]
+  uint32_t una;             // oldest packet not acked cumulatively
+  uint32_t next_seq;        // next new packet
+  // packets in flight: sent and neither sacked, acked nor given up as lost
+  uint32_t pipe;
+  // congestion window in packets. acked counts packets toward the next
+  // increment in congestion avoidance
+  uint32_t cwnd;
+  uint32_t ssthresh;
+  uint32_t acked;
+  bool recovery;    // until una passes recover
+  uint32_t recover; // highest sequence number sent when recovery started
+  uint64_t srtt_ns;
+  uint64_t rttvar_ns;
+  uint64_t rto_ns;
+  rel_slot *wheel[REL_WHEEL_SLOTS];
+  uint64_t wheel_tick; // next tick rel_poll() looks at
+  // counters
+  uint64_t sent; // packets, first transmissions only
+  uint64_t delivered;
+  uint64_t delivered_bytes; // payload
+  uint64_t fast_retransmits;
+  uint64_t timeouts;
+  histogram latency; // first transmission -> acked or sacked
+} rel_sender;
+
+// NULL if out of memory
+rel_sender *rel_sender_create(void);
+void rel_sender_destroy(rel_sender *s);
+// frames length bytes of payload as the next PROTO_DATA packet in a buffer
+// the sender keeps until it is acked, to be sent by the caller right away.
+// NULL if the congestion window or the receiver window is full
+PacketBuffer *rel_send(rel_sender *s, const void *payload, size_t length,
+                       uint64_t now_ns);
+// a datagram from the receiver, ignored unless it is a valid reply to
+// PROTO_DATA. returns how many packets it delivered (acked or sacked)
+int rel_on_ack(rel_sender *s, uint8_t *data, size_t length, uint64_t now_ns);
+// runs the timers up to now and fills out with up to max packets to send
+// again (timeouts and fast retransmits), returns how many. the buffers stay
+// the sender's
+int rel_poll(rel_sender *s, uint64_t now_ns, PacketBuffer **out, int max);
+// when rel_poll() has something to do next, UINT64_MAX if nothing is in
+// flight
+uint64_t rel_next_timer(const rel_sender *s);
+// everything sent so far is acked
+static inline bool rel_idle(const rel_sender *s) {
+  return s->una == s->next_seq;
+}
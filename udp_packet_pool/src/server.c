@@ -1,10 +1,44 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include "../../bench/trace.h"
+#include "../../memory_pool/freelist.h"
+#include "packet.h"
+#include "protocol.h"
+#include "stats.h"
 #include <errno.h>
 #include <netdb.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#define SERVER_BATCH 64
+_Static_assert(SERVER_BATCH <= CLIENT_ADMIT_BATCH, "one client_admit_batch()");
+
+volatile sig_atomic_t server_running = 1;
+void server_stop(void) { server_running = 0; }
+client_table *server_clients = NULL;
+void server_set_clients(client_table *clients) { server_clients = clients; }
+bool server_framed = false;
+void server_set_framed(bool framed) { server_framed = framed; }
+
+bool server_handle(uint8_t *data, size_t *length, size_t capacity,
+                   client_entry *client, thread_stats *stats) {
+  if (!server_framed) {
+    stats_handle_request(data, length, capacity);
+    return true;
+  }
+  proto_status status;
+  bool reply = proto_handle(data, length, capacity,
+                            client ? &client->peer : NULL, &status);
+  // a duplicate PROTO_DATA packet is still acked
+  if (status == PROTO_DUPLICATE)
+    stats_add(&stats->duplicates, 1);
+  else if (!reply)
+    stats_add(&stats->invalid, 1);
+  return reply;
+}
 /* ERSTELLT SOCKET, BINDET IHN, GIBT DEN SOCKET FILE DESCRIPOR ZURÜCK*/
 int create_udp_socket(char *port) {
 
@@ -33,24 +67,149 @@ int create_udp_socket(char *port) {
   freeaddrinfo(res);
   return socketfd;
 }
-/* NIMMT DEN SOCKET FD UND LÄUFT IN EINER ENDLOSSCHLEIFE*/
-void server_loop(int socketfd) {
-  // change to memory pool in the future
-  void *buf = malloc(1024);
-  while (1) {
+/* NIMMT DEN SOCKET FD UND LÄUFT BIS server_stop()*/
+// one recvfrom + one sendto per packet. nothing is printed per packet, the
+// counters are in stats.h (send "stats" to see them)
+void server_loop(int socketfd, io_counters *counters) {
+  thread_stats *stats = stats_register();
+  // aligned for the in place proto_header
+  _Alignas(8) uint8_t buf[PACKET_SIZE];
+  server_running = 1;
+  while (server_running) {
     // ich brauhce *socketlen für den letzten parameter
     struct sockaddr_storage sender;
     socklen_t sender_len = sizeof(sender);
-    ssize_t bytes_received = recvfrom(socketfd, buf, 1024, 0,
+    ssize_t bytes_received = recvfrom(socketfd, buf, sizeof(buf), 0,
                                       (struct sockaddr *)&sender, &sender_len);
+    counters->syscalls++;
     if (bytes_received == -1) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, " %d : %s \n", errno, strerror(errno));
+      break;
+    }
+    uint64_t start = stats_now_ns();
+    stats_rx(stats, 1, bytes_received);
+    stats_batch(stats, 1);
+    client_entry *client = NULL;
+    if (server_clients != NULL) {
+      client = client_admit(server_clients, (struct sockaddr *)&sender,
+                            sender_len, bytes_received, start);
+      if (client == NULL) {
+        stats_add(&stats->throttled, 1);
+        continue;
+      }
+    }
+    size_t length = bytes_received;
+    if (!server_handle(buf, &length, sizeof(buf), client, stats))
+      continue;
+    if (sendto(socketfd, buf, length, 0, (struct sockaddr *)&sender,
+               sender_len) == -1) {
+      stats_add(&stats->drops, 1);
+    } else {
+      stats_tx(stats, 1, length);
+      counters->packets++;
+    }
+    counters->syscalls++;
+    stats_processing(stats, stats_now_ns() - start, 1);
+  }
+}
+// one recvmmsg fills up to SERVER_BATCH buffers (MSG_WAITFORONE: returns as
+// soon as one packet is there), one sendmmsg echoes all of them
+void server_loop_batched(int socketfd, io_counters *counters) {
+  thread_stats *stats = stats_register();
+  FreeListPool *pool =
+      freelist_pool_create(sizeof(PacketBuffer), SERVER_BATCH);
+  PacketBuffer *packets[SERVER_BATCH];
+  struct mmsghdr msgs[SERVER_BATCH];
+  struct iovec iovs[SERVER_BATCH];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < SERVER_BATCH; i++) {
+    packets[i] = freelist_pool_alloc(pool);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  server_running = 1;
+  while (server_running) {
+    for (int i = 0; i < SERVER_BATCH; i++) {
+      iovs[i].iov_base = packets[i]->data;
+      iovs[i].iov_len = PACKET_SIZE;
+      msgs[i].msg_hdr.msg_name = &packets[i]->sender;
+      msgs[i].msg_hdr.msg_namelen = sizeof(packets[i]->sender);
+    }
+    int received =
+        recvmmsg(socketfd, msgs, SERVER_BATCH, MSG_WAITFORONE, NULL);
+    counters->syscalls++;
+    if (received == -1) {
+      if (errno == EINTR)
+        continue;
       fprintf(stderr, " %d : %s \n", errno, strerror(errno));
-      exit(1);
+      break;
+    }
+    TRACE_BEGIN("batch");
+    TRACE_COUNTER("batch size", received);
+    uint64_t start = stats_now_ns();
+    uint64_t bytes = 0;
+    for (int i = 0; i < received; i++) {
+      packets[i]->length = msgs[i].msg_len;
+      packets[i]->sender_len = msgs[i].msg_hdr.msg_namelen;
+      bytes += msgs[i].msg_len;
+    }
+    stats_rx(stats, received, bytes);
+    stats_batch(stats, received);
+    client_entry *admitted[SERVER_BATCH] = {NULL};
+    if (server_clients != NULL) {
+      const struct sockaddr *addrs[SERVER_BATCH];
+      socklen_t addr_lens[SERVER_BATCH];
+      size_t lengths[SERVER_BATCH];
+      for (int i = 0; i < received; i++) {
+        addrs[i] = (struct sockaddr *)&packets[i]->sender;
+        addr_lens[i] = packets[i]->sender_len;
+        lengths[i] = packets[i]->length;
+      }
+      client_admit_batch(server_clients, addrs, addr_lens, lengths, received,
+                         start, admitted);
+    }
+    // refused and dropped packets move behind the ones to echo
+    int echo = 0;
+    for (int i = 0; i < received; i++) {
+      PacketBuffer *pb = packets[i];
+      if (server_clients != NULL && admitted[i] == NULL) {
+        stats_add(&stats->throttled, 1);
+        continue;
+      }
+      if (!server_handle(pb->data, &pb->length, PACKET_SIZE, admitted[i],
+                         stats))
+        continue;
+      packets[i] = packets[echo];
+      packets[echo] = pb;
+      iovs[echo].iov_base = pb->data;
+      iovs[echo].iov_len = pb->length;
+      msgs[echo].msg_hdr.msg_name = &pb->sender;
+      msgs[echo].msg_hdr.msg_namelen = pb->sender_len;
+      echo++;
+    }
+    // a full socket send buffer can take less than all, the rest is dropped
+    // on a real error like a plain sendto() would
+    for (int sent = 0; sent < echo;) {
+      int n = sendmmsg(socketfd, msgs + sent, echo - sent, 0);
+      counters->syscalls++;
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n == -1) {
+        stats_add(&stats->drops, echo - sent);
+        break;
+      }
+      for (int i = sent; i < sent + n; i++)
+        stats_tx(stats, 1, iovs[i].iov_len);
+      sent += n;
+      counters->packets += n;
     }
-    buf[bytes_received] = '\0';
-    printf("received  %zu bytes: %s \n", bytes_received, (char *)buf);
-    sendto(socketfd, buf, bytes_received, 0, (struct sockaddr *)&sender,
-           sender_len);
+    // every packet of the batch waited for the whole batch
+    stats_processing(stats, stats_now_ns() - start, received);
+    TRACE_END("batch");
   }
-  free(buf);
+  for (int i = 0; i < SERVER_BATCH; i++)
+    freelist_pool_free(pool, packets[i]);
+  freelist_pool_destroy(pool);
 }
@@ -1,4 +1,45 @@
 #pragma once
+#include "client_table.h"
+#include "stats.h"
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// what a loop did, for the benchmarks
+typedef struct {
+  uint64_t packets;  // echoed
+  uint64_t syscalls; // recv/send/io_uring_enter calls
+} io_counters;
 
 int create_udp_socket(char *port);
-void server_loop(int socketfd);
+// every loop counts into its own thread_stats (stats.h) and answers
+// through server_handle()
+void server_loop(int socketfd, io_counters *counters);
+// recvmmsg/sendmmsg on pool buffers, up to SERVER_BATCH packets per call
+void server_loop_batched(int socketfd, io_counters *counters);
+// io_uring backend (server_uring.c): one multishot recvmsg into a provided
+// buffer ring made of pool buffers, the echoes of one completion drain go
+// out with the next io_uring_enter. false with errno set if io_uring (or
+// the buffer ring) is not available
+bool server_loop_uring(int socketfd, io_counters *counters);
+// the loops run while this is set and set it when they start.
+// server_stop() clears it (signal safe), a loop returns after the packet or
+// completion it is waiting for
+extern volatile sig_atomic_t server_running;
+void server_stop(void);
+// per client accounting and rate limit for the loops started after this
+// call (NULL: off, the default). the receiving thread runs client_admit()
+// for every packet, refused packets are counted as throttled and not echoed
+void server_set_clients(client_table *clients);
+extern client_table *server_clients;
+// framed protocol (protocol.h) for the loops started after this call
+// (false: plain echo, the default). packets that are not valid framed
+// packets are counted as invalid and dropped, with a client table each
+// client also gets a duplicate window and a PROTO_DATA stream
+void server_set_framed(bool framed);
+extern bool server_framed;
+// what every loop does with a packet it admitted: the framed protocol or
+// echo/STATS_REQUEST, the reply is built in place. client may be NULL (no
+// duplicate check). false if the packet is dropped, counted in stats
+bool server_handle(uint8_t *data, size_t *length, size_t capacity,
+                   client_entry *client, thread_stats *stats);
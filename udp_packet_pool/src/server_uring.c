@@ -0,0 +1,224 @@
+#include "../../memory_pool/freelist.h"
+#include "packet.h"
+#include "server.h"
+#include "stats.h"
+#include "uring.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define URING_ENTRIES 256
+// every pool buffer is a provided buffer, a power of two for the ring
+#define URING_BUFFERS 1024
+// multishot recvmsg puts io_uring_recvmsg_out and msg_namelen bytes of
+// sender address in front of the payload, the buffer starts that far in
+// front of PacketBuffer.data (inside the headroom)
+#define RECV_NAME_LEN sizeof(struct sockaddr_in6)
+#define RECV_PREFIX (sizeof(struct io_uring_recvmsg_out) + RECV_NAME_LEN)
+#define RECV_USER_DATA UINT64_MAX
+// one io_uring_enter waits for the pending sends plus this many packets
+// (or URING_WAIT_NS), like recvmmsg returning a whole batch
+#define URING_WAIT_BATCH 32
+#define URING_WAIT_NS 50000
+
+_Static_assert(RECV_PREFIX <= PACKET_HEADROOM, "headroom too small");
+
+// a sendmsg reads its msghdr and iovec until it completes, one per buffer
+typedef struct {
+  struct msghdr msg;
+  struct iovec iov;
+} send_slot;
+
+// hands a buffer (back) to the kernel, no syscall
+static void give_buffer(uring *ring, PacketBuffer *base, PacketBuffer *pb) {
+  uring_buf_ring_add(ring, pb->data - RECV_PREFIX, RECV_PREFIX + PACKET_SIZE,
+                     pb - base);
+}
+static struct io_uring_sqe *next_sqe(uring *ring, io_counters *counters) {
+  struct io_uring_sqe *sqe = uring_get_sqe(ring);
+  if (sqe == NULL) {
+    // ring full: push what we have, do not wait
+    uring_submit(ring, 0);
+    counters->syscalls++;
+    sqe = uring_get_sqe(ring);
+  }
+  return sqe;
+}
+// false if the submission queue stays full
+static bool arm_recv(uring *ring, int socketfd, struct msghdr *recv_msg,
+                     io_counters *counters) {
+  struct io_uring_sqe *sqe = next_sqe(ring, counters);
+  if (sqe == NULL)
+    return false;
+  sqe->opcode = IORING_OP_RECVMSG;
+  sqe->fd = socketfd;
+  sqe->addr = (uint64_t)(uintptr_t)recv_msg;
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = RECV_USER_DATA;
+  return true;
+}
+
+bool server_loop_uring(int socketfd, io_counters *counters) {
+  uring ring;
+  thread_stats *stats = stats_register();
+  if (!uring_init(&ring, URING_ENTRIES))
+    return false;
+  if (!uring_setup_buf_ring(&ring, URING_BUFFERS)) {
+    int saved = errno;
+    uring_destroy(&ring);
+    errno = saved;
+    return false;
+  }
+  FreeListPool *pool =
+      freelist_pool_create(sizeof(PacketBuffer), URING_BUFFERS);
+  send_slot *slots = calloc(URING_BUFFERS, sizeof(send_slot));
+  if (pool == NULL || slots == NULL) {
+    uring_destroy(&ring);
+    free(slots);
+    if (pool != NULL)
+      freelist_pool_destroy(pool);
+    errno = ENOMEM;
+    return false;
+  }
+  PacketBuffer *base = pool->memory;
+  // the buffers stay allocated for the whole loop, they belong to the
+  // kernel until a packet arrives and again after its echo went out
+  for (int i = 0; i < URING_BUFFERS; i++)
+    give_buffer(&ring, base, freelist_pool_alloc(pool));
+  uring_buf_ring_publish(&ring);
+  struct msghdr recv_msg;
+  memset(&recv_msg, 0, sizeof(recv_msg));
+  recv_msg.msg_namelen = RECV_NAME_LEN;
+
+  bool armed = false, starved = false, failed = false;
+  unsigned inflight = 0; // sends not completed yet
+  server_running = 1;
+  while (server_running && !failed) {
+    if (!armed && !starved) {
+      if (!arm_recv(&ring, socketfd, &recv_msg, counters)) {
+        fprintf(stderr, "io_uring: submission queue full\n");
+        break;
+      }
+      armed = true;
+    }
+    // sends of the last drain + rearm go in. a single completion is not
+    // worth the syscall: the sends complete inline, wait for them and the
+    // next batch of packets. ETIME: fewer arrived, handle what is there
+    unsigned wait_nr = inflight + (armed ? URING_WAIT_BATCH : 0);
+    if (wait_nr == 0)
+      wait_nr = 1;
+    if (wait_nr > URING_ENTRIES)
+      wait_nr = URING_ENTRIES;
+    if (uring_submit_wait(&ring, wait_nr, URING_WAIT_NS) == -1 &&
+        errno != EINTR && errno != EBUSY && errno != ETIME) {
+      fprintf(stderr, " %d : %s \n", errno, strerror(errno));
+      break;
+    }
+    counters->syscalls++;
+    unsigned seen = 0, received = 0;
+    bool returned = false;
+    uint64_t now = stats_now_ns();
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&ring, seen)) != NULL) {
+      seen++;
+      if (cqe->user_data != RECV_USER_DATA) {
+        // echo sent (or failed, UDP drops it either way)
+        PacketBuffer *pb = base + cqe->user_data;
+        if (cqe->res < 0) {
+          stats_add(&stats->drops, 1);
+        } else {
+          stats_tx(stats, 1, cqe->res);
+          counters->packets++;
+        }
+        stats_processing(stats, now - pb->timestamp_ns, 1);
+        give_buffer(&ring, base, pb);
+        returned = true;
+        inflight--;
+        continue;
+      }
+      if (!(cqe->flags & IORING_CQE_F_MORE))
+        armed = false;
+      if (cqe->res == -ENOBUFS) {
+        // every buffer is waiting for its send, rearm once one is back
+        starved = true;
+        stats_add(&stats->pool_exhausted, 1);
+        continue;
+      }
+      if (cqe->res < 0 || !(cqe->flags & IORING_CQE_F_BUFFER))
+        continue;
+      uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      PacketBuffer *pb = base + bid;
+      struct io_uring_recvmsg_out *out =
+          (struct io_uring_recvmsg_out *)(pb->data - RECV_PREFIX);
+      pb->length = out->payloadlen < PACKET_SIZE ? out->payloadlen
+                                                 : PACKET_SIZE;
+      pb->sender_len =
+          out->namelen < RECV_NAME_LEN ? out->namelen : RECV_NAME_LEN;
+      memcpy(&pb->sender, out + 1, pb->sender_len);
+      pb->timestamp_ns = now;
+      received++;
+      stats_rx(stats, 1, pb->length);
+      client_entry *client = NULL;
+      if (server_clients != NULL) {
+        client = client_admit(server_clients, (struct sockaddr *)&pb->sender,
+                              pb->sender_len, pb->length, now);
+        if (client == NULL)
+          stats_add(&stats->throttled, 1);
+      }
+      if ((server_clients != NULL && client == NULL) ||
+          !server_handle(pb->data, &pb->length, PACKET_SIZE, client, stats)) {
+        give_buffer(&ring, base, pb);
+        returned = true;
+        continue;
+      }
+
+      send_slot *slot = &slots[bid];
+      slot->iov = (struct iovec){pb->data, pb->length};
+      slot->msg = (struct msghdr){.msg_name = &pb->sender,
+                                  .msg_namelen = pb->sender_len,
+                                  .msg_iov = &slot->iov,
+                                  .msg_iovlen = 1};
+      struct io_uring_sqe *sqe = next_sqe(&ring, counters);
+      if (sqe == NULL) {
+        fprintf(stderr, "io_uring: submission queue full\n");
+        give_buffer(&ring, base, pb);
+        returned = true;
+        failed = true;
+        break;
+      }
+      sqe->opcode = IORING_OP_SENDMSG;
+      sqe->fd = socketfd;
+      sqe->addr = (uint64_t)(uintptr_t)&slot->msg;
+      sqe->len = 1;
+      sqe->user_data = bid;
+      inflight++;
+    }
+    uring_cq_advance(&ring, seen);
+    if (received > 0)
+      stats_batch(stats, received);
+    if (returned) {
+      uring_buf_ring_publish(&ring);
+      starved = false;
+    }
+  }
+  // the kernel reads the send buffers until the sends complete, wait for
+  // them before the pool goes away. closing the ring cancels the recv
+  while (inflight > 0 && uring_submit(&ring, 1) >= 0) {
+    unsigned seen = 0;
+    struct io_uring_cqe *cqe;
+    while ((cqe = uring_peek_cqe(&ring, seen)) != NULL) {
+      seen++;
+      inflight -= cqe->user_data != RECV_USER_DATA;
+    }
+    uring_cq_advance(&ring, seen);
+  }
+  uring_destroy(&ring);
+  free(slots);
+  freelist_pool_destroy(pool);
+  return true;
+}
@@ -0,0 +1,29 @@
+#include "spsc.h"
+#include <stdlib.h>
+
+spsc_ring *spsc_create(size_t capacity) {
+  size_t size = 2;
+  while (size < capacity)
+    size <<= 1;
+  spsc_ring *ring = aligned_alloc(CACHE_LINE, sizeof(spsc_ring));
+  if (ring == NULL)
+    return NULL;
+  ring->slots = malloc(size * sizeof(void *));
+  if (ring->slots == NULL) {
+    free(ring);
+    return NULL;
+  }
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  ring->cached_head = 0;
+  ring->cached_tail = 0;
+  atomic_init(&ring->max_depth, 0);
+  ring->mask = size - 1;
+  return ring;
+}
+void spsc_destroy(spsc_ring *ring) {
+  if (ring == NULL)
+    return;
+  free(ring->slots);
+  free(ring);
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#define CACHE_LINE 64
+
+// single producer single consumer ring of pointers. exactly one thread
+// pushes and exactly one thread pops, then no lock is needed: the producer
+// only writes tail, the consumer only writes head. each side keeps a copy
+// of the other index and only reloads it (one cache miss) when the copy
+// says full/empty.
+typedef struct {
+  // consumer side
+  _Alignas(CACHE_LINE) _Atomic uint64_t head;
+  uint64_t cached_tail;
+  // highest depth the consumer found when it reloaded tail, for sizing.
+  // written by the consumer only, atomic so a stats thread can read it
+  _Atomic uint64_t max_depth;
+  // producer side
+  _Alignas(CACHE_LINE) _Atomic uint64_t tail;
+  uint64_t cached_head;
+  // read only
+  _Alignas(CACHE_LINE) size_t mask;
+  void **slots;
+} spsc_ring;
+
+// capacity is rounded up to a power of two. NULL if out of memory
+spsc_ring *spsc_create(size_t capacity);
+void spsc_destroy(spsc_ring *ring);
+
+// false if full (producer only)
+static inline bool spsc_push(spsc_ring *ring, void *item) {
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  if (tail - ring->cached_head > ring->mask) {
+    ring->cached_head =
+        atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (tail - ring->cached_head > ring->mask)
+      return false;
+  }
+  ring->slots[tail & ring->mask] = item;
+  // slot write before the new tail is visible
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
+static inline void spsc_reload_tail(spsc_ring *ring, uint64_t head) {
+  ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  uint64_t depth = ring->cached_tail - head;
+  if (depth > atomic_load_explicit(&ring->max_depth, memory_order_relaxed))
+    atomic_store_explicit(&ring->max_depth, depth, memory_order_relaxed);
+}
+// NULL if empty (consumer only)
+static inline void *spsc_pop(spsc_ring *ring) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head == ring->cached_tail) {
+    spsc_reload_tail(ring, head);
+    if (head == ring->cached_tail)
+      return NULL;
+  }
+  void *item = ring->slots[head & ring->mask];
+  // slot read before the producer may overwrite it
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return item;
+}
+// pops up to max items with one head update
+static inline size_t spsc_pop_batch(spsc_ring *ring, void **items,
+                                    size_t max) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (ring->cached_tail - head < max)
+    spsc_reload_tail(ring, head);
+  size_t n = ring->cached_tail - head;
+  if (n > max)
+    n = max;
+  for (size_t i = 0; i < n; i++)
+    items[i] = ring->slots[(head + i) & ring->mask];
+  if (n > 0)
+    atomic_store_explicit(&ring->head, head + n, memory_order_release);
+  return n;
+}
+// items in the ring right now, any thread (approximate while in use)
+static inline size_t spsc_depth(spsc_ring *ring) {
+  uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  return tail > head ? tail - head : 0;
+}
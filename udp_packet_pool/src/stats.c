@@ -0,0 +1,219 @@
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static thread_stats slots[STATS_MAX_THREADS + 1]; // + scratch
+static atomic_int registered;
+
+thread_stats *stats_register(void) {
+  int index = atomic_fetch_add(&registered, 1);
+  if (index >= STATS_MAX_THREADS)
+    return &slots[STATS_MAX_THREADS];
+  atomic_store_explicit(&slots[index].processing_min_ns, UINT64_MAX,
+                        memory_order_relaxed);
+  return &slots[index];
+}
+
+static uint64_t load(_Atomic uint64_t *counter) {
+  return atomic_load_explicit(counter, memory_order_relaxed);
+}
+void stats_collect(stats_snapshot *out) {
+  memset(out, 0, sizeof(*out));
+  histogram_reset(&out->processing_ns);
+  int threads = atomic_load(&registered);
+  if (threads > STATS_MAX_THREADS)
+    threads = STATS_MAX_THREADS;
+  out->threads = threads;
+  for (int t = 0; t < threads; t++) {
+    thread_stats *s = &slots[t];
+    out->rx_packets += load(&s->rx_packets);
+    out->rx_bytes += load(&s->rx_bytes);
+    out->tx_packets += load(&s->tx_packets);
+    out->tx_bytes += load(&s->tx_bytes);
+    out->drops += load(&s->drops);
+    out->pool_exhausted += load(&s->pool_exhausted);
+    out->throttled += load(&s->throttled);
+    out->invalid += load(&s->invalid);
+    out->duplicates += load(&s->duplicates);
+    for (int i = 0; i < STATS_BATCH_BUCKETS; i++)
+      out->batch_sizes[i] += load(&s->batch_sizes[i]);
+    histogram *h = &out->processing_ns;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+      uint64_t count = load(&s->processing_ns[i]);
+      h->counts[i] += count;
+      h->total += count;
+    }
+    uint64_t min = load(&s->processing_min_ns);
+    uint64_t max = load(&s->processing_max_ns);
+    if (min < h->min)
+      h->min = min;
+    if (max > h->max)
+      h->max = max;
+  }
+  if (out->processing_ns.total == 0)
+    out->processing_ns.min = 0;
+}
+
+size_t stats_format(const stats_snapshot *s, char *buf, size_t capacity) {
+  const histogram *h = &s->processing_ns;
+  uint64_t batches = 0;
+  for (int i = 0; i < STATS_BATCH_BUCKETS; i++)
+    batches += s->batch_sizes[i];
+  int n = snprintf(
+      buf, capacity,
+      "threads %d\nrx_packets %lu\nrx_bytes %lu\ntx_packets %lu\n"
+      "tx_bytes %lu\ndrops %lu\npool_exhausted %lu\nthrottled %lu\n"
+      "invalid %lu\nduplicates %lu\nbatches %lu\n"
+      "avg_batch %.1f\nbatch_sizes 1:%lu 2:%lu 4:%lu 8:%lu 16:%lu 32:%lu "
+      "64:%lu 128:%lu\nprocessing_ns min %lu p50 %lu p90 %lu p99 %lu "
+      "p99.9 %lu max %lu\n",
+      s->threads, (unsigned long)s->rx_packets, (unsigned long)s->rx_bytes,
+      (unsigned long)s->tx_packets, (unsigned long)s->tx_bytes,
+      (unsigned long)s->drops, (unsigned long)s->pool_exhausted,
+      (unsigned long)s->throttled, (unsigned long)s->invalid,
+      (unsigned long)s->duplicates,
+      (unsigned long)batches,
+      batches ? (double)s->rx_packets / batches : 0.0,
+      (unsigned long)s->batch_sizes[0], (unsigned long)s->batch_sizes[1],
+      (unsigned long)s->batch_sizes[2], (unsigned long)s->batch_sizes[3],
+      (unsigned long)s->batch_sizes[4], (unsigned long)s->batch_sizes[5],
+      (unsigned long)s->batch_sizes[6], (unsigned long)s->batch_sizes[7],
+      (unsigned long)h->min, (unsigned long)histogram_percentile(h, 50),
+      (unsigned long)histogram_percentile(h, 90),
+      (unsigned long)histogram_percentile(h, 99),
+      (unsigned long)histogram_percentile(h, 99.9), (unsigned long)h->max);
+  if (n < 0)
+    return 0;
+  return (size_t)n < capacity ? (size_t)n : capacity - 1;
+}
+
+bool stats_handle_request(uint8_t *data, size_t *length, size_t capacity) {
+  if (*length != sizeof(STATS_REQUEST) - 1 ||
+      memcmp(data, STATS_REQUEST, sizeof(STATS_REQUEST) - 1) != 0)
+    return false;
+  // 15 KB histogram, not on the stack of a server thread
+  static _Thread_local stats_snapshot snapshot;
+  char text[1024];
+  stats_collect(&snapshot);
+  size_t n = stats_format(&snapshot, text, sizeof(text));
+  if (n > capacity)
+    n = capacity;
+  memcpy(data, text, n);
+  *length = n;
+  return true;
+}
+
+static struct {
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  bool running;
+  int interval_ms;
+  char name[64];
+  stats_shared *shared;
+} publisher = {.lock = PTHREAD_MUTEX_INITIALIZER,
+               .wake = PTHREAD_COND_INITIALIZER};
+
+static void publish(stats_shared *shared, const stats_snapshot *snapshot) {
+  uint64_t seq = atomic_load_explicit(&shared->sequence, memory_order_relaxed);
+  atomic_store_explicit(&shared->sequence, seq + 1, memory_order_relaxed);
+  // odd sequence visible before any byte of the new snapshot
+  atomic_thread_fence(memory_order_release);
+  shared->snapshot = *snapshot;
+  shared->updated_ns = stats_now_ns();
+  atomic_store_explicit(&shared->sequence, seq + 2, memory_order_release);
+}
+static void *publish_thread(void *arg) {
+  (void)arg;
+  static stats_snapshot snapshot;
+  pthread_mutex_lock(&publisher.lock);
+  while (publisher.running) {
+    pthread_mutex_unlock(&publisher.lock);
+    stats_collect(&snapshot);
+    publish(publisher.shared, &snapshot);
+    pthread_mutex_lock(&publisher.lock);
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += publisher.interval_ms / 1000;
+    until.tv_nsec += (publisher.interval_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+      until.tv_sec++;
+      until.tv_nsec -= 1000000000L;
+    }
+    if (publisher.running)
+      pthread_cond_timedwait(&publisher.wake, &publisher.lock, &until);
+  }
+  pthread_mutex_unlock(&publisher.lock);
+  return NULL;
+}
+
+bool stats_publish_start(const char *name, int interval_ms) {
+  int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd == -1)
+    return false;
+  if (ftruncate(fd, sizeof(stats_shared)) == -1) {
+    int saved = errno;
+    close(fd);
+    shm_unlink(name);
+    errno = saved;
+    return false;
+  }
+  stats_shared *shared = mmap(NULL, sizeof(stats_shared),
+                              PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    shm_unlink(name);
+    return false;
+  }
+  memset(shared, 0, sizeof(*shared));
+  shared->magic = STATS_SHARED_MAGIC;
+  shared->version = STATS_SHARED_VERSION;
+  snprintf(publisher.name, sizeof(publisher.name), "%s", name);
+  publisher.shared = shared;
+  publisher.interval_ms = interval_ms > 0 ? interval_ms : 1000;
+  publisher.running = true;
+  int err = pthread_create(&publisher.thread, NULL, publish_thread, NULL);
+  if (err != 0) {
+    publisher.running = false;
+    munmap(shared, sizeof(stats_shared));
+    shm_unlink(name);
+    errno = err;
+    return false;
+  }
+  return true;
+}
+void stats_publish_stop(void) {
+  pthread_mutex_lock(&publisher.lock);
+  bool was_running = publisher.running;
+  publisher.running = false;
+  pthread_cond_signal(&publisher.wake);
+  pthread_mutex_unlock(&publisher.lock);
+  if (!was_running)
+    return;
+  pthread_join(publisher.thread, NULL);
+  munmap(publisher.shared, sizeof(stats_shared));
+  shm_unlink(publisher.name);
+}
+
+bool stats_read_shared(const stats_shared *shared, stats_snapshot *out) {
+  if (shared->magic != STATS_SHARED_MAGIC ||
+      shared->version != STATS_SHARED_VERSION)
+    return false;
+  while (1) {
+    uint64_t before = atomic_load_explicit(
+        (_Atomic uint64_t *)&shared->sequence, memory_order_acquire);
+    if (before & 1)
+      continue; // publisher is writing
+    *out = shared->snapshot;
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t after = atomic_load_explicit(
+        (_Atomic uint64_t *)&shared->sequence, memory_order_relaxed);
+    if (before == after)
+      return true;
+  }
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "histogram.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#define STATS_MAX_THREADS 64
+// batch sizes in power of two buckets: 1, 2-3, 4-7, ..., 64 and more
+#define STATS_BATCH_BUCKETS 8
+// a packet with exactly this payload gets the stats text back instead of
+// its echo
+#define STATS_REQUEST "stats"
+// one segment per server, the prefix and its port
+#define STATS_SHM_PREFIX "/udp_packet_pool_stats."
+
+// counters of one server thread. only that thread writes them (load, add,
+// relaxed store: no locked instruction), any thread can read them while it
+// runs. aligned so no two threads share a cache line
+typedef struct {
+  _Alignas(64) _Atomic uint64_t rx_packets;
+  _Atomic uint64_t rx_bytes;
+  _Atomic uint64_t tx_packets;
+  _Atomic uint64_t tx_bytes;
+  _Atomic uint64_t drops;          // could not be sent / queued
+  _Atomic uint64_t pool_exhausted; // wanted a buffer, the pool was empty
+  _Atomic uint64_t throttled;      // refused by the client table
+  _Atomic uint64_t invalid;        // framed mode: not a valid framed packet
+  _Atomic uint64_t duplicates;     // framed mode: sequence number seen
+  _Atomic uint64_t batch_sizes[STATS_BATCH_BUCKETS];
+  // receive -> echo handed to the kernel, buckets of histogram.h
+  _Atomic uint64_t processing_ns[HIST_BUCKETS];
+  _Atomic uint64_t processing_min_ns;
+  _Atomic uint64_t processing_max_ns;
+} thread_stats;
+
+// sum over all threads at one moment
+typedef struct {
+  int threads;
+  uint64_t rx_packets;
+  uint64_t rx_bytes;
+  uint64_t tx_packets;
+  uint64_t tx_bytes;
+  uint64_t drops;
+  uint64_t pool_exhausted;
+  uint64_t throttled;
+  uint64_t invalid;
+  uint64_t duplicates;
+  uint64_t batch_sizes[STATS_BATCH_BUCKETS];
+  histogram processing_ns;
+} stats_snapshot;
+
+// layout of the shared memory segment. sequence is odd while the publisher
+// writes snapshot, a reader copies it and retries if sequence changed
+// (seqlock), so the server never waits for a reader
+#define STATS_SHARED_MAGIC 0x75647073u // "udps"
+#define STATS_SHARED_VERSION 3
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  _Atomic uint64_t sequence;
+  uint64_t updated_ns; // CLOCK_MONOTONIC
+  stats_snapshot snapshot;
+} stats_shared;
+
+static inline uint64_t stats_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+// a slot for the calling thread, call once when a server thread starts.
+// slots are never given back; past STATS_MAX_THREADS every thread gets a
+// scratch slot that is not counted
+thread_stats *stats_register(void);
+
+static inline void stats_add(_Atomic uint64_t *counter, uint64_t n) {
+  atomic_store_explicit(
+      counter, atomic_load_explicit(counter, memory_order_relaxed) + n,
+      memory_order_relaxed);
+}
+static inline void stats_rx(thread_stats *s, uint64_t packets,
+                            uint64_t bytes) {
+  stats_add(&s->rx_packets, packets);
+  stats_add(&s->rx_bytes, bytes);
+}
+static inline void stats_tx(thread_stats *s, uint64_t packets,
+                            uint64_t bytes) {
+  stats_add(&s->tx_packets, packets);
+  stats_add(&s->tx_bytes, bytes);
+}
+static inline void stats_batch(thread_stats *s, unsigned size) {
+  unsigned bucket = size ? 31 - __builtin_clz(size) : 0;
+  if (bucket >= STATS_BATCH_BUCKETS)
+    bucket = STATS_BATCH_BUCKETS - 1;
+  stats_add(&s->batch_sizes[bucket], 1);
+}
+// count packets that all took ns
+static inline void stats_processing(thread_stats *s, uint64_t ns,
+                                    uint64_t count) {
+  stats_add(&s->processing_ns[histogram_bucket(ns)], count);
+  if (ns < atomic_load_explicit(&s->processing_min_ns, memory_order_relaxed))
+    atomic_store_explicit(&s->processing_min_ns, ns, memory_order_relaxed);
+  if (ns > atomic_load_explicit(&s->processing_max_ns, memory_order_relaxed))
+    atomic_store_explicit(&s->processing_max_ns, ns, memory_order_relaxed);
+}
+
+// sums the registered threads without stopping them
+void stats_collect(stats_snapshot *out);
+// "key value" lines, at most capacity bytes (no terminating 0 needed by the
+// caller), returns the length
+size_t stats_format(const stats_snapshot *s, char *buf, size_t capacity);
+// if data is a STATS_REQUEST, replaces it with the current stats text and
+// sets *length. true if it was one
+bool stats_handle_request(uint8_t *data, size_t *length, size_t capacity);
+
+// copies a snapshot into the shared memory segment name every interval_ms
+// from a thread of its own. false with errno set if the segment cannot be
+// created, EEXIST if it is there already (another server publishes under
+// that name, or a crashed one left it behind). the name is not taken over
+bool stats_publish_start(const char *name, int interval_ms);
+// stops the thread and removes the segment
+void stats_publish_stop(void);
+// reader side: a consistent copy of shared->snapshot, false if the segment
+// is not (yet) a stats segment
+bool stats_read_shared(const stats_shared *shared, stats_snapshot *out);
@@ -0,0 +1,61 @@
+// prints the stats a running server publishes to shared memory, without
+// touching the server (see stats.h). with an interval it keeps printing and
+// adds the rates since the last read.
+// usage: statsview [interval seconds] [server port | segment name]
+// the segment of the server on port 8888 by default, a name starting with
+// '/' is used as is
+#include "stats.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+  double interval = argc > 1 ? atof(argv[1]) : 0;
+  const char *server = argc > 2 ? argv[2] : "8888";
+  char name[64];
+  snprintf(name, sizeof(name), "%s%s",
+           server[0] == '/' ? "" : STATS_SHM_PREFIX, server);
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd == -1) {
+    fprintf(stderr, "%s: %d : %s (is the server running?)\n", name, errno,
+            strerror(errno));
+    return 1;
+  }
+  const stats_shared *shared =
+      mmap(NULL, sizeof(stats_shared), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (shared == MAP_FAILED) {
+    perror(name);
+    return 1;
+  }
+  static stats_snapshot now, last;
+  char text[1024];
+  uint64_t last_ns = 0;
+  do {
+    if (!stats_read_shared(shared, &now)) {
+      fprintf(stderr, "%s: not a stats segment\n", name);
+      return 1;
+    }
+    uint64_t updated = shared->updated_ns;
+    fwrite(text, 1, stats_format(&now, text, sizeof(text)), stdout);
+    if (last_ns != 0 && updated > last_ns) {
+      double seconds = (updated - last_ns) / 1e9;
+      printf("rx %.0f packets/s %.1f MB/s  tx %.0f packets/s %.1f MB/s\n",
+             (now.rx_packets - last.rx_packets) / seconds,
+             (now.rx_bytes - last.rx_bytes) / seconds / 1e6,
+             (now.tx_packets - last.tx_packets) / seconds,
+             (now.tx_bytes - last.tx_bytes) / seconds / 1e6);
+    }
+    printf("\n");
+    fflush(stdout);
+    last = now;
+    last_ns = updated;
+    if (interval > 0)
+      usleep(interval * 1e6);
+  } while (interval > 0);
+  return 0;
+}
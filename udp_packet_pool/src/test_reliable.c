@@ -0,0 +1,140 @@
+// reliable.h against the receiving end of protocol.c, no sockets: packets
+// go through proto_handle() with a proto_peer as the server runs it, time is
+// made up. aborts on the first failed check
+// usage: test_reliable
+#include "packet.h"
+#include "protocol.h"
+#include "reliable.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#define START_NS 1000000000ull
+#define US 1000ull
+
+static uint64_t rng_state = 88172645463325252ull;
+static uint64_t xorshift(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+// the receiver gets pb and its ack goes back to the sender at now_ns
+static int deliver(rel_sender *s, proto_peer *peer, PacketBuffer *pb,
+                   uint64_t now_ns) {
+  _Alignas(8) uint8_t data[PACKET_SIZE];
+  memcpy(data, pb->data, pb->length);
+  size_t length = pb->length;
+  proto_status status;
+  bool answered = proto_handle(data, &length, sizeof(data), peer, &status);
+  assert(answered);
+  return rel_on_ack(s, data, length, now_ns);
+}
+
+// an rtt sample brings the RTO down from the initial 50 ms to the 1 ms
+// minimum, the next lost packet has to go again after about 1 ms
+static void test_timer(void) {
+  rel_sender *s = rel_sender_create();
+  proto_peer peer = {0};
+  uint64_t now = START_NS;
+  PacketBuffer *pb = rel_send(s, "a", 1, now);
+  assert(deliver(s, &peer, pb, now + 200 * US) == 1);
+  assert(s->rto_ns == REL_MIN_RTO_NS);
+
+  now += 300 * US;
+  pb = rel_send(s, "b", 1, now); // lost
+  assert(pb != NULL);
+  PacketBuffer *again[REL_RING];
+  assert(rel_poll(s, now + 900 * US, again, REL_RING) == 0);
+  assert(rel_next_timer(s) <= now + REL_MIN_RTO_NS + 2 * REL_TICK_NS);
+  assert(rel_poll(s, now + 1200 * US, again, REL_RING) == 1);
+  assert(again[0] == pb && s->timeouts == 1);
+  assert(deliver(s, &peer, again[0], now + 1300 * US) == 1);
+  assert(rel_idle(s));
+  rel_sender_destroy(s);
+  printf("timer: ok\n");
+}
+
+// REL_DUPTHRESH sacked packets after a hole send it again without a timeout
+static void test_fast_retransmit(void) {
+  rel_sender *s = rel_sender_create();
+  proto_peer peer = {0};
+  uint64_t now = START_NS;
+  PacketBuffer *sent[4];
+  for (int i = 0; i < 4; i++)
+    assert((sent[i] = rel_send(s, "x", 1, now)) != NULL);
+  PacketBuffer *again[REL_RING];
+  for (int i = 1; i < 4; i++)
+    deliver(s, &peer, sent[i], now + 100 * US);
+  assert(s->fast_retransmits == 1 && s->recovery);
+  assert(rel_poll(s, now + 100 * US, again, REL_RING) == 1);
+  assert(again[0] == sent[0] && s->timeouts == 0);
+  assert(deliver(s, &peer, again[0], now + 200 * US) == 1);
+  assert(rel_idle(s) && s->delivered == 4 && !s->recovery);
+  rel_sender_destroy(s);
+  printf("fast retransmit: ok\n");
+}
+
+// random loss both ways and reordering: every packet arrives exactly once
+// (the receiver counts only PROTO_OK), the sender's pipe never goes wrong
+static void test_loss(void) {
+  rel_sender *s = rel_sender_create();
+  proto_peer peer = {0};
+  uint64_t now = START_NS;
+  enum { PACKETS = 20000, WIRE = 256 };
+  struct {
+    PacketBuffer *pb;
+    uint64_t at;
+  } wire[WIRE];
+  int in_wire = 0;
+  long queued = 0, received = 0;
+  while ((long)s->delivered < PACKETS) {
+    PacketBuffer *pb;
+    PacketBuffer *out[REL_RING];
+    int n = 0;
+    while (queued < PACKETS && (pb = rel_send(s, &queued, 8, now))) {
+      out[n++] = pb;
+      queued++;
+    }
+    n += rel_poll(s, now, out + n, REL_RING - n);
+    for (int i = 0; i < n && in_wire < WIRE; i++) {
+      if (xorshift() % 100 < 5)
+        continue; // lost on the way there
+      wire[in_wire].pb = out[i];
+      wire[in_wire++].at = now + 100 * US + xorshift() % (200 * US);
+    }
+    for (int i = 0; i < in_wire;) {
+      if (wire[i].at > now) {
+        i++;
+        continue;
+      }
+      _Alignas(8) uint8_t data[PACKET_SIZE];
+      memcpy(data, wire[i].pb->data, wire[i].pb->length);
+      size_t length = wire[i].pb->length;
+      proto_status status;
+      // a buffer in the wire may have been acked and reused meanwhile,
+      // then it is a copy of a newer packet: also fine for the receiver
+      if (proto_handle(data, &length, sizeof(data), &peer, &status)) {
+        if (status == PROTO_OK)
+          received++;
+        if (xorshift() % 100 >= 5) // the ack can get lost too
+          rel_on_ack(s, data, length, now);
+      }
+      wire[i] = wire[--in_wire];
+    }
+    assert(s->pipe <= s->next_seq - s->una);
+    now += 10 * US;
+  }
+  assert(received == PACKETS && s->delivered == PACKETS);
+  assert(rel_idle(s));
+  printf("loss: ok, %lu fast retransmits, %lu timeouts\n",
+         (unsigned long)s->fast_retransmits, (unsigned long)s->timeouts);
+  rel_sender_destroy(s);
+}
+
+int main(void) {
+  test_timer();
+  test_fast_retransmit();
+  test_loss();
+  return 0;
+}
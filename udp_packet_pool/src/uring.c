@@ -0,0 +1,171 @@
+#include "uring.h"
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+static int io_uring_enter(int fd, unsigned submit, unsigned wait,
+                          unsigned flags) {
+  return syscall(__NR_io_uring_enter, fd, submit, wait, flags, NULL, 0);
+}
+static int io_uring_enter_arg(int fd, unsigned submit, unsigned wait,
+                              unsigned flags,
+                              struct io_uring_getevents_arg *arg) {
+  return syscall(__NR_io_uring_enter, fd, submit, wait,
+                 flags | IORING_ENTER_EXT_ARG, arg, sizeof(*arg));
+}
+static int io_uring_register(int fd, unsigned opcode, void *arg,
+                             unsigned nr) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr);
+}
+
+bool uring_init(uring *ring, unsigned entries) {
+  memset(ring, 0, sizeof(*ring));
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+  // one thread submits and reaps, the kernel can skip the task work irqs
+  p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+  p.cq_entries = entries * 4;
+  p.flags |= IORING_SETUP_CQSIZE;
+  ring->fd = io_uring_setup(entries, &p);
+  if (ring->fd == -1 && errno == EINVAL) {
+    // older kernel without the flags
+    memset(&p, 0, sizeof(p));
+    ring->fd = io_uring_setup(entries, &p);
+  }
+  if (ring->fd == -1)
+    return false;
+  ring->entries = p.sq_entries;
+  ring->features = p.features;
+  ring->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_ring_size =
+      p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (ring->cq_ring_size > ring->sq_ring_size)
+      ring->sq_ring_size = ring->cq_ring_size;
+    ring->cq_ring_size = ring->sq_ring_size;
+  }
+  ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+  if (ring->sq_ring == MAP_FAILED)
+    goto fail;
+  ring->cq_ring = ring->sq_ring;
+  if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+    ring->cq_ring =
+        mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ring == MAP_FAILED)
+      goto fail;
+  }
+  ring->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED)
+    goto fail;
+  uint8_t *sq = ring->sq_ring, *cq = ring->cq_ring;
+  ring->sq_head = (unsigned *)(sq + p.sq_off.head);
+  ring->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array = (unsigned *)(sq + p.sq_off.array);
+  ring->sq_local_tail = *ring->sq_tail;
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return true;
+fail:;
+  int saved = errno;
+  uring_destroy(ring);
+  errno = saved;
+  return false;
+}
+void uring_destroy(uring *ring) {
+  if (ring->buf_ring != NULL)
+    munmap(ring->buf_ring,
+           ring->buf_entries * sizeof(struct io_uring_buf));
+  if (ring->sqes != NULL && ring->sqes != MAP_FAILED)
+    munmap(ring->sqes, ring->sqes_size);
+  if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED &&
+      ring->cq_ring != ring->sq_ring)
+    munmap(ring->cq_ring, ring->cq_ring_size);
+  if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED)
+    munmap(ring->sq_ring, ring->sq_ring_size);
+  if (ring->fd > 0)
+    close(ring->fd);
+  memset(ring, 0, sizeof(*ring));
+}
+struct io_uring_sqe *uring_get_sqe(uring *ring) {
+  unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+  if (ring->sq_local_tail - head >= ring->entries)
+    return NULL;
+  unsigned index = ring->sq_local_tail & *ring->sq_mask;
+  struct io_uring_sqe *sqe = &ring->sqes[index];
+  ring->sq_array[index] = index;
+  ring->sq_local_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+int uring_submit(uring *ring, unsigned wait_nr) {
+  unsigned submit = ring->sq_local_tail - *ring->sq_tail;
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  return io_uring_enter(ring->fd, submit, wait_nr,
+                        wait_nr ? IORING_ENTER_GETEVENTS : 0);
+}
+int uring_submit_wait(uring *ring, unsigned wait_nr, uint64_t timeout_ns) {
+  if (!(ring->features & IORING_FEAT_EXT_ARG))
+    return uring_submit(ring, 1);
+  unsigned submit = ring->sq_local_tail - *ring->sq_tail;
+  __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+  struct __kernel_timespec ts = {timeout_ns / 1000000000,
+                                 timeout_ns % 1000000000};
+  struct io_uring_getevents_arg arg = {0, 0, 0, (uint64_t)(uintptr_t)&ts};
+  return io_uring_enter_arg(ring->fd, submit, wait_nr,
+                            IORING_ENTER_GETEVENTS, &arg);
+}
+struct io_uring_cqe *uring_peek_cqe(uring *ring, unsigned offset) {
+  unsigned head = *ring->cq_head + offset;
+  if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    return NULL;
+  return &ring->cqes[head & *ring->cq_mask];
+}
+void uring_cq_advance(uring *ring, unsigned n) {
+  __atomic_store_n(ring->cq_head, *ring->cq_head + n, __ATOMIC_RELEASE);
+}
+bool uring_setup_buf_ring(uring *ring, unsigned entries) {
+  size_t size = entries * sizeof(struct io_uring_buf);
+  void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (memory == MAP_FAILED)
+    return false;
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t)(uintptr_t)memory;
+  reg.ring_entries = entries;
+  reg.bgid = 0;
+  if (io_uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+    int saved = errno;
+    munmap(memory, size);
+    errno = saved;
+    return false;
+  }
+  ring->buf_ring = memory;
+  ring->buf_entries = entries;
+  ring->buf_tail = 0;
+  return true;
+}
+void uring_buf_ring_add(uring *ring, void *addr, unsigned length,
+                        uint16_t bid) {
+  struct io_uring_buf *buf =
+      &ring->buf_ring->bufs[ring->buf_tail & (ring->buf_entries - 1)];
+  buf->addr = (uint64_t)(uintptr_t)addr;
+  buf->len = length;
+  buf->bid = bid;
+  ring->buf_tail++;
+}
+void uring_buf_ring_publish(uring *ring) {
+  __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
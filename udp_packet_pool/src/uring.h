@@ -0,0 +1,50 @@
+#pragma once
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// just enough io_uring for the server, straight on the syscalls (no
+// liburing): the two mmapped rings, sqe/cqe helpers and one provided
+// buffer ring
+typedef struct {
+  int fd;
+  unsigned entries;
+  unsigned features; // IORING_FEAT_*
+  // submission ring, tail is only published in uring_submit()
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned sq_local_tail;
+  struct io_uring_sqe *sqes;
+  // completion ring
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+  void *sq_ring, *cq_ring;
+  size_t sq_ring_size, cq_ring_size, sqes_size;
+  // provided buffers (group 0)
+  struct io_uring_buf_ring *buf_ring;
+  unsigned buf_entries; // power of two
+  uint16_t buf_tail;
+} uring;
+
+// false with errno set (ENOSYS/EPERM if io_uring is not available)
+bool uring_init(uring *ring, unsigned entries);
+void uring_destroy(uring *ring);
+// NULL if the submission ring is full, submit first
+struct io_uring_sqe *uring_get_sqe(uring *ring);
+// publishes the new sqes and waits for at least wait_nr completions in the
+// same io_uring_enter call, returns its result
+int uring_submit(uring *ring, unsigned wait_nr);
+// uring_submit() that also returns once timeout_ns passed (-1 with errno
+// ETIME when nothing else ended the wait). without IORING_FEAT_EXT_ARG
+// (before 5.11) it waits for one completion, no timeout
+int uring_submit_wait(uring *ring, unsigned wait_nr, uint64_t timeout_ns);
+// next completion or NULL, uring_cq_advance() after handling n of them
+struct io_uring_cqe *uring_peek_cqe(uring *ring, unsigned offset);
+void uring_cq_advance(uring *ring, unsigned n);
+// registers buffer group 0 with room for entries buffers (power of two)
+bool uring_setup_buf_ring(uring *ring, unsigned entries);
+// queues a buffer for the kernel, visible after uring_buf_ring_publish().
+// neither is a syscall, the kernel reads the ring tail from memory
+void uring_buf_ring_add(uring *ring, void *addr, unsigned length,
+                        uint16_t bid);
+void uring_buf_ring_publish(uring *ring);